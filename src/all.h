@@ -11,19 +11,41 @@
 #define semistatic static
 #endif
 
+#include <archive.h>
+#include <archive_entry.h>
 #include <curl/curl.h>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <search.h>
 #include <signal.h>
 #include <glob.h>
 #include <json-c/json.h>
 #include <openssl/evp.h>
+#include <poll.h>
+#include <sqfs/block_processor.h>
+#include <sqfs/block_writer.h>
+#include <sqfs/compressor.h>
+#include <sqfs/dir_writer.h>
+#include <sqfs/error.h>
+#include <sqfs/frag_table.h>
+#include <sqfs/id_table.h>
+#include <sqfs/inode.h>
+#include <sqfs/io.h>
+#include <sqfs/meta_writer.h>
+#include <sqfs/super.h>
+#include <sqfs/xattr_writer.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -44,13 +66,32 @@
 #include "phases/live/configure.h"
 #include "phases/live/install.h"
 #include "phases/live/autostart.h"
-#include "phases/live/embed.h"
 #include "phases/live/bundle.h"
 #include "phases/live/live.h"
+#include "phases/assembly/esp.h"
 #include "phases/assembly/grub.h"
+#include "phases/assembly/uki.h"
+#include "phases/assembly/squashfs.h"
 #include "phases/assembly/iso.h"
 #include "phases/assembly/assembly.h"
+#include "phases/pipeline.h"
+#include "utils/options.h"
+#include "utils/payload.h"
+#include "utils/ramdisk.h"
 #include "utils/rootfs.h"
+#include "utils/derive.h"
+#include "utils/manifest.h"
+#include "utils/archiver.h"
+#include "utils/cache.h"
+#include "utils/block_cache.h"
+#include "utils/squashfs_writer.h"
+#include "utils/iso_image.h"
+#include "utils/scheduler.h"
+#include "utils/fingerprint.h"
+#include "utils/initramfs.h"
+#include "utils/boot_trace.h"
+#include "utils/triggers.h"
+#include "utils/unsafe_io.h"
 #include "utils/dependencies.h"
 #include "utils/branding/identity.h"
 #include "utils/branding/plymouth.h"
@@ -20,6 +20,54 @@
 /** The prefix for temporary build directories. */
 #define CONFIG_TMPDIR_PREFIX "/tmp/limeos-build-"
 
+// ---
+// Cache Configuration
+// ---
+
+/** The directory where build artifacts are cached across builds. */
+#define CONFIG_CACHE_DIR "/var/cache/limeos-iso-builder"
+
+/** The directory where generated initramfs images are cached. */
+#define CONFIG_INITRAMFS_CACHE_DIR CONFIG_CACHE_DIR "/initramfs"
+
+/** The directory where live squashfs images are cached. */
+#define CONFIG_SQUASHFS_CACHE_DIR CONFIG_CACHE_DIR "/squashfs"
+
+/** The directory where compressed squashfs data blocks are cached. */
+#define CONFIG_SQUASHFS_BLOCK_CACHE_DIR CONFIG_SQUASHFS_CACHE_DIR "/blocks"
+
+/** The size the initramfs image cache is pruned down to, in MiB. */
+#define CONFIG_INITRAMFS_CACHE_MAX_MIB 1024
+
+/** The size the squashfs image cache is pruned down to, in MiB. */
+#define CONFIG_SQUASHFS_CACHE_MAX_MIB 16384
+
+/** The size the squashfs block cache is pruned down to, in MiB. */
+#define CONFIG_SQUASHFS_BLOCK_CACHE_MAX_MIB 16384
+
+/** The directory where GRUB boot images are cached. */
+#define CONFIG_GRUB_CACHE_DIR CONFIG_CACHE_DIR "/grub"
+
+// ---
+// Memory Configuration
+// ---
+
+/**
+ * The estimated peak sizes of the build directories in MiB.
+ *
+ * Used with --ram-budget to decide which directories fit in RAM. The live
+ * estimate includes the target payload written into it. The staging estimate
+ * covers what ISO assembly stages: the live squashfs, the kernel and initrd,
+ * the EFI image, and the target payload moved out of the live rootfs.
+ */
+#define CONFIG_BASE_ROOTFS_ESTIMATE_MIB 500
+#define CONFIG_LIVE_ROOTFS_ESTIMATE_MIB 2000
+#define CONFIG_TARGET_ROOTFS_ESTIMATE_MIB 2800
+#define CONFIG_STAGING_ESTIMATE_MIB 2500
+
+/** The memory kept free for build processes when sizing the RAM budget. */
+#define CONFIG_RAM_RESERVE_MIB 2048
+
 // ---
 // Github Configuration
 // ---
@@ -81,6 +129,18 @@
     "nouveau.modeset=1 "                /* Force nouveau KMS early.         */ \
     "i915.modeset=1"                    /* Force i915 KMS early.            */
 
+/**
+ * The prefix of the volume ID stamped on each ISO.
+ *
+ * A random suffix makes the ID unique per build, and the live kernel command
+ * line names it in a `live-media=` hint, so live-boot mounts that volume
+ * instead of probing every block device for the live squashfs.
+ */
+#define CONFIG_ISO_VOLUME_ID_PREFIX "LIMEOS_"
+
+/** The directory udev links block devices into by filesystem label. */
+#define CONFIG_LIVE_MEDIA_LABEL_DIR "/dev/disk/by-label"
+
 /** The default kernel image path within the ISO. */
 #define CONFIG_BOOT_KERNEL_PATH "/boot/vmlinuz"
 
@@ -90,6 +150,103 @@
 /** The GRUB menu entry name displayed during boot. */
 #define CONFIG_GRUB_MENU_ENTRY_NAME "LimeOS Installer"
 
+/**
+ * The GRUB modules built into the boot images with the minimal GRUB profile.
+ *
+ * These exist on every platform and cover reading the ISO, finding it by
+ * volume label, running the hidden single-entry menu, and booting Linux.
+ */
+#define CONFIG_GRUB_MINIMAL_MODULES \
+    "normal "                           /* Read grub.cfg and run its menu.  */ \
+    "test "                             /* Check the platform in grub.cfg.  */ \
+    "search "                           /* Find the boot medium.            */ \
+    "search_label "                     /* Find it by volume label (EFI).   */ \
+    "iso9660 "                          /* Read the ISO filesystem.         */ \
+    "part_msdos "                       /* Read the hybrid MBR.             */ \
+    "part_gpt "                         /* Read the hybrid GPT.             */ \
+    "linux "                            /* Load the kernel and initrd.      */ \
+    "video "                            /* Video subsystem.                 */ \
+    "gfxterm"                           /* Graphical terminal.              */
+
+/**
+ * The GRUB video drivers installed with the minimal GRUB profile.
+ *
+ * Each exists on one platform only, so grub.cfg loads the ones matching the
+ * firmware instead of every driver (all_video).
+ */
+#define CONFIG_GRUB_MINIMAL_VIDEO_MODULES \
+    "efi_gop "                          /* UEFI graphics output protocol.   */ \
+    "efi_uga "                          /* UEFI graphics on older Macs.     */ \
+    "vbe "                              /* BIOS VESA framebuffer.           */ \
+    "vga"                               /* BIOS VGA fallback.               */
+
+// ---
+// Initramfs Configuration
+// ---
+
+/**
+ * The default compressor for initramfs images: "zstd", "lz4", or "xz".
+ *
+ * GRUB loads the initrd from slow optical and USB media, so image size
+ * matters as much as decompression speed. zstd balances both, lz4 favors
+ * decompression speed, and xz favors size. Each codec's level and package
+ * come from the initramfs codec table (see find_initramfs_codec()).
+ */
+#define CONFIG_INITRAMFS_CODEC "zstd"
+
+/**
+ * The default initramfs module policy: "list" or "most".
+ *
+ * list includes only the modules of the module classes each image declares
+ * (see CONFIG_LIVE_INITRAMFS_CLASSES), for a smaller initrd that loads and
+ * unpacks faster. most includes the drivers of nearly all hardware, for
+ * machines outside the supported hardware. most stays the default until the
+ * class lists have been validated on real hardware.
+ */
+#define CONFIG_INITRAMFS_MODULES "most"
+
+/** Disk, optical drive, and memory card controllers. */
+#define CONFIG_INITRAMFS_STORAGE_MODULES \
+    "ahci ata_piix ata_generic pata_acpi sd_mod sr_mod "  /* SATA/PATA, disks. */ \
+    "mptspi mpt3sas megaraid_sas "                        /* SAS/RAID HBAs.    */ \
+    "vmw_pvscsi hv_storvsc "                              /* VMware, Hyper-V.  */ \
+    "mmc_block sdhci_pci sdhci_acpi"                      /* SD/eMMC.          */
+
+/** USB host controllers, USB drives, and USB keyboards. */
+#define CONFIG_INITRAMFS_USB_MODULES \
+    "xhci_pci ehci_pci ohci_pci uhci_hcd "                /* Host controllers. */ \
+    "usb_storage uas "                                    /* USB drives.       */ \
+    "usbhid hid_generic"                                  /* Keyboards.        */
+
+/** Virtio disk and SCSI controllers of KVM and QEMU guests. */
+#define CONFIG_INITRAMFS_VIRTIO_MODULES "virtio_pci virtio_blk virtio_scsi"
+
+/** NVMe drives, including those behind Intel VMD (RST) controllers. */
+#define CONFIG_INITRAMFS_NVME_MODULES "nvme vmd"
+
+/** Laptop keyboards and touchpads connected over I2C. */
+#define CONFIG_INITRAMFS_INPUT_MODULES "i2c_hid i2c_hid_acpi hid_multitouch"
+
+/** GPU drivers loaded early for kernel mode setting. */
+#define CONFIG_INITRAMFS_GPU_MODULES "amdgpu i915 nouveau radeon"
+
+/** Filesystems live-boot mounts the live system from. */
+#define CONFIG_INITRAMFS_LIVE_MEDIA_MODULES "isofs squashfs overlay loop"
+
+/**
+ * Filesystems the installed system's root and EFI system partition can be
+ * on, with the code pages vfat mounts with by default.
+ */
+#define CONFIG_INITRAMFS_ROOT_FS_MODULES "ext4 vfat nls_cp437 nls_ascii"
+
+/** The initramfs module classes of the live image. */
+#define CONFIG_LIVE_INITRAMFS_CLASSES \
+    "storage usb input virtio nvme gpu live-media"
+
+/** The initramfs module classes of the target image. */
+#define CONFIG_TARGET_INITRAMFS_CLASSES \
+    "storage usb input virtio nvme gpu root-fs"
+
 // ---
 // Plymouth Configuration
 // ---
@@ -132,8 +289,131 @@
 /** The installation path for component binaries (relative to rootfs). */
 #define CONFIG_INSTALL_BIN_PATH "/usr/local/bin"
 
-/** The path where the target tarball is stored in the live rootfs. */
-#define CONFIG_TARGET_ROOTFS_PATH "/usr/share/limeos/rootfs.tar.gz"
+/** The directory where the target payload is stored in the live rootfs. */
+#define CONFIG_TARGET_PAYLOAD_DIR "/usr/share/limeos"
+
+/**
+ * The base name of the target payload, before the format and codec extensions.
+ *
+ * Example: "rootfs" as a gzip tarball produces "rootfs.tar.gz".
+ */
+#define CONFIG_TARGET_PAYLOAD_NAME "rootfs"
+
+/**
+ * The name of the file describing the target payload, stored next to it.
+ *
+ * Holds shell-style KEY=value lines naming the payload's format, codec, and
+ * file, so the installer can pick the matching extraction path.
+ */
+#define CONFIG_TARGET_PAYLOAD_INFO_NAME "payload.conf"
+
+/**
+ * The default format for the target payload: "tar", "chunked", "squashfs",
+ * or "erofs".
+ *
+ * tar is extracted serially by the installer. chunked splits the tarball into
+ * independently compressed chunks listed in an index, which can be extracted
+ * in parallel and resumed. squashfs and erofs images can be mounted, or
+ * unpacked in parallel (e.g. with `unsquashfs -p`).
+ */
+#define CONFIG_PAYLOAD_FORMAT "tar"
+
+/**
+ * The uncompressed file content per chunk of a chunked payload in MiB.
+ *
+ * Smaller chunks spread better across installer threads and lose less work
+ * when an interrupted installation resumes, at a small cost in ratio.
+ */
+#define CONFIG_PAYLOAD_CHUNK_MIB 64
+
+/**
+ * The default placement of the target payload: "squashfs" or "iso".
+ *
+ * squashfs keeps it inside the live rootfs. iso stores it as a plain file
+ * next to the live squashfs so it is not compressed a second time, and links
+ * it into the live rootfs from the mounted boot medium.
+ */
+#define CONFIG_PAYLOAD_PLACEMENT "squashfs"
+
+/**
+ * The default squashfs profile for the live filesystem: "dev" or "release".
+ *
+ * dev uses fast low-level zstd for quick iteration. release uses xz with the
+ * x86 BCJ filter and 1 MiB blocks for the smallest ISO.
+ */
+#define CONFIG_SQUASHFS_PROFILE "release"
+
+/**
+ * The default writer for the live squashfs: "native" or "mksquashfs".
+ *
+ * native writes the image in-process with libsquashfs from the builder's own
+ * walk of the tree, compressing across all CPUs and caching compressed data
+ * blocks, so blocks of unchanged files are not compressed again by later
+ * builds. mksquashfs stays the default until the native writer's round-trip
+ * test has passed in CI.
+ */
+#define CONFIG_SQUASHFS_WRITER "mksquashfs"
+
+/**
+ * The default GRUB profile: "full" or "minimal".
+ *
+ * full installs every GRUB module and loads all video drivers at boot.
+ * minimal installs only the modules the hidden single-entry menu needs,
+ * builds them into the boot images, and loads only the firmware's video
+ * driver, for smaller boot images and less time spent in GRUB.
+ */
+#define CONFIG_GRUB_PROFILE "full"
+
+/**
+ * The default UEFI boot path: "grub" or "uki".
+ *
+ * grub boots UEFI machines through GRUB's EFI image, like BIOS machines.
+ * uki makes the default EFI loader a unified kernel image joining the live
+ * kernel, initrd, and command line, so firmware starts the kernel directly.
+ * BIOS machines boot through GRUB either way.
+ */
+#define CONFIG_EFI_BOOT "grub"
+
+/**
+ * The systemd EFI stub ukify builds unified kernel images on, installed by
+ * the systemd-boot-efi package.
+ */
+#define CONFIG_UKI_EFI_STUB_PATH "/usr/lib/systemd/boot/efi/linuxx64.efi.stub"
+
+/**
+ * The default way of assembling the ISO: "staging", "graft", or "stream".
+ *
+ * staging copies the kernel and initrd into the staging directory next to
+ * the squashfs. graft maps them onto the ISO straight from the live rootfs
+ * with xorriso graft points and keeps them out of the squashfs instead, so
+ * they are never written a second time. stream grafts them too, and writes
+ * the squashfs straight into the finished ISO after its last sector rather
+ * than into staging, so it is not written once and then copied.
+ */
+#define CONFIG_ASSEMBLY_MODE "staging"
+
+/** How long the --boot-trace service records file accesses, in seconds. */
+#define CONFIG_BOOT_TRACE_SECONDS 120
+
+/** The path where live-boot mounts the boot medium in the live system. */
+#define CONFIG_LIVE_MEDIUM_PATH "/run/live/medium"
+
+/**
+ * The name of the squashfs holding the base rootfs in layered builds.
+ *
+ * Stored in the ISO's live directory and shared by the live system, which
+ * stacks its own delta on top, and the installer, which stacks the target
+ * delta on top.
+ */
+#define CONFIG_BASE_LAYER_NAME "base.squashfs"
+
+/**
+ * The default codec for the target payload: "gzip", "zstd", or "xz".
+ *
+ * gzip keeps the historical rootfs.tar.gz path and is compressed with pigz
+ * when available. zstd decompresses several times faster during installation.
+ */
+#define CONFIG_PAYLOAD_CODEC "gzip"
 
 /** The APT cache directory where bootloader packages are pre-populated. */
 #define CONFIG_APT_CACHE_DIR "/var/cache/apt/archives"
@@ -5,6 +5,26 @@
 
 #include "all.h"
 
+/** Identifiers for long options without a short equivalent. */
+enum
+{
+    OPTION_UNSAFE_IO = 256,
+    OPTION_RAM_BUDGET,
+    OPTION_PAYLOAD_CODEC,
+    OPTION_PAYLOAD_FORMAT,
+    OPTION_PAYLOAD_PLACEMENT,
+    OPTION_LAYERED,
+    OPTION_SQUASHFS_PROFILE,
+    OPTION_SQUASHFS_SORT,
+    OPTION_BOOT_TRACE,
+    OPTION_SQUASHFS_WRITER,
+    OPTION_ASSEMBLY_MODE,
+    OPTION_GRUB_PROFILE,
+    OPTION_EFI_BOOT,
+    OPTION_INITRAMFS_MODULES,
+    OPTION_INITRAMFS_CODEC
+};
+
 static void print_usage(const char *program_name)
 {
     printf("Usage: %s <version> [options]\n", program_name);
@@ -13,6 +33,33 @@ static void print_usage(const char *program_name)
     printf("  <version>       Version tag to build (e.g., 1.0.0)\n");
     printf("\n");
     printf("Options:\n");
+    printf("  --unsafe-io     Skip fsync during package installation\n");
+    printf("  --ram-budget=MiB\n");
+    printf("                  Build in a tmpfs of up to MiB, spilling to disk\n");
+    printf("  --payload-codec=gzip|zstd|xz\n");
+    printf("                  Compress the target payload (default: %s)\n", CONFIG_PAYLOAD_CODEC);
+    printf("  --payload-format=tar|chunked|squashfs|erofs\n");
+    printf("                  Store the target payload as (default: %s)\n", CONFIG_PAYLOAD_FORMAT);
+    printf("  --payload-placement=squashfs|iso\n");
+    printf("                  Store the target payload in (default: %s)\n", CONFIG_PAYLOAD_PLACEMENT);
+    printf("  --layered       Ship the base once, shared by live and target\n");
+    printf("  --squashfs-profile=dev|release\n");
+    printf("                  Build the live squashfs with (default: %s)\n", CONFIG_SQUASHFS_PROFILE);
+    printf("  --squashfs-writer=mksquashfs|native\n");
+    printf("                  Write the live squashfs with (default: %s)\n", CONFIG_SQUASHFS_WRITER);
+    printf("  --squashfs-sort=FILE\n");
+    printf("                  Order the live squashfs by a boot trace log\n");
+    printf("  --boot-trace    Record file accesses while the live system boots\n");
+    printf("  --assembly-mode=staging|graft|stream\n");
+    printf("                  Assemble the ISO by (default: %s)\n", CONFIG_ASSEMBLY_MODE);
+    printf("  --grub-profile=full|minimal\n");
+    printf("                  Build the GRUB boot images with (default: %s)\n", CONFIG_GRUB_PROFILE);
+    printf("  --efi-boot=grub|uki\n");
+    printf("                  Boot UEFI machines through (default: %s)\n", CONFIG_EFI_BOOT);
+    printf("  --initramfs-modules=list|most\n");
+    printf("                  Select initramfs modules by (default: %s)\n", CONFIG_INITRAMFS_MODULES);
+    printf("  --initramfs-codec=zstd|lz4|xz\n");
+    printf("                  Compress initramfs images with (default: %s)\n", CONFIG_INITRAMFS_CODEC);
     printf("  --help          Show this help message\n");
 }
 
@@ -20,11 +67,7 @@ int main(int argc, char *argv[])
 {
     const char *version = NULL;
     char build_dir[COMMON_MAX_PATH_LENGTH];
-    char components_dir[COMMON_MAX_PATH_LENGTH];
-    char base_rootfs_dir[COMMON_MAX_PATH_LENGTH];
-    char target_rootfs_dir[COMMON_MAX_PATH_LENGTH];
-    char target_tarball_path[COMMON_MAX_PATH_LENGTH];
-    char live_rootfs_dir[COMMON_MAX_PATH_LENGTH];
+    BuildContext build = {0};
     int exit_code = 0;
 
     // Verify the program is running as root.
@@ -58,6 +101,21 @@ int main(int argc, char *argv[])
     // Parse command-line arguments.
     int option;
     static struct option long_options[] = {
+        {"unsafe-io", no_argument, 0, OPTION_UNSAFE_IO},
+        {"ram-budget", required_argument, 0, OPTION_RAM_BUDGET},
+        {"payload-codec", required_argument, 0, OPTION_PAYLOAD_CODEC},
+        {"payload-format", required_argument, 0, OPTION_PAYLOAD_FORMAT},
+        {"payload-placement", required_argument, 0, OPTION_PAYLOAD_PLACEMENT},
+        {"layered", no_argument, 0, OPTION_LAYERED},
+        {"squashfs-profile", required_argument, 0, OPTION_SQUASHFS_PROFILE},
+        {"squashfs-writer", required_argument, 0, OPTION_SQUASHFS_WRITER},
+        {"squashfs-sort", required_argument, 0, OPTION_SQUASHFS_SORT},
+        {"boot-trace", no_argument, 0, OPTION_BOOT_TRACE},
+        {"assembly-mode", required_argument, 0, OPTION_ASSEMBLY_MODE},
+        {"grub-profile", required_argument, 0, OPTION_GRUB_PROFILE},
+        {"efi-boot", required_argument, 0, OPTION_EFI_BOOT},
+        {"initramfs-modules", required_argument, 0, OPTION_INITRAMFS_MODULES},
+        {"initramfs-codec", required_argument, 0, OPTION_INITRAMFS_CODEC},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
@@ -65,6 +123,59 @@ int main(int argc, char *argv[])
     {
         switch (option)
         {
+            case OPTION_UNSAFE_IO:
+                build_options.unsafe_io = 1;
+                break;
+            case OPTION_RAM_BUDGET:
+            {
+                char *end;
+                build_options.ram_budget_mib = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || build_options.ram_budget_mib <= 0)
+                {
+                    LOG_ERROR("Invalid RAM budget: %s (expected a size in MiB)", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case OPTION_PAYLOAD_CODEC:
+                build_options.payload_codec = optarg;
+                break;
+            case OPTION_PAYLOAD_FORMAT:
+                build_options.payload_format = optarg;
+                break;
+            case OPTION_PAYLOAD_PLACEMENT:
+                build_options.payload_placement = optarg;
+                break;
+            case OPTION_LAYERED:
+                build_options.layered = 1;
+                break;
+            case OPTION_SQUASHFS_PROFILE:
+                build_options.squashfs_profile = optarg;
+                break;
+            case OPTION_SQUASHFS_WRITER:
+                build_options.squashfs_writer = optarg;
+                break;
+            case OPTION_SQUASHFS_SORT:
+                build_options.squashfs_sort = optarg;
+                break;
+            case OPTION_BOOT_TRACE:
+                build_options.boot_trace = 1;
+                break;
+            case OPTION_ASSEMBLY_MODE:
+                build_options.assembly_mode = optarg;
+                break;
+            case OPTION_GRUB_PROFILE:
+                build_options.grub_profile = optarg;
+                break;
+            case OPTION_EFI_BOOT:
+                build_options.efi_boot = optarg;
+                break;
+            case OPTION_INITRAMFS_MODULES:
+                build_options.initramfs_modules = optarg;
+                break;
+            case OPTION_INITRAMFS_CODEC:
+                build_options.initramfs_codec = optarg;
+                break;
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -74,6 +185,13 @@ int main(int argc, char *argv[])
         }
     }
 
+    // Validate the selected options and their dependencies.
+    if (validate_option_dependencies() != 0)
+    {
+        LOG_ERROR("Invalid options, cannot continue");
+        return 1;
+    }
+
     // Validate that a version argument was provided.
     if (optind >= argc)
     {
@@ -100,58 +218,68 @@ int main(int argc, char *argv[])
     // Install signal handlers for graceful shutdown.
     common.install_signal_handlers(build_dir);
 
-    // Construct derived paths.
-    snprintf(components_dir, sizeof(components_dir), "%s/components", build_dir);
-    snprintf(base_rootfs_dir, sizeof(base_rootfs_dir), "%s/base-rootfs", build_dir);
-    snprintf(target_rootfs_dir, sizeof(target_rootfs_dir), "%s/target-rootfs", build_dir);
-    snprintf(target_tarball_path, sizeof(target_tarball_path), "%s/rootfs.tar.gz", build_dir);
-    snprintf(live_rootfs_dir, sizeof(live_rootfs_dir), "%s/live-rootfs", build_dir);
-
-    LOG_INFO("Building ISO for version %s", version);
-
-    // Phase 1: Preparation - fetch components from GitHub.
-    if (run_preparation_phase(version, components_dir) != 0)
+    // Mount a RAM-backed directory if a memory budget was given.
+    char ram_dir[COMMON_MAX_PATH_LENGTH] = "";
+    long ram_remaining_mib = 0;
+    if (build_options.ram_budget_mib > 0)
     {
-        exit_code = 1;
-        goto cleanup;
+        ram_remaining_mib = mount_ramdisk(
+            build_dir, build_options.ram_budget_mib, ram_dir, sizeof(ram_dir)
+        );
+        if (ram_remaining_mib < 0)
+        {
+            LOG_WARNING("Failed to mount RAM build directory, building on disk");
+            ram_dir[0] = '\0';
+            ram_remaining_mib = 0;
+        }
     }
-    if (common.check_interrupted()) return 130;
 
-    // Phase 2: Base - create and strip base rootfs.
-    if (run_base_phase(base_rootfs_dir) != 0)
-    {
-        exit_code = 1;
-        goto cleanup;
-    }
-    if (common.check_interrupted()) return 130;
+    // Construct derived paths, placing the most frequently read trees in RAM
+    // first and spilling whatever does not fit the budget to disk.
+    build.version = version;
+    snprintf(build.components_dir, sizeof(build.components_dir), "%s/components", build_dir);
+    snprintf(
+        build.base_rootfs_dir, sizeof(build.base_rootfs_dir), "%s/base-rootfs",
+        reserve_ramdisk_space(&ram_remaining_mib, "base rootfs", CONFIG_BASE_ROOTFS_ESTIMATE_MIB)
+            ? ram_dir : build_dir
+    );
+    snprintf(
+        build.live_rootfs_dir, sizeof(build.live_rootfs_dir), "%s/live-rootfs",
+        reserve_ramdisk_space(&ram_remaining_mib, "live rootfs", CONFIG_LIVE_ROOTFS_ESTIMATE_MIB)
+            ? ram_dir : build_dir
+    );
+    snprintf(
+        build.target_rootfs_dir, sizeof(build.target_rootfs_dir), "%s/target-rootfs",
+        reserve_ramdisk_space(&ram_remaining_mib, "target rootfs", CONFIG_TARGET_ROOTFS_ESTIMATE_MIB)
+            ? ram_dir : build_dir
+    );
+    snprintf(
+        build.staging_dir, sizeof(build.staging_dir), "%s/staging-iso",
+        reserve_ramdisk_space(&ram_remaining_mib, "ISO staging", CONFIG_STAGING_ESTIMATE_MIB)
+            ? ram_dir : build_dir
+    );
+
+    LOG_INFO("Building ISO for version %s", version);
 
-    // Phase 3: Target - copy base, install packages, brand, package.
-    if (run_target_phase(base_rootfs_dir, target_rootfs_dir, target_tarball_path, version) != 0)
+    // Run all phases, building target and live concurrently from the base.
+    int result = run_build_pipeline(&build);
+    if (result == -2 || common.check_interrupted())
     {
-        exit_code = 1;
-        goto cleanup;
+        exit_code = 130;
     }
-    if (common.check_interrupted()) return 130;
-
-    // Phase 4: Live - copy base, install packages, embed target.
-    if (run_live_phase(base_rootfs_dir, live_rootfs_dir, target_tarball_path, components_dir, version) != 0)
+    else if (result != 0)
     {
         exit_code = 1;
-        goto cleanup;
     }
-    if (common.check_interrupted()) return 130;
 
-    // Base rootfs no longer needed after target and live are created.
-    common.rm_rf(base_rootfs_dir);
-
-    // Phase 5: Assembly - configure bootloaders and create ISO.
-    if (run_assembly_phase(live_rootfs_dir, version) != 0)
+    // Release derived rootfs before their base, then remove everything else.
+    release_rootfs(build.target_rootfs_dir);
+    release_rootfs(build.live_rootfs_dir);
+    release_rootfs(build.base_rootfs_dir);
+    if (ram_dir[0] != '\0')
     {
-        exit_code = 1;
-        goto cleanup;
+        unmount_ramdisk(ram_dir);
     }
-
-cleanup:
     common.rm_rf(build_dir);
     common.clear_cleanup_dir();
     return exit_code;
@@ -7,7 +7,10 @@
 /** Maximum length for the ISO output path. */
 #define ISO_OUTPUT_PATH_MAX_LENGTH 256
 
-int run_assembly_phase(const char *rootfs_dir, const char *version)
+int run_assembly_phase(
+    const char *base_rootfs_dir, const char *rootfs_dir,
+    const char *staging_dir, const char *version
+)
 {
     // Construct the ISO output path.
     char iso_output_path[ISO_OUTPUT_PATH_MAX_LENGTH];
@@ -17,7 +20,7 @@ int run_assembly_phase(const char *rootfs_dir, const char *version)
     );
 
     // Create the final ISO image (handles GRUB setup internally).
-    if (create_iso(rootfs_dir, iso_output_path) != 0)
+    if (create_iso(base_rootfs_dir, rootfs_dir, staging_dir, iso_output_path) != 0)
     {
         LOG_ERROR("Failed to create ISO image");
         return -1;
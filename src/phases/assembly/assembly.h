@@ -6,10 +6,16 @@
  * Configures GRUB for BIOS and EFI boot, creates a squashfs of
  * the live rootfs, and assembles the final bootable hybrid ISO image.
  *
+ * @param base_rootfs_dir The base rootfs directory, squashed separately in
+ * layered builds.
  * @param rootfs_dir The live rootfs directory.
+ * @param staging_dir The directory to stage the ISO contents in.
  * @param version The version string for the ISO filename.
  *
  * @return - `0` - Indicates success.
  * @return - `-1` - Indicates failure.
  */
-int run_assembly_phase(const char *rootfs_dir, const char *version);
+int run_assembly_phase(
+    const char *base_rootfs_dir, const char *rootfs_dir,
+    const char *staging_dir, const char *version
+);
@@ -0,0 +1,70 @@
+/**
+ * This code is responsible for creating the EFI system partition images
+ * that UEFI firmware boots the ISO from.
+ */
+
+#include "all.h"
+
+/** The path of the default EFI loader within the EFI system partition. */
+#define ESP_EFI_LOADER_PATH "::/EFI/BOOT/BOOTX64.EFI"
+
+/** The free space left in the FAT image beyond the loader, in KiB. */
+#define ESP_SLACK_KIB 2048
+
+/**
+ * The largest image an El Torito boot entry can cover, in KiB. Its sector
+ * count is 16 bits wide, in 512-byte sectors.
+ */
+#define ESP_ELTORITO_MAX_KIB (65535 / 2)
+
+int create_esp_image(const char *loader_path, const char *output_path)
+{
+    // Size the FAT image to the loader, plus room for the filesystem itself.
+    off_t loader_size = get_file_size(loader_path);
+    if (loader_size < 0)
+    {
+        LOG_ERROR("Failed to read EFI loader size");
+        return -1;
+    }
+    long size_kib = (long)(loader_size / 1024) + (long)(loader_size / (32 * 1024)) + ESP_SLACK_KIB;
+
+    // Larger images still boot from USB through the partition tables, but
+    // firmware booting the ISO as an optical disc may read only the start.
+    if (size_kib > ESP_ELTORITO_MAX_KIB)
+    {
+        LOG_WARNING(
+            "EFI system partition image (%ld KiB) exceeds the El Torito limit "
+            "(%d KiB); UEFI boot from optical media may fail, USB boot is unaffected",
+            size_kib, ESP_ELTORITO_MAX_KIB
+        );
+    }
+
+    // Quote paths for shell safety.
+    char quoted_loader[COMMON_MAX_QUOTED_LENGTH];
+    char quoted_output[COMMON_MAX_QUOTED_LENGTH];
+    if (common.shell_escape_path(loader_path, quoted_loader, sizeof(quoted_loader)) != 0
+        || common.shell_escape_path(output_path, quoted_output, sizeof(quoted_output)) != 0)
+    {
+        LOG_ERROR("Failed to quote EFI system partition paths");
+        return -1;
+    }
+
+    // Format the image and copy the loader in as the default one, without
+    // mounting anything.
+    common.rm_file(output_path);
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        command, sizeof(command),
+        "mkfs.vfat -C %s %ld && "
+        "mmd -i %s ::/EFI ::/EFI/BOOT && "
+        "mcopy -i %s %s " ESP_EFI_LOADER_PATH,
+        quoted_output, size_kib, quoted_output, quoted_output, quoted_loader
+    );
+    if (common.run_command_indented(command) != 0)
+    {
+        LOG_ERROR("Failed to create EFI system partition image");
+        return -2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+/**
+ * Creates an EFI system partition image holding one EFI loader.
+ *
+ * Formats a FAT image sized to fit the loader and stores the loader as the
+ * default one for x86-64 firmware (`EFI/BOOT/BOOTX64.EFI`), without
+ * mounting anything. Any earlier image at the output path is replaced.
+ *
+ * El Torito boot entries cover at most 32 MiB, so a larger image, such as
+ * one holding a unified kernel image, is logged as booting UEFI machines from
+ * USB media only, where firmware reads it through the partition tables.
+ *
+ * @param loader_path The path of the EFI loader.
+ * @param output_path The path of the FAT image to create.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates loader size read or path quoting failure.
+ * @return - `-2` - Indicates FAT image creation failure.
+ */
+int create_esp_image(const char *loader_path, const char *output_path);
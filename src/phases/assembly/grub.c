@@ -4,9 +4,158 @@
 
 #include "all.h"
 
-int setup_grub(const char *staging_path)
+/** The grub-mkrescue options the boot images are built with. */
+#define GRUB_MKRESCUE_OPTIONS \
+    "--locales=\"\" "   /* Skip locales (reduce size).       */ \
+    "--fonts=\"\" "     /* Skip fonts (hidden menu anyway).  */ \
+    "--themes=\"\""     /* Skip themes.                      */
+
+/**
+ * The early config of the EFI image, finding the ISO by its volume label,
+ * which is unique to each build.
+ */
+#define GRUB_EFI_EARLY_CONFIG \
+    "search --no-floppy --label --set=root %s\n" \
+    "set prefix=($root)/boot/grub\n"
+
+/** The GRUB modules the EFI image needs to run its early config. */
+#define GRUB_EFI_CORE_MODULES "search iso9660 part_msdos part_gpt"
+
+/** The grub.cfg lines loading the minimal profile's video driver. */
+#define GRUB_MINIMAL_VIDEO_SETUP \
+    "if [ \"$grub_platform\" = \"efi\" ]; then\n" \
+    "    insmod efi_gop\n" \
+    "    insmod efi_uga\n" \
+    "else\n" \
+    "    insmod vbe\n" \
+    "    insmod vga\n" \
+    "fi\n"
+
+/** The supported GRUB profiles. */
+static const GrubProfile GRUB_PROFILES[] = {
+    {
+        "full",
+        "",
+        "",
+        "insmod all_video\n"
+        "insmod gfxterm\n"
+    },
+    {
+        "minimal",
+        "--install-modules=\"" CONFIG_GRUB_MINIMAL_MODULES " " CONFIG_GRUB_MINIMAL_VIDEO_MODULES "\" "
+        "--modules=\"" CONFIG_GRUB_MINIMAL_MODULES "\"",
+        CONFIG_GRUB_MINIMAL_MODULES,
+        GRUB_MINIMAL_VIDEO_SETUP
+    }
+};
+
+/** The number of supported GRUB profiles. */
+#define GRUB_PROFILES_COUNT \
+    (int)(sizeof(GRUB_PROFILES) / sizeof(GRUB_PROFILES[0]))
+
+/** The host GRUB files the boot images are built from. */
+static const char *const GRUB_SOURCE_PATHS[] = {
+    "/usr/lib/grub",
+    "/usr/bin/grub-mkrescue",
+    "/usr/bin/grub-mkimage"
+};
+
+/** The number of host GRUB source paths. */
+#define GRUB_SOURCE_PATHS_COUNT \
+    (int)(sizeof(GRUB_SOURCE_PATHS) / sizeof(GRUB_SOURCE_PATHS[0]))
+
+static int compute_grub_key(char *out_key, size_t out_size)
+{
+    Fingerprint fingerprint;
+    if (init_fingerprint(&fingerprint) != 0)
+    {
+        return -1;
+    }
+
+    // Hash the options and the host GRUB platforms, modules, and tools,
+    // which change with the GRUB packages.
+    int result = add_fingerprint_string(&fingerprint, "options", GRUB_MKRESCUE_OPTIONS);
+    if (result == 0)
+    {
+        result = add_fingerprint_string(
+            &fingerprint, "profile-options", get_grub_profile()->mkrescue_options
+        );
+    }
+    for (int i = 0; i < GRUB_SOURCE_PATHS_COUNT && result == 0; i++)
+    {
+        result = add_fingerprint_tree(&fingerprint, GRUB_SOURCE_PATHS[i], GRUB_SOURCE_PATHS[i]);
+    }
+
+    if (result != 0)
+    {
+        discard_fingerprint(&fingerprint);
+        return -1;
+    }
+
+    return finish_fingerprint(&fingerprint, out_key, out_size) == 0 ? 0 : -1;
+}
+
+static int build_grub_template(const char *template_path)
 {
-    LOG_INFO("Configuring GRUB for live ISO boot");
+    char tree_path[COMMON_MAX_PATH_LENGTH];
+    char temp_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(tree_path, sizeof(tree_path), "%s.tree-%d", template_path, getpid());
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp-%d", template_path, getpid());
+
+    // Quote paths for shell safety.
+    char quoted_tree[COMMON_MAX_QUOTED_LENGTH];
+    char quoted_temp[COMMON_MAX_QUOTED_LENGTH];
+    if (common.shell_escape_path(tree_path, quoted_tree, sizeof(quoted_tree)) != 0
+        || common.shell_escape_path(temp_path, quoted_temp, sizeof(quoted_temp)) != 0)
+    {
+        LOG_ERROR("Failed to quote GRUB boot image paths");
+        return -1;
+    }
+
+    // Run grub-mkrescue over an empty tree, so the image holds only the
+    // BIOS and EFI boot images and the GRUB module tree.
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        command, sizeof(command), "grub-mkrescue -o %s " GRUB_MKRESCUE_OPTIONS " %s %s",
+        quoted_temp, get_grub_profile()->mkrescue_options, quoted_tree
+    );
+    int result = common.mkdir_p(tree_path) == 0
+        && common.run_command_indented(command) == 0 ? 0 : -2;
+    common.rm_rf(tree_path);
+
+    // Move the image into place only once it is complete.
+    if (result == 0 && rename(temp_path, template_path) != 0)
+    {
+        result = -3;
+    }
+    if (result != 0)
+    {
+        common.rm_file(temp_path);
+    }
+
+    return result;
+}
+
+const GrubProfile *find_grub_profile(const char *name)
+{
+    for (int i = 0; i < GRUB_PROFILES_COUNT; i++)
+    {
+        if (strcmp(GRUB_PROFILES[i].name, name) == 0)
+        {
+            return &GRUB_PROFILES[i];
+        }
+    }
+    return NULL;
+}
+
+const GrubProfile *get_grub_profile(void)
+{
+    return find_grub_profile(build_options.grub_profile);
+}
+
+int setup_grub(const char *staging_path, const char *kernel_params)
+{
+    LOG_INFO("Configuring GRUB for live ISO boot (%s profile)", get_grub_profile()->name);
 
     // Construct the GRUB directory path.
     char grub_dir[COMMON_MAX_PATH_LENGTH];
@@ -25,10 +174,11 @@ int setup_grub(const char *staging_path)
 
     // Define the GRUB configuration content.
     // Switch to graphics terminal immediately to hide the "GRUB" text.
-    const char *grub_cfg =
+    char grub_cfg[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        grub_cfg, sizeof(grub_cfg),
         "# Switch to graphics mode immediately to clear boot text.\n"
-        "insmod all_video\n"
-        "insmod gfxterm\n"
+        "%s"
         "set gfxmode=auto\n"
         "terminal_output gfxterm\n"
         "clear\n"
@@ -39,9 +189,11 @@ int setup_grub(const char *staging_path)
         "set timeout=0            # No delay before booting.\n"
         "\n"
         "menuentry \"" CONFIG_GRUB_MENU_ENTRY_NAME "\" {\n"
-        "    linux " CONFIG_BOOT_KERNEL_PATH " " CONFIG_LIVE_KERNEL_PARAMS "\n"
+        "    linux " CONFIG_BOOT_KERNEL_PATH " %s\n"
         "    initrd " CONFIG_BOOT_INITRD_PATH "\n"
-        "}\n";
+        "}\n",
+        get_grub_profile()->video_setup, kernel_params
+    );
 
     // Write the GRUB configuration file.
     if (common.write_file(grub_cfg_path, grub_cfg) != 0)
@@ -54,3 +206,85 @@ int setup_grub(const char *staging_path)
 
     return 0;
 }
+
+int get_grub_boot_template(char *out_path, size_t out_size)
+{
+    // Compute the cache key from the host GRUB and the image options.
+    char key[COMMON_SHA256_HEX_LENGTH];
+    if (compute_grub_key(key, sizeof(key)) != 0)
+    {
+        LOG_ERROR("Failed to fingerprint host GRUB");
+        return -1;
+    }
+    snprintf(out_path, out_size, CONFIG_GRUB_CACHE_DIR "/%s.iso", key);
+
+    // Build the boot images only when GRUB or its options changed.
+    if (common.file_exists(out_path))
+    {
+        LOG_INFO("Reusing cached GRUB boot images");
+    }
+    else
+    {
+        LOG_INFO("Building GRUB boot images...");
+        if (common.mkdir_p(CONFIG_GRUB_CACHE_DIR) != 0 || build_grub_template(out_path) != 0)
+        {
+            LOG_ERROR("Failed to build GRUB boot images");
+            return -2;
+        }
+    }
+
+    return 0;
+}
+
+int create_grub_esp(const char *volume_id, const char *output_path)
+{
+    LOG_INFO("Building GRUB EFI image for volume %s...", volume_id);
+
+    // Build the image next to the FAT image that will hold it.
+    char config_path[COMMON_MAX_PATH_LENGTH];
+    char loader_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(config_path, sizeof(config_path), "%s.cfg-%d", output_path, getpid());
+    snprintf(loader_path, sizeof(loader_path), "%s.efi-%d", output_path, getpid());
+
+    // Quote paths for shell safety.
+    char quoted_config[COMMON_MAX_QUOTED_LENGTH];
+    char quoted_loader[COMMON_MAX_QUOTED_LENGTH];
+    if (common.shell_escape_path(config_path, quoted_config, sizeof(quoted_config)) != 0
+        || common.shell_escape_path(loader_path, quoted_loader, sizeof(quoted_loader)) != 0)
+    {
+        LOG_ERROR("Failed to quote GRUB EFI image paths");
+        return -1;
+    }
+
+    // Write the early config searching for this build's volume label.
+    char early_config[256];
+    snprintf(early_config, sizeof(early_config), GRUB_EFI_EARLY_CONFIG, volume_id);
+    if (common.write_file(config_path, early_config) != 0)
+    {
+        LOG_ERROR("Failed to write GRUB EFI early config");
+        return -1;
+    }
+
+    // Build the EFI image, loading every other module from the ISO.
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        command, sizeof(command),
+        "grub-mkimage -O x86_64-efi -p /boot/grub -c %s -o %s " GRUB_EFI_CORE_MODULES " %s",
+        quoted_config, quoted_loader, get_grub_profile()->core_modules
+    );
+    int result = common.run_command_indented(command) == 0 ? 0 : -2;
+    common.rm_file(config_path);
+    if (result != 0)
+    {
+        LOG_ERROR("Failed to build GRUB EFI image");
+    }
+
+    // Store it as the default loader of the EFI system partition.
+    if (result == 0 && create_esp_image(loader_path, output_path) != 0)
+    {
+        result = -3;
+    }
+    common.rm_file(loader_path);
+
+    return result;
+}
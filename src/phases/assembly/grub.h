@@ -1,16 +1,90 @@
 #pragma once
 
+/**
+ * A type representing a named set of GRUB boot image parameters.
+ *
+ * Holds the extra grub-mkrescue options selecting the installed and
+ * built-in modules, the modules built into the per-build EFI image, and the
+ * grub.cfg lines loading video support.
+ */
+typedef struct
+{
+    const char *name;
+    const char *mkrescue_options;
+    const char *core_modules;
+    const char *video_setup;
+} GrubProfile;
+
+/**
+ * Finds a GRUB profile by name.
+ *
+ * @param name The profile name (e.g. "minimal").
+ *
+ * @return The profile, or NULL if no profile has that name.
+ */
+const GrubProfile *find_grub_profile(const char *name);
+
+/**
+ * Gets the GRUB profile selected for the current build.
+ *
+ * @return The selected profile. Options are validated at startup, so this
+ * never returns NULL during a build.
+ */
+const GrubProfile *get_grub_profile(void);
+
 /**
  * Configures GRUB for live ISO boot.
  *
  * Creates the GRUB directory structure and writes grub.cfg with kernel
  * parameters for booting the live system. Called during ISO creation
- * to set up the staging directory before grub-mkrescue.
+ * to set up the staging directory before the ISO is written.
  *
  * @param staging_path The path to the ISO staging directory.
+ * @param kernel_params The live kernel command line.
  *
  * @return - `0` - Indicates successful configuration.
  * @return - `-1` - Indicates GRUB directory creation failure.
  * @return - `-2` - Indicates GRUB config file write failure.
  */
-int setup_grub(const char *staging_path);
+int setup_grub(const char *staging_path, const char *kernel_params);
+
+/**
+ * Gets a template ISO holding the GRUB boot images.
+ *
+ * The template is built by grub-mkrescue from an empty tree, so it holds
+ * the BIOS El Torito image, the EFI image, the hybrid boot records, and the
+ * GRUB module tree, and nothing else. It is cached, keyed by the host's
+ * GRUB files, the grub-mkrescue options, and the GRUB profile's modules, so
+ * it is only rebuilt when the GRUB packages or the profile change. ISOs are
+ * written from it with xorriso, which replays its boot setup.
+ *
+ * The template's EFI image finds its boot medium by the template's volume
+ * UUID, which every ISO built from it would share, so each build replaces it
+ * with its own (see create_grub_esp()).
+ *
+ * @param out_path The buffer receiving the template path.
+ * @param out_size The size of the path buffer.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates host GRUB fingerprint failure.
+ * @return - `-2` - Indicates boot image build failure.
+ */
+int get_grub_boot_template(char *out_path, size_t out_size);
+
+/**
+ * Creates an EFI system partition image booting GRUB from one build's ISO.
+ *
+ * Builds a GRUB EFI image with grub-mkimage whose early config searches for
+ * the given volume label, so firmware with several LimeOS media attached
+ * boots GRUB's modules and grub.cfg from the medium it started from. The
+ * image is stored as the default EFI loader of a FAT image.
+ *
+ * @param volume_id The volume ID of the ISO the image boots from.
+ * @param output_path The path of the FAT image to create.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates early config write or path quoting failure.
+ * @return - `-2` - Indicates GRUB EFI image build failure.
+ * @return - `-3` - Indicates FAT image creation failure.
+ */
+int create_grub_esp(const char *volume_id, const char *output_path);
@@ -4,8 +4,54 @@
 
 #include "all.h"
 
-/** Squashfs compression. xz provides best ratio for live systems. */
-#define SQUASHFS_COMPRESSION "xz"
+/** The name of the live squashfs in regular builds. */
+#define ISO_LIVE_SQUASHFS_NAME "filesystem.squashfs"
+
+/** The name of the squashfs holding the live delta in layered builds. */
+#define ISO_LIVE_LAYER_NAME "live.squashfs"
+
+/** The live-boot file listing the squashfs layers to stack, bottom first. */
+#define ISO_LIVE_MODULE_NAME "filesystem.module"
+
+/** The file in the live directory recording how the squashfs was built. */
+#define ISO_BUILD_RECORD_NAME "build.conf"
+
+/**
+ * The EFI system partition image at the ISO root, as grub-mkrescue names it.
+ * The replayed EFI boot entry and GPT partition point at this path.
+ */
+#define ISO_EFI_IMAGE_NAME "efi.img"
+
+/** A type representing a boot file mapped onto the ISO from the live rootfs. */
+typedef struct
+{
+    const char *label;
+    const char *path;
+} IsoGraft;
+
+/** The boot files grafted from the live rootfs in graft assembly mode. */
+static const IsoGraft ISO_BOOT_GRAFTS[] = {
+    { "Kernel", CONFIG_BOOT_KERNEL_PATH },
+    { "Initrd", CONFIG_BOOT_INITRD_PATH }
+};
+
+/** The number of grafted boot files. */
+#define ISO_BOOT_GRAFTS_COUNT \
+    (int)(sizeof(ISO_BOOT_GRAFTS) / sizeof(ISO_BOOT_GRAFTS[0]))
+
+/** The grafted boot file paths, which are kept out of the live squashfs. */
+static const char *const ISO_GRAFTED_PATHS[] = {
+    CONFIG_BOOT_KERNEL_PATH,
+    CONFIG_BOOT_INITRD_PATH
+};
+
+/** A type representing one squashfs layer of the live system. */
+typedef struct
+{
+    const char *source_path;
+    const char *name;
+    int has_boot_files;
+} IsoLayer;
 
 /** Maximum cleanup retry attempts before giving up. */
 #define CLEANUP_MAX_RETRIES 3
@@ -29,40 +75,202 @@ static int create_staging_directory(const char *staging_path)
     return 0;
 }
 
-static int create_squashfs(const char *rootfs_path, const char *staging_path)
+static int move_payload_file(
+    const char *rootfs_path, const char *staging_path, const char *name
+)
+{
+    // Construct the file paths in the live rootfs and in staging.
+    char src_path[COMMON_MAX_PATH_LENGTH];
+    char dst_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(src_path, sizeof(src_path), "%s" CONFIG_TARGET_PAYLOAD_DIR "/%s", rootfs_path, name);
+    snprintf(dst_path, sizeof(dst_path), "%s/live/%s", staging_path, name);
+
+    // Move the file, copying when staging is on another filesystem.
+    if (rename(src_path, dst_path) != 0)
+    {
+        if (errno != EXDEV || common.copy_file(src_path, dst_path) != 0)
+        {
+            LOG_ERROR("Failed to move %s to staging", name);
+            return -1;
+        }
+        common.rm_file(src_path);
+    }
+
+    // Link the file's path to its copy on the mounted boot medium.
+    char link_target[COMMON_MAX_PATH_LENGTH];
+    snprintf(link_target, sizeof(link_target), CONFIG_LIVE_MEDIUM_PATH "/live/%s", name);
+    if (common.symlink_file(link_target, src_path) != 0)
+    {
+        LOG_ERROR("Failed to link %s into live rootfs", name);
+        return -2;
+    }
+
+    return 0;
+}
+
+static int place_target_payload(const char *rootfs_path, const char *staging_path)
+{
+    LOG_INFO("Moving target payload out of the live squashfs...");
+
+    // Move the payload file itself.
+    char name[COMMON_MAX_PATH_LENGTH];
+    get_target_payload_name(name, sizeof(name));
+    if (move_payload_file(rootfs_path, staging_path, name) != 0)
+    {
+        return -1;
+    }
+    if (!get_payload_format()->is_chunked)
+    {
+        return 0;
+    }
+
+    // Move the chunks listed in a chunked payload's index, which is now in
+    // staging.
+    char index_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(index_path, sizeof(index_path), "%s/live/%s", staging_path, name);
+    ArchiveChunkList chunks;
+    if (read_archive_chunk_list(index_path, &chunks) != 0)
+    {
+        LOG_ERROR("Failed to read target payload chunk index");
+        return -1;
+    }
+    int result = 0;
+    for (int i = 0; i < chunks.count && result == 0; i++)
+    {
+        result = move_payload_file(rootfs_path, staging_path, chunks.names[i]);
+    }
+    free_archive_chunk_list(&chunks);
+
+    return result;
+}
+
+static int is_stream_assembly(void)
+{
+    return strcmp(build_options.assembly_mode, "stream") == 0;
+}
+
+static int is_graft_assembly(void)
 {
-    LOG_INFO("Creating squashfs filesystem...");
+    // Streamed assembly grafts the boot files too.
+    return strcmp(build_options.assembly_mode, "graft") == 0 || is_stream_assembly();
+}
 
+static int get_live_layers(
+    const char *base_rootfs_path, const char *rootfs_path,
+    char *upper_path, size_t upper_size, IsoLayer *out_layers
+)
+{
+    // Split the live system into the base and its changes in layered
+    // builds. The base is shared with the target, so grafted boot files are
+    // only left out of the live delta.
+    if (build_options.layered
+        && get_overlay_upper_dir(rootfs_path, upper_path, upper_size) == 0)
+    {
+        out_layers[0] = (IsoLayer){ base_rootfs_path, CONFIG_BASE_LAYER_NAME, 0 };
+        out_layers[1] = (IsoLayer){ upper_path, ISO_LIVE_LAYER_NAME, 1 };
+        return 2;
+    }
+
+    out_layers[0] = (IsoLayer){ rootfs_path, ISO_LIVE_SQUASHFS_NAME, 1 };
+    return 1;
+}
+
+static int get_excluded_count(const IsoLayer *layer)
+{
+    return is_graft_assembly() && layer->has_boot_files ? ISO_BOOT_GRAFTS_COUNT : 0;
+}
+
+static int create_live_squashfs(const IsoLayer *layer, const char *staging_path)
+{
     // Construct the squashfs output path.
     char squashfs_path[COMMON_MAX_PATH_LENGTH];
-    snprintf(squashfs_path, sizeof(squashfs_path), "%s/live/filesystem.squashfs", staging_path);
+    snprintf(squashfs_path, sizeof(squashfs_path), "%s/live/%s", staging_path, layer->name);
 
-    // Quote the rootfs path for shell safety.
-    char quoted_rootfs[COMMON_MAX_QUOTED_LENGTH];
-    if (common.shell_escape_path(rootfs_path, quoted_rootfs, sizeof(quoted_rootfs)) != 0)
+    // Reserve the squashfs with a placeholder when it is streamed into the
+    // ISO once that is written.
+    if (is_stream_assembly())
     {
-        LOG_ERROR("Failed to quote rootfs path");
-        return -1;
+        if (create_iso_placeholder(squashfs_path, layer->name) != 0)
+        {
+            LOG_ERROR("Failed to reserve squashfs filesystem %s", layer->name);
+            return -1;
+        }
+        return 0;
+    }
+
+    LOG_INFO("Creating squashfs filesystem %s...", layer->name);
+
+    return create_squashfs(
+        layer->source_path, squashfs_path, ISO_GRAFTED_PATHS, get_excluded_count(layer)
+    );
+}
+
+static int create_live_layers(
+    const IsoLayer *layers, int layer_count, const char *staging_path
+)
+{
+    for (int i = 0; i < layer_count; i++)
+    {
+        if (create_live_squashfs(&layers[i], staging_path) != 0)
+        {
+            return -1;
+        }
+    }
+    if (layer_count == 1)
+    {
+        return 0;
     }
 
-    // Quote the squashfs path for shell safety.
-    char quoted_squashfs[COMMON_MAX_QUOTED_LENGTH];
-    if (common.shell_escape_path(squashfs_path, quoted_squashfs, sizeof(quoted_squashfs)) != 0)
+    // Tell live-boot to stack the live delta on top of the base.
+    char module_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(module_path, sizeof(module_path), "%s/live/" ISO_LIVE_MODULE_NAME, staging_path);
+    if (common.write_file(module_path, CONFIG_BASE_LAYER_NAME "\n" ISO_LIVE_LAYER_NAME "\n") != 0)
     {
-        LOG_ERROR("Failed to quote squashfs path");
+        LOG_ERROR("Failed to write live layer list");
         return -2;
     }
 
-    // Create the squashfs filesystem.
-    char command[COMMON_MAX_COMMAND_LENGTH];
-    snprintf(
-        command, sizeof(command),
-        "mksquashfs %s %s -comp " SQUASHFS_COMPRESSION " -noappend",
-        quoted_rootfs, quoted_squashfs
-    );
-    if (common.run_command_indented(command) != 0)
+    return 0;
+}
+
+static int stream_live_layers(
+    const IsoLayer *layers, int layer_count, const char *output_path
+)
+{
+    // Append each squashfs after the last sector of the ISO.
+    off_t iso_size;
+    if (get_iso_append_offset(output_path, &iso_size) != 0)
     {
-        LOG_ERROR("Failed to create squashfs from %s", rootfs_path);
+        LOG_ERROR("Failed to read ISO image: %s", output_path);
+        return -1;
+    }
+    off_t offset = iso_size;
+    for (int i = 0; i < layer_count; i++)
+    {
+        LOG_INFO("Streaming squashfs filesystem %s into the ISO...", layers[i].name);
+
+        off_t size;
+        if (stream_squashfs(
+                layers[i].source_path, output_path, offset, ISO_GRAFTED_PATHS,
+                get_excluded_count(&layers[i]), &size) != 0)
+        {
+            return -1;
+        }
+        LOG_INFO("Squashfs size: %.1f MiB", (double)size / (1024.0 * 1024.0));
+
+        // Point the placeholder's directory records at the squashfs.
+        if (set_iso_placeholder_extent(output_path, layers[i].name, offset, size) != 0)
+        {
+            LOG_ERROR("Failed to place squashfs filesystem %s in the ISO", layers[i].name);
+            return -2;
+        }
+        offset += size;
+    }
+
+    // Grow the ISO's volume and partition tables over the squashfs.
+    if (resize_iso_image(output_path, iso_size, offset) != 0)
+    {
+        LOG_ERROR("Failed to resize ISO image: %s", output_path);
         return -3;
     }
 
@@ -90,6 +298,7 @@ static int copy_boot_files(const char *rootfs_path, const char *staging_path)
         LOG_ERROR("Failed to copy kernel");
         return -2;
     }
+    log_file_size("Kernel", dst_path);
 
     // Copy the initrd to staging.
     snprintf(src_path, sizeof(src_path), "%s/boot/initrd.img", rootfs_path);
@@ -99,20 +308,72 @@ static int copy_boot_files(const char *rootfs_path, const char *staging_path)
         LOG_ERROR("Failed to copy initrd");
         return -3;
     }
+    log_file_size("Initrd", dst_path);
 
     return 0;
 }
 
-static int run_grub_mkrescue(const char *staging_path, const char *output_path)
+static int get_boot_grafts(const char *rootfs_path, char *out_grafts, size_t out_size)
 {
-    LOG_INFO("Running grub-mkrescue to create hybrid ISO...");
+    // Map each boot file onto the ISO straight from the live rootfs.
+    out_grafts[0] = '\0';
+    for (int i = 0; i < ISO_BOOT_GRAFTS_COUNT; i++)
+    {
+        char src_path[COMMON_MAX_PATH_LENGTH];
+        snprintf(src_path, sizeof(src_path), "%s%s", rootfs_path, ISO_BOOT_GRAFTS[i].path);
+        if (!common.file_exists(src_path))
+        {
+            LOG_ERROR("Missing boot file: %s", src_path);
+            return -1;
+        }
+        log_file_size(ISO_BOOT_GRAFTS[i].label, src_path);
+
+        // Quote the rootfs and ISO paths for shell safety.
+        char quoted_src[COMMON_MAX_QUOTED_LENGTH];
+        char quoted_dst[COMMON_MAX_QUOTED_LENGTH];
+        if (common.shell_escape_path(src_path, quoted_src, sizeof(quoted_src)) != 0
+            || common.shell_escape_path(ISO_BOOT_GRAFTS[i].path, quoted_dst, sizeof(quoted_dst)) != 0)
+        {
+            LOG_ERROR("Failed to quote boot file graft");
+            return -2;
+        }
+        size_t length = strlen(out_grafts);
+        snprintf(out_grafts + length, out_size - length, "-map %s %s ", quoted_src, quoted_dst);
+    }
+
+    return 0;
+}
+
+static int run_xorriso(
+    const char *staging_path, const char *grafts, const char *volume_id,
+    const char *output_path
+)
+{
+    // Get the GRUB boot images, which only change with the GRUB packages.
+    char template_path[COMMON_MAX_PATH_LENGTH];
+    if (get_grub_boot_template(template_path, sizeof(template_path)) != 0)
+    {
+        return -1;
+    }
+
+    // Allow files of 4 GiB and more when the payload sits on the ISO.
+    const char *iso_level = strcmp(build_options.payload_placement, "iso") == 0
+        ? "-compliance iso_9660_level=3 " : "";
+
+    LOG_INFO("Running xorriso to create hybrid ISO...");
 
     // Quote paths for shell safety.
+    char quoted_template[COMMON_MAX_QUOTED_LENGTH];
+    if (common.shell_escape_path(template_path, quoted_template, sizeof(quoted_template)) != 0)
+    {
+        LOG_ERROR("Failed to quote GRUB boot image path");
+        return -2;
+    }
     char quoted_staging[COMMON_MAX_QUOTED_LENGTH];
     if (common.shell_escape_path(staging_path, quoted_staging, sizeof(quoted_staging)) != 0)
     {
         LOG_ERROR("Failed to quote staging path");
-        return -1;
+        return -2;
     }
     char quoted_output[COMMON_MAX_QUOTED_LENGTH];
     if (common.shell_escape_path(output_path, quoted_output, sizeof(quoted_output)) != 0)
@@ -121,18 +382,24 @@ static int run_grub_mkrescue(const char *staging_path, const char *output_path)
         return -2;
     }
 
-    // Build hybrid ISO supporting both BIOS and UEFI boot.
-    // grub-mkrescue handles all boot image creation automatically.
+    // Remove any earlier image, which xorriso would otherwise append to.
+    common.rm_file(output_path);
+
+    // Build hybrid ISO supporting both BIOS and UEFI boot, replaying the
+    // boot setup of the template that holds the GRUB boot images.
     char command[COMMON_MAX_COMMAND_LENGTH];
     snprintf(
         command, sizeof(command),
-        "grub-mkrescue "
-        "-o %s "            // Output ISO file path.
-        "--locales=\"\" "   // Skip locales (reduce size).
-        "--fonts=\"\" "     // Skip fonts (hidden menu anyway).
-        "--themes=\"\" "    // Skip themes.
-        "%s",               // Source directory (staging).
-        quoted_output, quoted_staging
+        "xorriso "
+        "-indev %s "                // GRUB boot images and module tree.
+        "-outdev %s "               // Output ISO file path.
+        "-boot_image any replay "   // Reuse the BIOS, EFI, and hybrid boot setup.
+        "-volid %s "                // Label the live-boot hint names.
+        "%s"                        // ISO level.
+        "-map %s / "                // Staging directory at the root.
+        "%s"                        // Grafted boot files.
+        "-commit",
+        quoted_template, quoted_output, volume_id, iso_level, quoted_staging, grafts
     );
     if (common.run_command_indented(command) != 0)
     {
@@ -187,51 +454,129 @@ static void cleanup_live_boot(const char *rootfs_path)
     common.rm_file(path);
 }
 
-int create_iso(const char *rootfs_path, const char *output_path)
+int create_iso(
+    const char *base_rootfs_path, const char *rootfs_path,
+    const char *staging_path, const char *output_path
+)
 {
     LOG_INFO("Creating bootable ISO image...");
 
-    // Construct the staging directory path adjacent to rootfs.
-    char staging_path[COMMON_MAX_PATH_LENGTH];
-    snprintf(staging_path, sizeof(staging_path), "%s/../staging-iso", rootfs_path);
-
     // Create the staging directory structure.
     if (create_staging_directory(staging_path) != 0)
     {
         return -1;
     }
 
-    // Copy boot files to staging before cleanup removes them from rootfs.
-    if (copy_boot_files(rootfs_path, staging_path) != 0)
+    // Label the ISO uniquely and point live-boot at that label, so it does
+    // not probe every block device for the live squashfs.
+    char volume_id[ISO_VOLUME_ID_SIZE];
+    if (create_iso_volume_id(volume_id, sizeof(volume_id)) != 0)
+    {
+        LOG_ERROR("Failed to create ISO volume ID");
+        cleanup_staging(staging_path);
+        return -1;
+    }
+    char kernel_params[COMMON_MAX_PATH_LENGTH];
+    snprintf(
+        kernel_params, sizeof(kernel_params),
+        CONFIG_LIVE_KERNEL_PARAMS " live-media=" CONFIG_LIVE_MEDIA_LABEL_DIR "/%s", volume_id
+    );
+
+    // Copy boot files to staging before cleanup removes them from rootfs,
+    // or graft them onto the ISO where they are.
+    char grafts[COMMON_MAX_COMMAND_LENGTH] = "";
+    int boot_result = is_graft_assembly()
+        ? get_boot_grafts(rootfs_path, grafts, sizeof(grafts))
+        : copy_boot_files(rootfs_path, staging_path);
+    if (boot_result != 0)
     {
         cleanup_staging(staging_path);
         return -2;
     }
 
     // Configure GRUB bootloader in the staging directory.
-    if (setup_grub(staging_path) != 0)
+    if (setup_grub(staging_path, kernel_params) != 0)
     {
         cleanup_staging(staging_path);
         return -3;
     }
 
+    // Replace the template's EFI image with one finding this ISO by its
+    // label, or with one booting a unified kernel image, so UEFI firmware
+    // skips GRUB. BIOS boot still goes through GRUB.
+    char esp_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(esp_path, sizeof(esp_path), "%s/" ISO_EFI_IMAGE_NAME, staging_path);
+    int esp_result = strcmp(build_options.efi_boot, "uki") == 0
+        ? create_uki_esp(rootfs_path, kernel_params, esp_path)
+        : create_grub_esp(volume_id, esp_path);
+    if (esp_result != 0)
+    {
+        cleanup_staging(staging_path);
+        return -7;
+    }
+
     // Remove boot files from live rootfs to reduce squashfs size (~100MB).
-    cleanup_live_boot(rootfs_path);
+    // Grafted files stay until the ISO is written and are excluded instead.
+    if (is_graft_assembly())
+    {
+        cleanup_versioned_boot_files(rootfs_path);
+    }
+    else
+    {
+        cleanup_live_boot(rootfs_path);
+    }
 
-    // Create the squashfs filesystem from the live rootfs.
-    if (create_squashfs(rootfs_path, staging_path) != 0)
+    // Keep the already-compressed target payload out of the squashfs.
+    if (strcmp(build_options.payload_placement, "iso") == 0
+        && place_target_payload(rootfs_path, staging_path) != 0)
     {
         cleanup_staging(staging_path);
         return -4;
     }
 
-    // Assemble the final hybrid ISO with grub-mkrescue.
-    if (run_grub_mkrescue(staging_path, output_path) != 0)
+    // Create the squashfs filesystem from the live rootfs, split into a base
+    // layer and a live delta in layered builds.
+    char upper_path[COMMON_MAX_PATH_LENGTH];
+    IsoLayer layers[2];
+    int layer_count = get_live_layers(
+        base_rootfs_path, rootfs_path, upper_path, sizeof(upper_path), layers
+    );
+    if (create_live_layers(layers, layer_count, staging_path) != 0)
+    {
+        cleanup_staging(staging_path);
+        return -5;
+    }
+
+    // Record how the squashfs was built next to it.
+    char record_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(record_path, sizeof(record_path), "%s/live/" ISO_BUILD_RECORD_NAME, staging_path);
+    if (write_squashfs_record(record_path) != 0)
+    {
+        LOG_ERROR("Failed to write squashfs build record");
+        cleanup_staging(staging_path);
+        return -5;
+    }
+
+    // Assemble the final hybrid ISO with xorriso.
+    if (run_xorriso(staging_path, grafts, volume_id, output_path) != 0)
+    {
+        cleanup_staging(staging_path);
+        return -6;
+    }
+
+    // Write streamed squashfs filesystems straight into the ISO.
+    if (is_stream_assembly() && stream_live_layers(layers, layer_count, output_path) != 0)
     {
         cleanup_staging(staging_path);
         return -5;
     }
 
+    // Remove the grafted boot files now that they are on the ISO.
+    if (is_graft_assembly())
+    {
+        cleanup_live_boot(rootfs_path);
+    }
+
     // Clean up the staging directory after successful ISO creation.
     cleanup_staging(staging_path);
 
@@ -3,17 +3,49 @@
 /**
  * Creates a hybrid bootable ISO image from the root filesystem.
  *
- * Uses grub-mkrescue to create an ISO that supports both UEFI and legacy BIOS
- * boot.
+ * Uses xorriso to create an ISO that supports both UEFI and legacy BIOS boot,
+ * replaying the boot setup of the cached GRUB boot images (see
+ * get_grub_boot_template()). Their EFI system partition image is replaced by
+ * one whose GRUB finds this ISO by its volume label (see create_grub_esp()).
+ * With the iso payload placement, the target payload is moved next to the
+ * live squashfs and linked back into the live rootfs. In layered builds
+ * with an overlay-derived live rootfs, the base and the live delta are
+ * squashed separately and stacked by live-boot.
  *
+ * With --assembly-mode=graft, the kernel and initrd are not copied into the
+ * staging directory. They are grafted onto the ISO from the live rootfs and
+ * left out of the live squashfs, then removed once the ISO is written.
+ *
+ * With --assembly-mode=stream, the boot files are grafted as well, and the
+ * staging directory only holds small placeholders for the squashfs. Once
+ * xorriso has written the ISO, each squashfs is written straight into
+ * it after its last sector, and the placeholder's directory records, the
+ * volume size, and the partition tables are patched to cover it.
+ *
+ * With --efi-boot=uki, the EFI system partition image's default loader is a
+ * unified kernel image instead (see create_uki_esp()), while BIOS boot keeps
+ * using GRUB.
+ *
+ * Each ISO gets a volume ID unique to the build, and the live kernel command
+ * line names it in a `live-media=` hint, so live-boot mounts the boot medium
+ * without probing every block device.
+ *
+ * @param base_rootfs_path The path to the base rootfs directory.
  * @param rootfs_path The path to the prepared root filesystem directory.
+ * @param staging_path The path of the staging directory to create, in RAM
+ * or on disk like the rootfs directories.
  * @param output_path The path where the ISO file will be created.
  *
  * @return - `0` - Indicates successful ISO creation.
- * @return - `-1` - Indicates staging directory creation failure.
- * @return - `-2` - Indicates boot files copy failure.
+ * @return - `-1` - Indicates staging directory or volume ID creation failure.
+ * @return - `-2` - Indicates boot files copy or graft failure.
  * @return - `-3` - Indicates GRUB setup failure.
- * @return - `-4` - Indicates squashfs creation failure.
- * @return - `-5` - Indicates ISO assembly failure.
+ * @return - `-4` - Indicates target payload placement failure.
+ * @return - `-5` - Indicates squashfs creation failure.
+ * @return - `-6` - Indicates ISO assembly failure.
+ * @return - `-7` - Indicates EFI system partition image creation failure.
  */
-int create_iso(const char *rootfs_path, const char *output_path);
+int create_iso(
+    const char *base_rootfs_path, const char *rootfs_path,
+    const char *staging_path, const char *output_path
+);
@@ -0,0 +1,483 @@
+/**
+ * This code is responsible for creating the live squashfs filesystems with
+ * the selected build profile.
+ */
+
+#define _GNU_SOURCE
+#include "all.h"
+
+/** The supported squashfs profiles. */
+static const SquashfsProfile SQUASHFS_PROFILES[] = {
+    { "dev", "-comp zstd -Xcompression-level 3", 131072, 1024, "zstd", 3, 0 },
+    { "release", "-comp xz -Xbcj x86", 1048576, 2048, "xz", 0, SQFS_COMP_FLAG_XZ_X86 }
+};
+
+/** The number of supported squashfs profiles. */
+#define SQUASHFS_PROFILES_COUNT \
+    (int)(sizeof(SQUASHFS_PROFILES) / sizeof(SQUASHFS_PROFILES[0]))
+
+/** The file remembering content hashes of squashed files across builds. */
+#define SQUASHFS_MEMO_PATH CONFIG_SQUASHFS_CACHE_DIR "/content.memo"
+
+/**
+ * The content hash memo shared by every layer of the build.
+ *
+ * It is loaded once and kept for the whole process, so each save writes
+ * the entries used by all layers hashed so far. Saving a memo per layer
+ * would drop the base layer's entries when the live delta is hashed.
+ */
+static FingerprintMemo squashfs_memo;
+
+/** Whether the content hash memo has been loaded. */
+static int squashfs_memo_loaded = 0;
+
+static long get_processor_count(void)
+{
+    // Use every online CPU, falling back to one if the count is unknown.
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    if (processors < 1)
+    {
+        processors = 1;
+    }
+    return processors;
+}
+
+static int compute_squashfs_key(
+    const Manifest *manifest, char *out_key, size_t out_size
+)
+{
+    const SquashfsProfile *profile = get_squashfs_profile();
+    Fingerprint fingerprint;
+
+    // Load the memo on the first layer and keep it for the later ones.
+    if (!squashfs_memo_loaded)
+    {
+        if (load_fingerprint_memo(&squashfs_memo, SQUASHFS_MEMO_PATH) != 0)
+        {
+            return -1;
+        }
+        squashfs_memo_loaded = 1;
+    }
+    if (init_fingerprint(&fingerprint) != 0)
+    {
+        return -1;
+    }
+
+    // Hash the parameters that shape the image, but not thread or memory
+    // limits, which only affect how fast it is built.
+    char block_size[32];
+    snprintf(block_size, sizeof(block_size), "%d", profile->block_size);
+    int result = add_fingerprint_string(&fingerprint, "writer", build_options.squashfs_writer);
+    if (result == 0)
+    {
+        result = add_fingerprint_string(&fingerprint, "compression", profile->compression);
+    }
+    if (result == 0)
+    {
+        result = add_fingerprint_string(&fingerprint, "block-size", block_size);
+    }
+    if (result == 0 && build_options.squashfs_sort)
+    {
+        result = add_fingerprint_file(&fingerprint, "sort", build_options.squashfs_sort);
+    }
+
+    // Hash the tree, reusing content hashes of unchanged files.
+    if (result == 0)
+    {
+        result = add_fingerprint_manifest(&fingerprint, manifest, &squashfs_memo);
+    }
+
+    // Keep the entries of every layer so far for the next build.
+    if (result == 0
+        && (common.mkdir_p(CONFIG_SQUASHFS_CACHE_DIR) != 0
+            || save_fingerprint_memo(&squashfs_memo, SQUASHFS_MEMO_PATH) != 0))
+    {
+        LOG_WARNING("Failed to save squashfs content memo");
+    }
+
+    if (result != 0)
+    {
+        discard_fingerprint(&fingerprint);
+        return -1;
+    }
+
+    return finish_fingerprint(&fingerprint, out_key, out_size) == 0 ? 0 : -1;
+}
+
+static int link_or_copy(const char *src_path, const char *dst_path)
+{
+    // Share the image when both paths are on the same filesystem.
+    if (link(src_path, dst_path) == 0)
+    {
+        return 0;
+    }
+    return common.copy_file(src_path, dst_path);
+}
+
+static int copy_into(const char *src_path, const char *dst_path, off_t offset)
+{
+    int src_fd = open(src_path, O_RDONLY | O_CLOEXEC);
+    int dst_fd = open(dst_path, O_WRONLY | O_CLOEXEC);
+    int result = src_fd >= 0 && dst_fd >= 0 && ftruncate(dst_fd, offset) == 0 ? 0 : -1;
+
+    // Copy within the kernel, sharing extents where the filesystem can.
+    loff_t dst_offset = offset;
+    ssize_t copied = 1;
+    while (result == 0 && copied > 0)
+    {
+        copied = copy_file_range(src_fd, NULL, dst_fd, &dst_offset, 1 << 30, 0);
+        if (copied < 0)
+        {
+            result = -1;
+        }
+    }
+
+    if (src_fd >= 0)
+    {
+        close(src_fd);
+    }
+    if (dst_fd >= 0 && close(dst_fd) != 0)
+    {
+        result = -1;
+    }
+
+    return result;
+}
+
+static void store_cached_squashfs(const char *output_path, const char *cache_path)
+{
+    if (store_cache_file(output_path, cache_path, 1) != 0)
+    {
+        LOG_WARNING("Failed to store squashfs in cache");
+        return;
+    }
+
+    // Keep the image cache within its size limit.
+    if (prune_cache(CONFIG_SQUASHFS_CACHE_DIR, ".squashfs", 0, CONFIG_SQUASHFS_CACHE_MAX_MIB) != 0)
+    {
+        LOG_WARNING("Failed to prune squashfs cache");
+    }
+}
+
+const SquashfsProfile *find_squashfs_profile(const char *name)
+{
+    for (int i = 0; i < SQUASHFS_PROFILES_COUNT; i++)
+    {
+        if (strcmp(SQUASHFS_PROFILES[i].name, name) == 0)
+        {
+            return &SQUASHFS_PROFILES[i];
+        }
+    }
+    return NULL;
+}
+
+const SquashfsProfile *get_squashfs_profile(void)
+{
+    return find_squashfs_profile(build_options.squashfs_profile);
+}
+
+void get_squashfs_options(char *out_options, size_t out_size)
+{
+    const SquashfsProfile *profile = get_squashfs_profile();
+
+    snprintf(
+        out_options, out_size, "%s -b %d -processors %ld -mem %dM",
+        profile->compression, profile->block_size, get_processor_count(),
+        profile->memory_mib
+    );
+}
+
+static int run_mksquashfs(
+    const char *source_path, const char *output_path, const char *sort_path,
+    const char *const *excluded_paths, int excluded_count
+)
+{
+    // Quote the source path for shell safety.
+    char quoted_source[COMMON_MAX_QUOTED_LENGTH];
+    if (common.shell_escape_path(source_path, quoted_source, sizeof(quoted_source)) != 0)
+    {
+        LOG_ERROR("Failed to quote rootfs path");
+        return -1;
+    }
+
+    // Quote the squashfs path for shell safety.
+    char quoted_output[COMMON_MAX_QUOTED_LENGTH];
+    if (common.shell_escape_path(output_path, quoted_output, sizeof(quoted_output)) != 0)
+    {
+        LOG_ERROR("Failed to quote squashfs path");
+        return -2;
+    }
+
+    // Quote the sort file path for shell safety.
+    char sort_option[COMMON_MAX_QUOTED_LENGTH + 8] = "";
+    if (sort_path)
+    {
+        char quoted_sort[COMMON_MAX_QUOTED_LENGTH];
+        if (common.shell_escape_path(sort_path, quoted_sort, sizeof(quoted_sort)) != 0)
+        {
+            LOG_ERROR("Failed to quote sort file path");
+            return -4;
+        }
+        snprintf(sort_option, sizeof(sort_option), " -sort %s", quoted_sort);
+    }
+
+    // Quote the excluded paths, which mksquashfs takes relative to the
+    // source and after every other option.
+    char exclude_option[COMMON_MAX_COMMAND_LENGTH] = "";
+    for (int i = 0; i < excluded_count; i++)
+    {
+        char quoted_excluded[COMMON_MAX_QUOTED_LENGTH];
+        if (common.shell_escape_path(excluded_paths[i] + 1, quoted_excluded, sizeof(quoted_excluded)) != 0)
+        {
+            LOG_ERROR("Failed to quote excluded path");
+            return -4;
+        }
+        size_t length = strlen(exclude_option);
+        snprintf(
+            exclude_option + length, sizeof(exclude_option) - length, "%s %s",
+            i == 0 ? " -e" : "", quoted_excluded
+        );
+    }
+
+    // Create the squashfs filesystem with the selected profile.
+    char options[COMMON_MAX_COMMAND_LENGTH];
+    get_squashfs_options(options, sizeof(options));
+    LOG_INFO("Using squashfs profile %s: %s", get_squashfs_profile()->name, options);
+
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        command, sizeof(command), "mksquashfs %s %s %s%s -noappend%s",
+        quoted_source, quoted_output, options, sort_option, exclude_option
+    );
+    if (common.run_command_indented(command) != 0)
+    {
+        LOG_ERROR("Failed to create squashfs from %s", source_path);
+        return -3;
+    }
+
+    log_file_size("Squashfs", output_path);
+
+    return 0;
+}
+
+static SquashfsWriterConfig get_native_writer_config(void)
+{
+    // Write the image in-process across all CPUs, reusing cached
+    // compressed blocks.
+    const SquashfsProfile *profile = get_squashfs_profile();
+    SquashfsWriterConfig config = {
+        .compressor = profile->native_compressor,
+        .level = profile->native_level,
+        .flags = profile->native_flags,
+        .block_size = profile->block_size,
+        .workers = (int)get_processor_count(),
+        .memory_mib = profile->memory_mib,
+        .block_cache_dir = CONFIG_SQUASHFS_BLOCK_CACHE_DIR
+    };
+    return config;
+}
+
+static int run_native_writer(
+    const Manifest *manifest, const char *output_path, off_t offset,
+    const char *sort_path
+)
+{
+    const SquashfsProfile *profile = get_squashfs_profile();
+    SquashfsWriterConfig config = get_native_writer_config();
+    config.sort_path = sort_path;
+    config.offset = offset;
+    LOG_INFO(
+        "Using squashfs profile %s with the native writer (%d workers)",
+        profile->name, config.workers
+    );
+    if (common.mkdir_p(CONFIG_SQUASHFS_BLOCK_CACHE_DIR) != 0)
+    {
+        LOG_WARNING("Failed to create squashfs block cache, compressing every block");
+        config.block_cache_dir = NULL;
+    }
+    if (write_squashfs_image(manifest, output_path, &config) != 0)
+    {
+        LOG_ERROR("Failed to create squashfs from %s", manifest->root->path);
+        return -3;
+    }
+
+    // Keep the block cache within its size limit.
+    if (config.block_cache_dir
+        && prune_cache(
+            CONFIG_SQUASHFS_BLOCK_CACHE_DIR, NULL, 1, CONFIG_SQUASHFS_BLOCK_CACHE_MAX_MIB
+        ) != 0)
+    {
+        LOG_WARNING("Failed to prune squashfs block cache");
+    }
+
+    if (offset == 0)
+    {
+        log_file_size("Squashfs", output_path);
+    }
+
+    return 0;
+}
+
+static int build_squashfs(
+    const Manifest *manifest, const char *output_path, off_t offset,
+    const char *const *excluded_paths, int excluded_count
+)
+{
+    // Order files by a boot trace, placing boot-time reads first.
+    char sort_path[COMMON_MAX_PATH_LENGTH];
+    const char *sort = NULL;
+    if (build_options.squashfs_sort)
+    {
+        snprintf(sort_path, sizeof(sort_path), "%s.sort", output_path);
+        if (convert_boot_trace(build_options.squashfs_sort, sort_path) != 0)
+        {
+            LOG_ERROR("Failed to convert boot trace %s", build_options.squashfs_sort);
+            common.rm_file(sort_path);
+            return -4;
+        }
+        sort = sort_path;
+    }
+
+    // Write the image with the selected writer.
+    int result = strcmp(build_options.squashfs_writer, "native") == 0
+        ? run_native_writer(manifest, output_path, offset, sort)
+        : run_mksquashfs(manifest->root->path, output_path, sort, excluded_paths, excluded_count);
+    if (sort)
+    {
+        common.rm_file(sort);
+    }
+
+    return result;
+}
+
+static int squash_tree(
+    const char *source_path, const char *output_path, off_t offset,
+    const char *const *excluded_paths, int excluded_count
+)
+{
+    char key[COMMON_SHA256_HEX_LENGTH];
+    char cache_path[COMMON_MAX_PATH_LENGTH];
+    int cacheable = 1;
+
+    // Walk the tree once, for both the cache key and the native writer.
+    Manifest manifest;
+    if (create_manifest(source_path, excluded_paths, excluded_count, &manifest) != 0)
+    {
+        LOG_ERROR("Failed to read %s", source_path);
+        return -6;
+    }
+
+    // Compute the cache key from the tree and the image parameters.
+    if (compute_squashfs_key(&manifest, key, sizeof(key)) != 0)
+    {
+        LOG_WARNING("Failed to fingerprint %s, squashfs cache disabled", source_path);
+        cacheable = 0;
+    }
+    else
+    {
+        snprintf(cache_path, sizeof(cache_path), CONFIG_SQUASHFS_CACHE_DIR "/%s.squashfs", key);
+    }
+
+    // Reuse the cached image when the tree is unchanged.
+    if (cacheable && common.file_exists(cache_path))
+    {
+        free_manifest(&manifest);
+        LOG_INFO("Reusing cached squashfs for %s", source_path);
+        touch_cache_entry(cache_path);
+        int reuse_result = offset > 0
+            ? copy_into(cache_path, output_path, offset)
+            : link_or_copy(cache_path, output_path);
+        if (reuse_result != 0)
+        {
+            LOG_ERROR("Failed to reuse cached squashfs");
+            return -5;
+        }
+        if (offset == 0)
+        {
+            log_file_size("Squashfs", output_path);
+        }
+        return 0;
+    }
+
+    // Build the image from scratch.
+    int result = build_squashfs(&manifest, output_path, offset, excluded_paths, excluded_count);
+    free_manifest(&manifest);
+    if (result != 0)
+    {
+        return result;
+    }
+
+    // Store the new image for later builds. An image written into another
+    // file is not copied out again, which would undo the point of it.
+    if (cacheable && offset == 0)
+    {
+        store_cached_squashfs(output_path, cache_path);
+    }
+
+    return 0;
+}
+
+int create_squashfs(
+    const char *source_path, const char *output_path,
+    const char *const *excluded_paths, int excluded_count
+)
+{
+    return squash_tree(source_path, output_path, 0, excluded_paths, excluded_count);
+}
+
+int stream_squashfs(
+    const char *source_path, const char *output_path, off_t offset,
+    const char *const *excluded_paths, int excluded_count, off_t *out_size
+)
+{
+    int result = squash_tree(source_path, output_path, offset, excluded_paths, excluded_count);
+    if (result != 0)
+    {
+        return result;
+    }
+
+    // The image ends the file.
+    struct stat st;
+    if (stat(output_path, &st) != 0)
+    {
+        return -3;
+    }
+    *out_size = st.st_size - offset;
+
+    return 0;
+}
+
+int write_squashfs_record(const char *path)
+{
+    // Record the parameters of the writer that was used.
+    char options[COMMON_MAX_COMMAND_LENGTH];
+    if (strcmp(build_options.squashfs_writer, "native") == 0)
+    {
+        SquashfsWriterConfig config = get_native_writer_config();
+        snprintf(
+            options, sizeof(options),
+            "compressor=%s level=%d flags=0x%x block-size=%d workers=%d memory=%dM",
+            config.compressor, config.level, config.flags, config.block_size,
+            config.workers, config.memory_mib
+        );
+    }
+    else
+    {
+        get_squashfs_options(options, sizeof(options));
+    }
+
+    char record[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        record, sizeof(record),
+        "SQUASHFS_PROFILE=%s\nSQUASHFS_WRITER=%s\nSQUASHFS_OPTIONS=\"%s\"\n"
+        "SQUASHFS_SORTED=%s\n",
+        get_squashfs_profile()->name, build_options.squashfs_writer, options,
+        build_options.squashfs_sort ? "yes" : "no"
+    );
+    if (common.write_file(path, record) != 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+/**
+ * A type representing a named set of squashfs parameters.
+ *
+ * The compression is given both as mksquashfs arguments and as the
+ * libsquashfs compressor, level, and flags the native writer uses.
+ */
+typedef struct
+{
+    const char *name;
+    const char *compression;
+    int block_size;
+    int memory_mib;
+    const char *native_compressor;
+    int native_level;
+    int native_flags;
+} SquashfsProfile;
+
+/**
+ * Finds a squashfs profile by name.
+ *
+ * @param name The profile name (e.g. "release").
+ *
+ * @return The profile, or NULL if no profile has that name.
+ */
+const SquashfsProfile *find_squashfs_profile(const char *name);
+
+/**
+ * Gets the squashfs profile selected for the current build.
+ *
+ * @return The selected profile. Options are validated at startup, so this
+ * never returns NULL during a build.
+ */
+const SquashfsProfile *get_squashfs_profile(void);
+
+/**
+ * Builds the mksquashfs arguments for the selected profile.
+ *
+ * Covers compression, block size, and explicit thread and memory limits,
+ * with one thread per online CPU.
+ *
+ * @param out_options The buffer receiving the arguments.
+ * @param out_size The size of the output buffer.
+ */
+void get_squashfs_options(char *out_options, size_t out_size);
+
+/**
+ * Creates a squashfs filesystem from a directory with the selected profile.
+ *
+ * The tree is walked once into a manifest, which both the cache key and the
+ * native writer use. The image is written by mksquashfs, or in-process from
+ * that manifest with --squashfs-writer=native.
+ *
+ * With --squashfs-sort, the boot trace is converted into a sort file so the
+ * files read during boot are laid out first and in read order.
+ *
+ * Images are cached by a fingerprint of the tree (paths, modes, owners,
+ * sizes, extended attributes, and content hashes) and the parameters that
+ * shape the image. When the fingerprint matches a cached image, it is
+ * hardlinked, or copied across filesystems, instead of being rebuilt. The
+ * least recently used images beyond CONFIG_SQUASHFS_CACHE_MAX_MIB and
+ * blocks beyond CONFIG_SQUASHFS_BLOCK_CACHE_MAX_MIB are pruned.
+ *
+ * Excluded paths are relative to the source and start with a slash (e.g.
+ * `/boot/vmlinuz`). They are left out of both the image and its cache key.
+ *
+ * @param source_path The directory to squash.
+ * @param output_path The path of the squashfs file to create.
+ * @param excluded_paths The paths to leave out of the image, or NULL.
+ * @param excluded_count The number of excluded paths.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates source path quoting failure.
+ * @return - `-2` - Indicates output path quoting failure.
+ * @return - `-3` - Indicates mksquashfs or native writer failure.
+ * @return - `-4` - Indicates boot trace conversion or path quoting failure.
+ * @return - `-5` - Indicates cached image reuse failure.
+ * @return - `-6` - Indicates source tree read failure.
+ */
+int create_squashfs(
+    const char *source_path, const char *output_path,
+    const char *const *excluded_paths, int excluded_count
+);
+
+/**
+ * Writes a squashfs filesystem from a directory into an existing file.
+ *
+ * Works like create_squashfs(), but the image is written at an offset of
+ * the output file, which it then ends, so it can be appended to another
+ * image without an intermediate file. Only the native writer supports this.
+ * Cached images are copied in, but images written this way are not added to
+ * the cache, since that would copy them out again.
+ *
+ * @param source_path The directory to squash.
+ * @param output_path The file to write the image into.
+ * @param offset The offset to write the image at.
+ * @param excluded_paths The paths to leave out of the image, or NULL.
+ * @param excluded_count The number of excluded paths.
+ * @param out_size The size of the written image, padded to 4 KiB.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-3` - Indicates native writer failure.
+ * @return - `-4` - Indicates boot trace conversion failure.
+ * @return - `-5` - Indicates cached image reuse failure.
+ * @return - `-6` - Indicates source tree read failure.
+ */
+int stream_squashfs(
+    const char *source_path, const char *output_path, off_t offset,
+    const char *const *excluded_paths, int excluded_count, off_t *out_size
+);
+
+/**
+ * Records the squashfs parameters of the build in a metadata file.
+ *
+ * Writes shell-style KEY=value lines naming the profile, the writer, the
+ * parameters that writer used, and whether a boot trace ordered the files,
+ * so an ISO can be traced back to them. The parameters are the exact
+ * mksquashfs arguments, or the native writer's compressor, level, flags,
+ * block size, worker count, and memory limit.
+ *
+ * @param path The path of the metadata file to write.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates write failure.
+ */
+int write_squashfs_record(const char *path);
@@ -0,0 +1,68 @@
+/**
+ * This code is responsible for building the unified kernel image that UEFI
+ * firmware boots in place of GRUB.
+ */
+
+#include "all.h"
+
+static int build_uki(
+    const char *rootfs_path, const char *kernel_params, const char *uki_path
+)
+{
+    char kernel_path[COMMON_MAX_PATH_LENGTH];
+    char initrd_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(kernel_path, sizeof(kernel_path), "%s" CONFIG_BOOT_KERNEL_PATH, rootfs_path);
+    snprintf(initrd_path, sizeof(initrd_path), "%s" CONFIG_BOOT_INITRD_PATH, rootfs_path);
+
+    // Quote paths for shell safety.
+    char quoted_kernel[COMMON_MAX_QUOTED_LENGTH];
+    char quoted_initrd[COMMON_MAX_QUOTED_LENGTH];
+    char quoted_uki[COMMON_MAX_QUOTED_LENGTH];
+    if (common.shell_escape_path(kernel_path, quoted_kernel, sizeof(quoted_kernel)) != 0
+        || common.shell_escape_path(initrd_path, quoted_initrd, sizeof(quoted_initrd)) != 0
+        || common.shell_escape_path(uki_path, quoted_uki, sizeof(quoted_uki)) != 0)
+    {
+        LOG_ERROR("Failed to quote unified kernel image paths");
+        return -1;
+    }
+
+    // Join the kernel, initrd, and command line onto the systemd EFI stub.
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        command, sizeof(command),
+        "ukify build "
+        "--stub=" CONFIG_UKI_EFI_STUB_PATH " "
+        "--linux=%s "
+        "--initrd=%s "
+        "--cmdline=\"%s\" "
+        "--output=%s",
+        quoted_kernel, quoted_initrd, kernel_params, quoted_uki
+    );
+    if (common.run_command_indented(command) != 0)
+    {
+        LOG_ERROR("Failed to build unified kernel image");
+        return -2;
+    }
+
+    return 0;
+}
+
+int create_uki_esp(
+    const char *rootfs_path, const char *kernel_params, const char *output_path
+)
+{
+    LOG_INFO("Building unified kernel image for UEFI boot...");
+
+    // Build the UKI next to the FAT image that will hold it.
+    char uki_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(uki_path, sizeof(uki_path), "%s.uki-%d", output_path, getpid());
+    int result = build_uki(rootfs_path, kernel_params, uki_path);
+    if (result == 0)
+    {
+        log_file_size("Unified kernel image", uki_path);
+        result = create_esp_image(uki_path, output_path) == 0 ? 0 : -3;
+    }
+    common.rm_file(uki_path);
+
+    return result;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+/**
+ * Creates an EFI system partition image booting a unified kernel image.
+ *
+ * Builds a unified kernel image with ukify from the live rootfs kernel and
+ * initrd and the given command line, and stores it as the default EFI
+ * loader (`EFI/BOOT/BOOTX64.EFI`) of a FAT image sized to fit it. UEFI
+ * firmware then starts the kernel directly, without GRUB.
+ *
+ * @param rootfs_path The path to the live root filesystem directory.
+ * @param kernel_params The live kernel command line.
+ * @param output_path The path of the FAT image to create.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates path quoting failure.
+ * @return - `-2` - Indicates unified kernel image build failure.
+ * @return - `-3` - Indicates FAT image creation failure.
+ */
+int create_uki_esp(
+    const char *rootfs_path, const char *kernel_params, const char *output_path
+);
@@ -5,7 +5,7 @@
  *
  * Creates a minimal, stripped rootfs that serves as the foundation for
  * both the target (installed system) and live (live installer) rootfs.
- * Running debootstrap once and copying saves significant build time.
+ * Running debootstrap once and deriving from it saves significant build time.
  *
  * @param rootfs_dir The directory for the base rootfs.
  *
@@ -17,17 +17,33 @@ int create_base_rootfs(const char *path)
         return -1;
     }
 
-    // Run debootstrap to create a minimal Debian rootfs.
+    // Create the base rootfs volume so target and live can snapshot it.
+    if (create_base_volume(path) != 0)
+    {
+        LOG_ERROR("Failed to create base rootfs directory");
+        return -2;
+    }
+
+    // Disable dpkg's per-file fsync before debootstrap installs anything.
+    if (build_options.unsafe_io && seed_unsafe_io(path) != 0)
+    {
+        LOG_ERROR("Failed to seed dpkg unsafe-io configuration");
+        return -3;
+    }
+
+    // Run debootstrap to create a minimal Debian rootfs. The initramfs
+    // compressor is included here so both target and live inherit it.
+    const InitramfsCodec *codec = get_initramfs_codec();
     char command[COMMON_MAX_COMMAND_LENGTH];
     snprintf(
         command, sizeof(command),
-        "debootstrap --variant=minbase %s %s",
-        CONFIG_DEBIAN_RELEASE, quoted_path
+        "debootstrap --variant=minbase --include=%s %s %s",
+        codec->package, CONFIG_DEBIAN_RELEASE, quoted_path
     );
     if (common.run_command_indented(command) != 0)
     {
         LOG_ERROR("Command failed: debootstrap");
-        return -2;
+        return -4;
     }
 
     // Enable Debian's non-free-firmware section.
@@ -45,7 +61,7 @@ int create_base_rootfs(const char *path)
     if (common.write_file(sources_path, sources_content) != 0)
     {
         LOG_ERROR("Failed to configure apt sources");
-        return -3;
+        return -5;
     }
 
     // Update package lists for later package installation.
@@ -53,7 +69,7 @@ int create_base_rootfs(const char *path)
     if (common.run_chroot_indented(path, "apt-get update") != 0)
     {
         LOG_ERROR("Failed to update package lists");
-        return -4;
+        return -6;
     }
 
     // Pre-create initramfs configuration before installing packages. When
@@ -62,7 +78,9 @@ int create_base_rootfs(const char *path)
     // BEFORE apt-get install runs. We use conf.d/ drop-ins because they
     // survive package installation; files like /etc/initramfs-tools/modules
     // are dpkg conffiles that get replaced when initramfs-tools installs.
-    LOG_INFO("Pre-configuring initramfs for hardware support...");
+    // The module policy is image-specific and is selected once each image's
+    // packages are installed (see configure_initramfs_modules()).
+    LOG_INFO("Pre-configuring initramfs compression...");
     char initramfs_conf_dir[COMMON_MAX_PATH_LENGTH];
     snprintf(
         initramfs_conf_dir, sizeof(initramfs_conf_dir),
@@ -71,21 +89,32 @@ int create_base_rootfs(const char *path)
     if (common.mkdir_p(initramfs_conf_dir) != 0)
     {
         LOG_ERROR("Failed to create initramfs-tools directory");
-        return -5;
+        return -7;
     }
 
-    // Set MODULES=most to include drivers for hardware not on the build host
-    // (VMs, NVMe, USB). The default MODULES=dep only includes drivers for
-    // detected hardware, which breaks when the ISO boots elsewhere.
-    char driver_policy_path[COMMON_MAX_PATH_LENGTH];
+    // Select the initramfs compressor and level. The compressor threads are
+    // set when the image is generated (see generate_rootfs_initramfs()).
+    char compression_path[COMMON_MAX_PATH_LENGTH];
+    char compression[128];
+    snprintf(
+        compression_path, sizeof(compression_path),
+        "%s/etc/initramfs-tools/conf.d/compression.conf", path
+    );
     snprintf(
-        driver_policy_path, sizeof(driver_policy_path),
-        "%s/etc/initramfs-tools/conf.d/driver-policy.conf", path
+        compression, sizeof(compression),
+        "COMPRESS=%s\nCOMPRESSLEVEL=%s\n", codec->name, codec->level
     );
-    if (common.write_file(driver_policy_path, "MODULES=most\n") != 0)
+    if (common.write_file(compression_path, compression) != 0)
     {
-        LOG_ERROR("Failed to create initramfs conf.d");
-        return -6;
+        LOG_ERROR("Failed to write initramfs compression config");
+        return -8;
+    }
+
+    // Suppress fsync in maintainer scripts of every later installation.
+    if (build_options.unsafe_io && enable_unsafe_io_preload(path) != 0)
+    {
+        LOG_ERROR("Failed to enable fsync-suppressing preload");
+        return -9;
     }
 
     LOG_INFO("Base rootfs created successfully");
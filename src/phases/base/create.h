@@ -4,17 +4,21 @@
  * Creates a minimal base rootfs using debootstrap.
  *
  * This creates the foundation that both target and live rootfs will
- * be copied from. Runs debootstrap, configures apt sources, updates
- * package lists, and pre-configures initramfs for hardware support.
+ * be derived from. Runs debootstrap, configures apt sources, updates
+ * package lists, and pre-configures initramfs compression. In unsafe-io
+ * mode, dpkg and maintainer scripts skip fsync.
  *
  * @param path The path to create the base rootfs.
  *
  * @return - `0` - Indicates success.
  * @return - `-1` - Indicates path quoting failure.
- * @return - `-2` - Indicates debootstrap failure.
- * @return - `-3` - Indicates apt sources configuration failure.
- * @return - `-4` - Indicates package list update failure.
- * @return - `-5` - Indicates initramfs directory creation failure.
- * @return - `-6` - Indicates initramfs config write failure.
+ * @return - `-2` - Indicates base directory creation failure.
+ * @return - `-3` - Indicates unsafe-io configuration failure.
+ * @return - `-4` - Indicates debootstrap failure.
+ * @return - `-5` - Indicates apt sources configuration failure.
+ * @return - `-6` - Indicates package list update failure.
+ * @return - `-7` - Indicates initramfs directory creation failure.
+ * @return - `-8` - Indicates initramfs compression config write failure.
+ * @return - `-9` - Indicates unsafe-io preload setup failure.
  */
 int create_base_rootfs(const char *path);
@@ -1,6 +1,6 @@
 /**
- * This code is responsible for creating the live rootfs by copying
- * from the base rootfs and installing live-specific packages.
+ * This code is responsible for creating the live rootfs by deriving
+ * it from the base rootfs and installing live-specific packages.
  */
 
 #include "all.h"
@@ -9,51 +9,52 @@ int create_live_rootfs(const char *base_path, const char *path)
 {
     LOG_INFO("Creating live rootfs at %s", path);
 
-    // Quote the base path for shell safety.
-    char quoted_base[COMMON_MAX_QUOTED_LENGTH];
-    if (common.shell_escape_path(base_path, quoted_base, sizeof(quoted_base)) != 0)
+    // Derive the rootfs from base without duplicating it where possible.
+    LOG_INFO("Deriving rootfs from base...");
+    if (derive_rootfs(base_path, path, NULL) != 0)
     {
-        LOG_ERROR("Failed to quote base path");
+        LOG_ERROR("Failed to derive rootfs from base");
         return -1;
     }
 
-    // Quote the destination path for shell safety.
-    char quoted_path[COMMON_MAX_QUOTED_LENGTH];
-    if (common.shell_escape_path(path, quoted_path, sizeof(quoted_path)) != 0)
+    // Defer initramfs, ldconfig, and fontconfig triggers until configuration
+    // is complete so each runs once instead of once per package.
+    if (defer_rootfs_triggers(path) != 0)
     {
-        LOG_ERROR("Failed to quote path");
+        LOG_ERROR("Failed to defer package triggers");
         return -2;
     }
 
-    // Copy the base rootfs.
-    LOG_INFO("Copying base rootfs...");
-    char command[COMMON_MAX_COMMAND_LENGTH];
-    snprintf(command, sizeof(command), "cp -a %s %s", quoted_base, quoted_path);
-    if (common.run_command_indented(command) != 0)
-    {
-        LOG_ERROR("Failed to copy base rootfs");
-        return -3;
-    }
-
-    // Install live-specific packages.
+    // Install live-specific packages, plus the tracer for boot traces.
     LOG_INFO("Installing live environment packages...");
-    int install_result = common.run_chroot_indented(path,
-        "apt-get install -y --no-install-recommends " CONFIG_LIVE_PACKAGES);
+    char install_command[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        install_command, sizeof(install_command),
+        "apt-get install -y --no-install-recommends " CONFIG_LIVE_PACKAGES "%s",
+        build_options.boot_trace ? " " BOOT_TRACE_PACKAGE : ""
+    );
+    int install_result = common.run_chroot_indented(path, install_command);
 
     // Check if package installation succeeded.
     if (install_result != 0)
     {
         LOG_ERROR("Failed to install required packages");
+        return -3;
+    }
+
+    // Select the initramfs modules this image declares. Must be done AFTER
+    // package install because `dpkg` overwrites pre-seeded files. The
+    // initramfs is generated later by `run_deferred_triggers()`.
+    if (configure_initramfs_modules(path, CONFIG_LIVE_INITRAMFS_CLASSES) != 0)
+    {
+        LOG_ERROR("Failed to configure initramfs modules");
         return -4;
     }
 
-    // Add GPU drivers for early KMS initialization. Must be done AFTER package
-    // install because `dpkg` overwrites pre-seeded files. `brand_live_rootfs()`
-    // will call update-initramfs later.
-    if (common.run_chroot(path,
-        "printf 'amdgpu\\ni915\\nnouveau\\nradeon\\n' >> /etc/initramfs-tools/modules") != 0)
+    // Record file accesses during boot to derive the squashfs order from.
+    if (build_options.boot_trace && enable_boot_trace(path) != 0)
     {
-        LOG_ERROR("Failed to add GPU drivers to initramfs modules");
+        LOG_ERROR("Failed to enable boot trace service");
         return -5;
     }
 
@@ -65,28 +66,6 @@ int create_live_rootfs(const char *base_path, const char *path)
         return -6;
     }
 
-    // Copy kernel and initrd to standard paths for boot loaders.
-    int kernel_result = copy_kernel_and_initrd(path);
-    if (kernel_result != 0)
-    {
-        switch (kernel_result)
-        {
-            case -1:
-                LOG_ERROR("Kernel not found");
-                break;
-            case -2:
-                LOG_ERROR("Failed to copy kernel");
-                break;
-            case -3:
-                LOG_ERROR("Initrd not found");
-                break;
-            case -4:
-                LOG_ERROR("Failed to copy initrd");
-                break;
-        }
-        return -7;
-    }
-
     LOG_INFO("Live rootfs created successfully");
 
     return 0;
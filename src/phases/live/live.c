@@ -4,11 +4,9 @@
 
 #include "all.h"
 
-int run_live_phase(
+int run_live_rootfs_stage(
     const char *base_rootfs_dir,
     const char *rootfs_dir,
-    const char *tarball_path,
-    const char *components_dir,
     const char *version
 )
 {
@@ -26,32 +24,64 @@ int run_live_phase(
         return -2;
     }
 
-    // Embed the target rootfs tarball.
-    if (embed_target_rootfs(rootfs_dir, tarball_path) != 0)
+    // Run the deferred package triggers once, generating the initramfs.
+    if (run_deferred_triggers(rootfs_dir) != 0)
     {
-        LOG_ERROR("Failed to embed target rootfs");
+        LOG_ERROR("Failed to run deferred package triggers");
         return -3;
     }
 
+    // Copy kernel and initrd to standard paths for boot loaders.
+    int kernel_result = copy_kernel_and_initrd(rootfs_dir);
+    if (kernel_result != 0)
+    {
+        switch (kernel_result)
+        {
+            case -1:
+                LOG_ERROR("Kernel not found");
+                break;
+            case -2:
+                LOG_ERROR("Failed to copy kernel");
+                break;
+            case -3:
+                LOG_ERROR("Initrd not found");
+                break;
+            case -4:
+                LOG_ERROR("Failed to copy initrd");
+                break;
+        }
+        return -4;
+    }
+
+    // Log the initrd size against the other initramfs module policy.
+    report_initrd_size(rootfs_dir, "live");
+
+    LOG_INFO("Live rootfs ready, target payload can be written into it");
+
+    return 0;
+}
+
+int run_live_payload_stage(const char *rootfs_dir, const char *components_dir)
+{
     // Install LimeOS components (installer, etc.).
     if (install_live_components(rootfs_dir, components_dir) != 0)
     {
         LOG_ERROR("Failed to install components");
-        return -4;
+        return -1;
     }
 
     // Configure autostart to launch installer on boot.
     if (configure_live_autostart(rootfs_dir) != 0)
     {
         LOG_ERROR("Failed to configure autostart");
-        return -5;
+        return -2;
     }
 
     // Clean up apt cache and lists before bundling bootloader packages.
     if (cleanup_apt_directories(rootfs_dir) != 0)
     {
         LOG_ERROR("Failed to cleanup apt directories");
-        return -6;
+        return -3;
     }
 
     // Bundle boot-mode-specific packages (GRUB for BIOS/EFI). Must happen after
@@ -59,10 +89,17 @@ int run_live_phase(
     if (bundle_live_packages(rootfs_dir) != 0)
     {
         LOG_ERROR("Failed to bundle packages");
-        return -7;
+        return -4;
+    }
+
+    // Remove the unsafe-io setup and flush the rootfs before it is squashed.
+    if (build_options.unsafe_io && restore_safe_io(rootfs_dir) != 0)
+    {
+        LOG_ERROR("Failed to restore safe I/O in live rootfs");
+        return -5;
     }
 
     LOG_INFO("Phase 4 complete: Live rootfs created");
-    
+
     return 0;
 }
@@ -1,31 +1,44 @@
 #pragma once
 
 /**
- * Runs the live phase.
+ * Runs the first stage of the live phase.
  *
- * Copies the base rootfs, installs live-specific packages, embeds the
- * target tarball, installs LimeOS components, configures init, and bundles
- * boot-mode-specific packages.
+ * Derives from the base rootfs, installs live-specific packages, applies OS
+ * branding, runs the deferred package triggers once, and copies the kernel
+ * and initrd to their standard paths. This stage does not depend on the
+ * target phase, so it can run concurrently with it.
  *
- * @param base_rootfs_dir The path to the base rootfs to copy from.
+ * @param base_rootfs_dir The path to the base rootfs to derive from.
  * @param rootfs_dir The directory for the live rootfs.
- * @param tarball_path The path to the target tarball to embed.
- * @param components_dir The directory containing downloaded components.
  * @param version The version string for OS branding.
  *
  * @return - `0` - Indicates success.
  * @return - `-1` - Indicates live rootfs creation failure.
  * @return - `-2` - Indicates live rootfs configuration failure.
- * @return - `-3` - Indicates target rootfs embedding failure.
- * @return - `-4` - Indicates component installation failure.
- * @return - `-5` - Indicates autostart configuration failure.
- * @return - `-6` - Indicates APT directory cleanup failure.
- * @return - `-7` - Indicates package bundling failure.
+ * @return - `-3` - Indicates deferred trigger failure.
+ * @return - `-4` - Indicates kernel copy failure.
  */
-int run_live_phase(
+int run_live_rootfs_stage(
     const char *base_rootfs_dir,
     const char *rootfs_dir,
-    const char *tarball_path,
-    const char *components_dir,
     const char *version
 );
+
+/**
+ * Runs the second stage of the live phase.
+ *
+ * Installs LimeOS components, configures init, and bundles
+ * boot-mode-specific packages. This stage only touches the live rootfs, so
+ * it can run while the target payload is being written into it.
+ *
+ * @param rootfs_dir The directory for the live rootfs.
+ * @param components_dir The directory containing downloaded components.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates component installation failure.
+ * @return - `-2` - Indicates autostart configuration failure.
+ * @return - `-3` - Indicates APT directory cleanup failure.
+ * @return - `-4` - Indicates package bundling failure.
+ * @return - `-5` - Indicates safe I/O restoration failure.
+ */
+int run_live_payload_stage(const char *rootfs_dir, const char *components_dir);
@@ -0,0 +1,127 @@
+/**
+ * This code is responsible for expressing the build phases as a dependency
+ * graph and running it with the scheduler.
+ */
+
+#include "all.h"
+
+static int run_preparation_task(void *context)
+{
+    BuildContext *build = context;
+    return run_preparation_phase(build->version, build->components_dir);
+}
+
+static int run_base_task(void *context)
+{
+    BuildContext *build = context;
+    return run_base_phase(build->base_rootfs_dir);
+}
+
+static int run_target_rootfs_task(void *context)
+{
+    BuildContext *build = context;
+    return run_target_rootfs_stage(
+        build->base_rootfs_dir, build->target_rootfs_dir, build->version
+    );
+}
+
+static int run_target_payload_task(void *context)
+{
+    BuildContext *build = context;
+    return run_target_payload_stage(
+        build->target_rootfs_dir, build->live_rootfs_dir
+    );
+}
+
+static int run_live_rootfs_task(void *context)
+{
+    BuildContext *build = context;
+    return run_live_rootfs_stage(
+        build->base_rootfs_dir, build->live_rootfs_dir, build->version
+    );
+}
+
+static int run_live_payload_task(void *context)
+{
+    BuildContext *build = context;
+    return run_live_payload_stage(build->live_rootfs_dir, build->components_dir);
+}
+
+static int run_base_release_task(void *context)
+{
+    BuildContext *build = context;
+
+    // Keep the base rootfs while the live rootfs is an overlay on top of it.
+    if (is_overlay_rootfs(build->live_rootfs_dir))
+    {
+        return 0;
+    }
+
+    // Release the base rootfs since target and live no longer need it.
+    if (release_rootfs(build->base_rootfs_dir) != 0)
+    {
+        LOG_WARNING("Failed to release base rootfs");
+    }
+
+    return 0;
+}
+
+static int run_assembly_task(void *context)
+{
+    BuildContext *build = context;
+    return run_assembly_phase(
+        build->base_rootfs_dir, build->live_rootfs_dir, build->staging_dir,
+        build->version
+    );
+}
+
+int run_build_pipeline(BuildContext *context)
+{
+    Scheduler scheduler;
+    init_scheduler(&scheduler);
+
+    // Declare one task per phase, splitting target and live at their join.
+    int preparation = add_scheduler_task(&scheduler, "preparation", run_preparation_task, context);
+    int base = add_scheduler_task(&scheduler, "base", run_base_task, context);
+    int target_rootfs = add_scheduler_task(&scheduler, "target-rootfs", run_target_rootfs_task, context);
+    int target_payload = add_scheduler_task(&scheduler, "target-payload", run_target_payload_task, context);
+    int live_rootfs = add_scheduler_task(&scheduler, "live-rootfs", run_live_rootfs_task, context);
+    int live_payload = add_scheduler_task(&scheduler, "live-payload", run_live_payload_task, context);
+    int base_release = add_scheduler_task(&scheduler, "base-release", run_base_release_task, context);
+    int assembly = add_scheduler_task(&scheduler, "assembly", run_assembly_task, context);
+    if (preparation < 0 || base < 0 || target_rootfs < 0 || target_payload < 0
+        || live_rootfs < 0 || live_payload < 0 || base_release < 0 || assembly < 0)
+    {
+        LOG_ERROR("Failed to declare build tasks");
+        return -3;
+    }
+
+    // Wire the dependency edges between the tasks.
+    if (add_scheduler_dependency(&scheduler, target_rootfs, base) != 0
+        || add_scheduler_dependency(&scheduler, live_rootfs, base) != 0
+        || add_scheduler_dependency(&scheduler, target_payload, target_rootfs) != 0
+        || add_scheduler_dependency(&scheduler, target_payload, live_rootfs) != 0
+        || add_scheduler_dependency(&scheduler, live_payload, preparation) != 0
+        || add_scheduler_dependency(&scheduler, live_payload, live_rootfs) != 0
+        || add_scheduler_dependency(&scheduler, base_release, target_payload) != 0
+        || add_scheduler_dependency(&scheduler, base_release, live_payload) != 0
+        || add_scheduler_dependency(&scheduler, assembly, target_payload) != 0
+        || add_scheduler_dependency(&scheduler, assembly, live_payload) != 0)
+    {
+        LOG_ERROR("Failed to declare build task dependencies");
+        return -3;
+    }
+
+    // Run the graph and translate its outcome.
+    switch (run_scheduler(&scheduler))
+    {
+        case 0:
+            return 0;
+        case -1:
+            return -1;
+        case -2:
+            return -2;
+        default:
+            return -3;
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+/** A type representing the paths and parameters shared by all phases. */
+typedef struct
+{
+    const char *version;
+    char components_dir[COMMON_MAX_PATH_LENGTH];
+    char base_rootfs_dir[COMMON_MAX_PATH_LENGTH];
+    char target_rootfs_dir[COMMON_MAX_PATH_LENGTH];
+    char live_rootfs_dir[COMMON_MAX_PATH_LENGTH];
+    char staging_dir[COMMON_MAX_PATH_LENGTH];
+} BuildContext;
+
+/**
+ * Runs all build phases as a dependency graph.
+ *
+ * Preparation and base run concurrently. Once the base rootfs exists, the
+ * target and live rootfs stages run concurrently, joining at the point where
+ * the target payload is written into the live rootfs. Assembly runs last.
+ *
+ * @param context The build context shared by all phases.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates a phase failure.
+ * @return - `-2` - Indicates the build was interrupted.
+ * @return - `-3` - Indicates the dependency graph could not be built or run.
+ */
+int run_build_pipeline(BuildContext *context);
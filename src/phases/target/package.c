@@ -1,19 +1,91 @@
 /**
- * This code is responsible for packaging the target rootfs into a tarball.
+ * This code is responsible for packaging the target rootfs into a tarball or
+ * filesystem image.
  */
 
 #include "all.h"
 
-int package_target_rootfs(const char *rootfs_path, const char *output_path)
+static int create_tar_payload(
+    const char *rootfs_path, const char *output_path,
+    char *out_sha256, size_t out_size
+)
 {
-    LOG_INFO("Packaging target rootfs to %s", output_path);
+    // Resolve the compressor for the selected codec.
+    const PayloadCodec *codec = get_payload_codec();
+    const char *compressor = get_payload_compressor(codec);
+    if (!compressor)
+    {
+        LOG_ERROR("No compressor available for codec %s", codec->name);
+        return -1;
+    }
+    LOG_INFO("Compressing with %s", compressor);
+
+    // Stream the rootfs through the compressor, hashing the output.
+    int archive_result = write_tar_archive(
+        rootfs_path, output_path, compressor, out_sha256, out_size
+    );
+    if (archive_result != 0)
+    {
+        LOG_ERROR("Failed to create rootfs tarball (error %d)", archive_result);
+        unlink(output_path);
+        return -2;
+    }
+
+    return 0;
+}
+
+static int create_chunked_payload(
+    const char *rootfs_path, const char *payload_dir, const char *output_path,
+    char *out_sha256, size_t out_size
+)
+{
+    // Resolve the compressor for the selected codec.
+    const PayloadCodec *codec = get_payload_codec();
+    const char *compressor = get_payload_compressor(codec);
+    if (!compressor)
+    {
+        LOG_ERROR("No compressor available for codec %s", codec->name);
+        return -1;
+    }
+    LOG_INFO("Compressing %d MiB chunks with %s", CONFIG_PAYLOAD_CHUNK_MIB, compressor);
+
+    // Split the rootfs into independently compressed chunks and an index.
+    char extension[32];
+    snprintf(extension, sizeof(extension), ".tar%s", codec->extension);
+    int archive_result = write_chunked_tar_archive(
+        rootfs_path, payload_dir, CONFIG_TARGET_PAYLOAD_NAME, extension,
+        compressor, (off_t)CONFIG_PAYLOAD_CHUNK_MIB * 1024 * 1024
+    );
+    if (archive_result != 0)
+    {
+        LOG_ERROR("Failed to create chunked rootfs payload (error %d)", archive_result);
+        return -2;
+    }
+
+    // Hash the index, which in turn holds the hash of every chunk.
+    if (common.compute_file_sha256(output_path, out_sha256, out_size) != 0)
+    {
+        LOG_ERROR("Failed to compute payload checksum");
+        return -3;
+    }
+
+    return 0;
+}
+
+static int create_image_payload(
+    const char *rootfs_path, const char *output_path,
+    char *out_sha256, size_t out_size
+)
+{
+    const PayloadFormat *format = get_payload_format();
+    const PayloadCodec *codec = get_payload_codec();
 
     // Quote the rootfs path for shell safety.
     char quoted_rootfs[COMMON_MAX_QUOTED_LENGTH];
     if (common.shell_escape_path(rootfs_path, quoted_rootfs, sizeof(quoted_rootfs)) != 0)
     {
         LOG_ERROR("Failed to quote rootfs path");
-        return -1;
+        return -2;
     }
 
     // Quote the output path for shell safety.
@@ -24,21 +96,103 @@ int package_target_rootfs(const char *rootfs_path, const char *output_path)
         return -2;
     }
 
-    // Create a compressed tarball of the rootfs.
-    // Use --numeric-owner to preserve UIDs/GIDs without mapping to names.
-    // Use -C to change to the rootfs directory so paths are relative.
+    // Build the image, letting the tool compress it with the selected codec.
     char command[COMMON_MAX_COMMAND_LENGTH];
-    snprintf(
-        command, sizeof(command),
-        "tar --numeric-owner -czf %s -C %s .",
-        quoted_output, quoted_rootfs
-    );
+    if (strcmp(format->name, "squashfs") == 0)
+    {
+        snprintf(
+            command, sizeof(command), "mksquashfs %s %s %s -noappend",
+            quoted_rootfs, quoted_output, codec->squashfs_options
+        );
+    }
+    else
+    {
+        snprintf(
+            command, sizeof(command), "mkfs.erofs %s %s %s",
+            codec->erofs_options, quoted_output, quoted_rootfs
+        );
+    }
     if (common.run_command_indented(command) != 0)
     {
-        LOG_ERROR("Failed to create rootfs tarball");
+        LOG_ERROR("Failed to create %s image", format->name);
+        unlink(output_path);
+        return -2;
+    }
+
+    // Hash the finished image.
+    if (common.compute_file_sha256(output_path, out_sha256, out_size) != 0)
+    {
+        LOG_ERROR("Failed to compute payload checksum");
         return -3;
     }
 
+    return 0;
+}
+
+int package_target_rootfs(
+    const char *rootfs_path, const char *payload_dir, int is_delta
+)
+{
+    const PayloadFormat *format = get_payload_format();
+    const PayloadCodec *codec = get_payload_codec();
+
+    // Construct the payload path for the selected format and codec.
+    char name[COMMON_MAX_PATH_LENGTH];
+    char output_path[COMMON_MAX_PATH_LENGTH];
+    get_target_payload_name(name, sizeof(name));
+    snprintf(output_path, sizeof(output_path), "%s/%s", payload_dir, name);
+
+    LOG_INFO("Packaging target rootfs as %s to %s", format->name, output_path);
+
+    // Create the payload in the selected format.
+    char sha256[COMMON_SHA256_HEX_LENGTH];
+    int result;
+    if (format->is_image)
+    {
+        result = create_image_payload(rootfs_path, output_path, sha256, sizeof(sha256));
+    }
+    else if (format->is_chunked)
+    {
+        result = create_chunked_payload(
+            rootfs_path, payload_dir, output_path, sha256, sizeof(sha256)
+        );
+    }
+    else
+    {
+        result = create_tar_payload(rootfs_path, output_path, sha256, sizeof(sha256));
+    }
+    if (result != 0)
+    {
+        return result;
+    }
+
+    // Record the checksum in sha256sum format next to the payload.
+    char checksum_path[COMMON_MAX_PATH_LENGTH];
+    char checksum_line[COMMON_SHA256_HEX_LENGTH + COMMON_MAX_PATH_LENGTH];
+    snprintf(checksum_path, sizeof(checksum_path), "%s.sha256", output_path);
+    snprintf(checksum_line, sizeof(checksum_line), "%s  %s\n", sha256, name);
+    if (common.write_file(checksum_path, checksum_line) != 0)
+    {
+        LOG_ERROR("Failed to write payload checksum");
+        return -3;
+    }
+
+    // Describe the payload for the installer in the same directory.
+    char info_path[COMMON_MAX_PATH_LENGTH];
+    char info[COMMON_MAX_PATH_LENGTH * 2];
+    snprintf(info_path, sizeof(info_path), "%s/" CONFIG_TARGET_PAYLOAD_INFO_NAME, payload_dir);
+    snprintf(
+        info, sizeof(info), "FORMAT=%s\nCODEC=%s\nFILE=%s\n%s",
+        format->name, codec->name, name,
+        is_delta ? "BASE=" CONFIG_LIVE_MEDIUM_PATH "/live/" CONFIG_BASE_LAYER_NAME "\n" : ""
+    );
+    if (common.write_file(info_path, info) != 0)
+    {
+        LOG_ERROR("Failed to write payload metadata");
+        return -4;
+    }
+
+    log_file_size("Target payload", output_path);
     LOG_INFO("Target rootfs packaged successfully");
 
     return 0;
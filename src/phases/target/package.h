@@ -1,17 +1,30 @@
 #pragma once
 
 /**
- * Packages the target rootfs into a compressed tarball.
+ * Packages the target rootfs into the selected payload format.
  *
- * Creates a gzipped tarball of the target rootfs that will be embedded
- * in the live environment for the installer to extract to disk.
+ * Tarballs are streamed in a single pass through the selected payload codec,
+ * hashing them as they are written. Chunked payloads are streamed the same
+ * way into independently compressed chunks, and their index is the payload
+ * file. squashfs and erofs images are built with their own tools,
+ * compressed internally with the same codec, and hashed afterwards. The
+ * SHA-256 is stored next to the payload in a `.sha256` file, and a metadata
+ * file records the format, codec, and file name so the installer can choose
+ * the matching extraction path.
  *
- * @param rootfs_path The path to the target rootfs directory.
- * @param output_path The path where the tarball will be created.
+ * A delta payload holds an overlay upper layer. Its metadata also names the
+ * base layer on the boot medium that the installer must stack it on.
+ *
+ * @param rootfs_path The path to the target rootfs directory or upper layer.
+ * @param payload_dir The directory where the payload will be created.
+ * @param is_delta Whether the rootfs path is a delta on top of the base.
  *
  * @return - `0` - Indicates successful packaging.
- * @return - `-1` - Indicates rootfs path quoting failure.
- * @return - `-2` - Indicates output path quoting failure.
- * @return - `-3` - Indicates tarball creation failure.
+ * @return - `-1` - Indicates no compressor is available for the codec.
+ * @return - `-2` - Indicates payload creation failure.
+ * @return - `-3` - Indicates checksum failure.
+ * @return - `-4` - Indicates metadata file write failure.
  */
-int package_target_rootfs(const char *rootfs_path, const char *output_path);
+int package_target_rootfs(
+    const char *rootfs_path, const char *payload_dir, int is_delta
+);
@@ -4,9 +4,10 @@
 
 #include "all.h"
 
-int run_target_phase(
-    const char *base_rootfs_dir, const char *rootfs_dir,
-    const char *tarball_path, const char *version
+int run_target_rootfs_stage(
+    const char *base_rootfs_dir,
+    const char *rootfs_dir,
+    const char *version
 )
 {
     if (create_target_rootfs(base_rootfs_dir, rootfs_dir) != 0)
@@ -21,22 +22,79 @@ int run_target_phase(
         return -2;
     }
 
+    if (run_deferred_triggers(rootfs_dir) != 0)
+    {
+        LOG_ERROR("Failed to run deferred package triggers");
+        return -3;
+    }
+
+    if (copy_initrd(rootfs_dir) != 0)
+    {
+        LOG_ERROR("Failed to copy initrd");
+        return -4;
+    }
+
+    report_initrd_size(rootfs_dir, "target");
+
+    if (build_options.unsafe_io && restore_safe_io(rootfs_dir) != 0)
+    {
+        LOG_ERROR("Failed to restore safe I/O in target rootfs");
+        return -5;
+    }
+
     if (cleanup_apt_directories(rootfs_dir) != 0)
     {
         LOG_ERROR("Failed to cleanup apt directories");
-        return -3;
+        return -6;
+    }
+
+    LOG_INFO("Target rootfs ready, waiting for live rootfs to package into");
+
+    return 0;
+}
+
+int run_target_payload_stage(const char *rootfs_dir, const char *live_rootfs_dir)
+{
+    // Create the payload directory within the live rootfs.
+    char payload_dir[COMMON_MAX_PATH_LENGTH];
+    snprintf(payload_dir, sizeof(payload_dir), "%s" CONFIG_TARGET_PAYLOAD_DIR, live_rootfs_dir);
+    if (common.mkdir_p(payload_dir) != 0)
+    {
+        LOG_ERROR("Failed to create limeos directory in live rootfs");
+        return -1;
+    }
+
+    // In layered builds, package only the target's changes to the base when
+    // the live system will ship the base as a layer. Tarballs cannot carry
+    // overlayfs opaque directories, so they always hold the full rootfs.
+    char source_dir[COMMON_MAX_PATH_LENGTH];
+    int is_delta = build_options.layered
+        && get_payload_format()->is_image
+        && is_overlay_rootfs(live_rootfs_dir)
+        && get_overlay_upper_dir(rootfs_dir, source_dir, sizeof(source_dir)) == 0;
+    if (!is_delta)
+    {
+        snprintf(source_dir, sizeof(source_dir), "%s", rootfs_dir);
+    }
+    if (build_options.layered && !is_delta)
+    {
+        LOG_WARNING("Packaging the full target rootfs, layering needs overlay rootfs and an image payload");
     }
 
-    if (package_target_rootfs(rootfs_dir, tarball_path) != 0)
+    // Package the target rootfs straight into the live rootfs.
+    if (package_target_rootfs(source_dir, payload_dir, is_delta) != 0)
     {
         LOG_ERROR("Failed to package target rootfs");
-        return -4;
+        return -2;
     }
 
-    // Remove the target rootfs directory.
-    common.rm_rf(rootfs_dir);
+    // Release the target rootfs (unmount, subvolume delete, or removal).
+    if (release_rootfs(rootfs_dir) != 0)
+    {
+        LOG_WARNING("Failed to release target rootfs");
+    }
 
     LOG_INFO("Phase 3 complete: Target rootfs packaged");
-    
+
     return 0;
 }
@@ -1,23 +1,45 @@
 #pragma once
 
 /**
- * Runs the target phase.
+ * Runs the first stage of the target phase.
  *
- * Copies the base rootfs, installs target-specific packages, applies OS
- * branding, and packages the result as a tarball for embedding in the live.
+ * Derives from the base rootfs, installs target-specific packages, applies OS
+ * branding, runs the deferred package triggers once, and strips the rootfs of
+ * build-time state. This stage does not depend on the live phase, so it can
+ * run concurrently with it.
  *
- * @param base_rootfs_dir The path to the base rootfs to copy from.
+ * @param base_rootfs_dir The path to the base rootfs to derive from.
  * @param rootfs_dir The directory for the target rootfs.
- * @param tarball_path The output path for the packaged tarball.
  * @param version The version string for OS branding.
  *
  * @return - `0` - Indicates success.
  * @return - `-1` - Indicates target rootfs creation failure.
  * @return - `-2` - Indicates target rootfs configuration failure.
- * @return - `-3` - Indicates APT directory cleanup failure.
- * @return - `-4` - Indicates tarball packaging failure.
+ * @return - `-3` - Indicates deferred trigger failure.
+ * @return - `-4` - Indicates initrd copy failure.
+ * @return - `-5` - Indicates safe I/O restoration failure.
+ * @return - `-6` - Indicates APT directory cleanup failure.
  */
-int run_target_phase(
-    const char *base_rootfs_dir, const char *rootfs_dir,
-    const char *tarball_path, const char *version
+int run_target_rootfs_stage(
+    const char *base_rootfs_dir,
+    const char *rootfs_dir,
+    const char *version
 );
+
+/**
+ * Runs the second stage of the target phase.
+ *
+ * Packages the target rootfs straight into its final location inside the
+ * live rootfs and releases the target rootfs. In layered builds with an
+ * image payload, only the target's changes to the base are packaged. This
+ * stage joins the target and live branches of the build, so it must run
+ * after both rootfs stages.
+ *
+ * @param rootfs_dir The directory for the target rootfs.
+ * @param live_rootfs_dir The live rootfs to write the payload into.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates payload directory creation failure.
+ * @return - `-2` - Indicates payload packaging failure.
+ */
+int run_target_payload_stage(const char *rootfs_dir, const char *live_rootfs_dir);
@@ -0,0 +1,468 @@
+/**
+ * This code is responsible for streaming a directory tree into compressed
+ * tarballs in-process, hashing the output as it is written.
+ */
+
+#include "all.h"
+
+/** The size of the buffer used to copy file contents into the archive. */
+#define ARCHIVER_COPY_BUFFER_SIZE 262144
+
+/** A type representing one compressed tarball being written. */
+typedef struct
+{
+    int fd;
+    Fingerprint hash;
+    off_t size;
+    struct archive *writer;
+    struct archive_entry_linkresolver *resolver;
+} ArchiveOutput;
+
+static la_ssize_t write_output(
+    struct archive *archive, void *client_data, const void *buffer, size_t length
+)
+{
+    ArchiveOutput *output = client_data;
+
+    // Hash the bytes on their way to disk.
+    if (add_fingerprint_bytes(&output->hash, buffer, length) != 0)
+    {
+        archive_set_error(archive, EIO, "Failed to hash archive output");
+        return -1;
+    }
+
+    // Write the whole buffer, retrying short writes.
+    size_t written = 0;
+    while (written < length)
+    {
+        ssize_t result = write(output->fd, (const char *)buffer + written, length - written);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            archive_set_error(archive, errno, "Failed to write archive output");
+            return -1;
+        }
+        written += (size_t)result;
+    }
+    output->size += (off_t)length;
+
+    return (la_ssize_t)length;
+}
+
+static int open_tree_reader(const char *source_dir, struct archive **out_disk)
+{
+    // Walk the tree physically, without ownership name lookups (numeric
+    // owners only), extended attributes, or crossing mount points.
+    struct archive *disk = archive_read_disk_new();
+    if (!disk
+        || archive_read_disk_set_symlink_physical(disk) != ARCHIVE_OK
+        || archive_read_disk_set_behavior(disk,
+            ARCHIVE_READDISK_NO_TRAVERSE_MOUNTS | ARCHIVE_READDISK_NO_XATTR
+            | ARCHIVE_READDISK_NO_ACL | ARCHIVE_READDISK_NO_FFLAGS
+            | ARCHIVE_READDISK_NO_SPARSE) != ARCHIVE_OK
+        || archive_read_disk_open(disk, source_dir) != ARCHIVE_OK)
+    {
+        archive_read_free(disk);
+        return -2;
+    }
+
+    *out_disk = disk;
+    return 0;
+}
+
+static int read_next_entry(
+    struct archive *disk, struct archive_entry *entry, const char *source_dir
+)
+{
+    int status = archive_read_next_header2(disk, entry);
+    if (status == ARCHIVE_EOF)
+    {
+        return 1;
+    }
+    if (status < ARCHIVE_WARN)
+    {
+        LOG_ERROR("Failed to read %s: %s", source_dir, archive_error_string(disk));
+        return -3;
+    }
+
+    // Descend into directories on the same filesystem.
+    if (archive_read_disk_can_descend(disk))
+    {
+        archive_read_disk_descend(disk);
+    }
+
+    // Store the path relative to the tree root, like `tar -C dir .`.
+    char relative_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(
+        relative_path, sizeof(relative_path), ".%s",
+        archive_entry_pathname(entry) + strlen(source_dir)
+    );
+    archive_entry_set_pathname(entry, relative_path);
+
+    return 0;
+}
+
+static int open_output(
+    ArchiveOutput *output, const char *output_path, const char *compressor
+)
+{
+    // Create the output file and start hashing.
+    output->size = 0;
+    output->writer = NULL;
+    output->resolver = NULL;
+    output->fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (output->fd < 0)
+    {
+        return -1;
+    }
+    if (init_fingerprint(&output->hash) != 0)
+    {
+        close(output->fd);
+        return -1;
+    }
+
+    // Write GNU tar through the external compressor into the output file,
+    // without padding the compressed stream to a full block.
+    output->writer = archive_write_new();
+    output->resolver = archive_entry_linkresolver_new();
+    if (!output->writer || !output->resolver
+        || archive_write_set_format_gnutar(output->writer) != ARCHIVE_OK
+        || archive_write_set_bytes_in_last_block(output->writer, 1) != ARCHIVE_OK
+        || archive_write_add_filter_program(output->writer, compressor) != ARCHIVE_OK
+        || archive_write_open(output->writer, output, NULL, write_output, NULL) != ARCHIVE_OK)
+    {
+        LOG_ERROR("Failed to set up archive: %s",
+            output->writer ? archive_error_string(output->writer) : "out of memory");
+        return -2;
+    }
+    archive_entry_linkresolver_set_strategy(output->resolver, archive_format(output->writer));
+
+    return 0;
+}
+
+static int close_output(
+    ArchiveOutput *output, int result, char *out_sha256, size_t out_size
+)
+{
+    // Flush the compressor and the last blocks.
+    if (output->writer && archive_write_close(output->writer) != ARCHIVE_OK && result == 0)
+    {
+        LOG_ERROR("Failed to finalize archive: %s", archive_error_string(output->writer));
+        result = -5;
+    }
+    archive_write_free(output->writer);
+    archive_entry_linkresolver_free(output->resolver);
+
+    if (close(output->fd) != 0 && result == 0)
+    {
+        result = -5;
+    }
+
+    // Produce the hash of the compressed output.
+    if (result != 0)
+    {
+        discard_fingerprint(&output->hash);
+        return result;
+    }
+    if (finish_fingerprint(&output->hash, out_sha256, out_size) != 0)
+    {
+        return -5;
+    }
+
+    return 0;
+}
+
+static int copy_entry_data(struct archive *disk, struct archive *writer)
+{
+    char buffer[ARCHIVER_COPY_BUFFER_SIZE];
+    la_ssize_t bytes;
+
+    while ((bytes = archive_read_data(disk, buffer, sizeof(buffer))) > 0)
+    {
+        if (archive_write_data(writer, buffer, (size_t)bytes) != bytes)
+        {
+            return -4;
+        }
+    }
+
+    return bytes < 0 ? -3 : 0;
+}
+
+static int write_entry(
+    ArchiveOutput *output, struct archive *disk, struct archive_entry *entry
+)
+{
+    // Turn repeated inodes into hardlink entries without data.
+    struct archive_entry *spare = NULL;
+    struct archive_entry *linked = entry;
+    archive_entry_linkify(output->resolver, &linked, &spare);
+    archive_entry_free(spare);
+    if (!linked)
+    {
+        return 0;
+    }
+
+    // Write the header and, for regular files, the contents.
+    const char *path = archive_entry_pathname(linked);
+    if (archive_write_header(output->writer, linked) < ARCHIVE_WARN)
+    {
+        LOG_ERROR("Failed to write %s: %s", path, archive_error_string(output->writer));
+        return -4;
+    }
+    if (archive_entry_filetype(linked) == AE_IFREG && archive_entry_size(linked) > 0)
+    {
+        int result = copy_entry_data(disk, output->writer);
+        if (result != 0)
+        {
+            LOG_ERROR("Failed to archive %s", path);
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+int write_tar_archive(
+    const char *source_dir, const char *output_path, const char *compressor,
+    char *out_sha256, size_t out_size
+)
+{
+    struct archive *disk;
+    if (open_tree_reader(source_dir, &disk) != 0)
+    {
+        return -2;
+    }
+
+    ArchiveOutput output;
+    int result = open_output(&output, output_path, compressor);
+    if (result == -1)
+    {
+        archive_read_free(disk);
+        return -1;
+    }
+
+    // Stream the tree into the archive.
+    struct archive_entry *entry = archive_entry_new();
+    if (result == 0 && !entry)
+    {
+        result = -2;
+    }
+    while (result == 0)
+    {
+        int status = read_next_entry(disk, entry, source_dir);
+        if (status == 1)
+        {
+            break;
+        }
+        result = status == 0 ? write_entry(&output, disk, entry) : status;
+    }
+    archive_entry_free(entry);
+    archive_read_free(disk);
+
+    return close_output(&output, result, out_sha256, out_size);
+}
+
+static void write_index_path(FILE *index, const char *path)
+{
+    // Escape the characters that delimit index fields and lines.
+    for (const char *c = path; *c; c++)
+    {
+        if (*c == '\\')
+        {
+            fputs("\\\\", index);
+        }
+        else if (*c == '\t')
+        {
+            fputs("\\t", index);
+        }
+        else if (*c == '\n')
+        {
+            fputs("\\n", index);
+        }
+        else
+        {
+            fputc(*c, index);
+        }
+    }
+}
+
+static int is_chunk_name(const char *name)
+{
+    // Chunks sit next to their index, so a name is never a path.
+    return name[0] != '\0' && name[0] != '.' && !strchr(name, '/') && !strchr(name, '\\');
+}
+
+int write_chunked_tar_archive(
+    const char *source_dir, const char *output_dir, const char *name,
+    const char *extension, const char *compressor, off_t chunk_size
+)
+{
+    // Create the index that maps chunks to their hashes and files.
+    char index_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(index_path, sizeof(index_path), "%s/%s" ARCHIVER_INDEX_EXTENSION, output_dir, name);
+    FILE *index = fopen(index_path, "w");
+    if (!index)
+    {
+        return -1;
+    }
+
+    struct archive *disk;
+    if (open_tree_reader(source_dir, &disk) != 0)
+    {
+        fclose(index);
+        return -2;
+    }
+    struct archive_entry *entry = archive_entry_new();
+    int result = entry ? 0 : -2;
+
+    ArchiveOutput output;
+    char chunk_name[COMMON_MAX_PATH_LENGTH];
+    char chunk_path[COMMON_MAX_PATH_LENGTH];
+    char sha256[COMMON_SHA256_HEX_LENGTH];
+    int chunk = -1;
+    int chunk_count = 0;
+    off_t chunk_content = 0;
+
+    while (result == 0)
+    {
+        int status = read_next_entry(disk, entry, source_dir);
+        if (status != 0)
+        {
+            result = status == 1 ? 0 : status;
+            break;
+        }
+
+        // Close the current chunk once it holds enough file content.
+        if (chunk >= 0 && chunk_content >= chunk_size)
+        {
+            result = close_output(&output, 0, sha256, sizeof(sha256));
+            if (result != 0)
+            {
+                chunk = -1;
+                break;
+            }
+            fprintf(index, "chunk\t%s\t%lld\t%s\n", chunk_name, (long long)output.size, sha256);
+            chunk = -1;
+        }
+
+        // Start a new chunk, which can be extracted independently.
+        if (chunk < 0)
+        {
+            chunk = chunk_count++;
+            snprintf(chunk_name, sizeof(chunk_name), "%s.%03d%s", name, chunk, extension);
+            snprintf(chunk_path, sizeof(chunk_path), "%s/%s", output_dir, chunk_name);
+            chunk_content = 0;
+            result = open_output(&output, chunk_path, compressor);
+            if (result == -1)
+            {
+                chunk = -1;
+                break;
+            }
+        }
+
+        // Record which chunk holds the entry and write it there.
+        fprintf(index, "file\t%d\t", chunk);
+        write_index_path(index, archive_entry_pathname(entry));
+        fputc('\n', index);
+        if (archive_entry_filetype(entry) == AE_IFREG)
+        {
+            chunk_content += archive_entry_size(entry);
+        }
+        if (result == 0)
+        {
+            result = write_entry(&output, disk, entry);
+        }
+    }
+    archive_entry_free(entry);
+    archive_read_free(disk);
+
+    // Finish the last chunk.
+    if (chunk >= 0)
+    {
+        result = close_output(&output, result, sha256, sizeof(sha256));
+        if (result == 0)
+        {
+            fprintf(index, "chunk\t%s\t%lld\t%s\n", chunk_name, (long long)output.size, sha256);
+        }
+    }
+
+    if (fclose(index) != 0 && result == 0)
+    {
+        result = -5;
+    }
+
+    return result;
+}
+
+int read_archive_chunk_list(const char *index_path, ArchiveChunkList *out_list)
+{
+    out_list->names = NULL;
+    out_list->count = 0;
+
+    FILE *index = fopen(index_path, "r");
+    if (!index)
+    {
+        return -1;
+    }
+
+    // Keep the name field of every chunk line.
+    int result = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    while (result == 0 && getline(&line, &line_size, index) >= 0)
+    {
+        if (strncmp(line, "chunk\t", 6) != 0)
+        {
+            continue;
+        }
+        char *name = line + 6;
+        name[strcspn(name, "\t\n")] = '\0';
+        if (!is_chunk_name(name))
+        {
+            result = -3;
+            break;
+        }
+
+        char **names = realloc(out_list->names, (out_list->count + 1) * sizeof(*names));
+        if (!names)
+        {
+            result = -2;
+            break;
+        }
+        out_list->names = names;
+        out_list->names[out_list->count] = strdup(name);
+        if (!out_list->names[out_list->count])
+        {
+            result = -2;
+            break;
+        }
+        out_list->count++;
+    }
+    if (result == 0 && ferror(index))
+    {
+        result = -1;
+    }
+    free(line);
+    fclose(index);
+
+    if (result != 0)
+    {
+        free_archive_chunk_list(out_list);
+    }
+
+    return result;
+}
+
+void free_archive_chunk_list(ArchiveChunkList *list)
+{
+    for (int i = 0; i < list->count; i++)
+    {
+        free(list->names[i]);
+    }
+    free(list->names);
+    list->names = NULL;
+    list->count = 0;
+}
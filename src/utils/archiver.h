@@ -0,0 +1,93 @@
+#pragma once
+#include "../all.h"
+
+/** The extension of the index written next to chunked archives. */
+#define ARCHIVER_INDEX_EXTENSION ".index"
+
+/** A type representing the chunk file names listed in a chunk index. */
+typedef struct
+{
+    char **names;
+    int count;
+} ArchiveChunkList;
+
+/**
+ * Archives a directory tree into a compressed tarball in a single pass.
+ *
+ * Walks the tree with libarchive and streams it through the compressor
+ * straight into the output file, hashing the compressed bytes as they are
+ * written. Entries are stored relative to the tree root (`./etc/...`) with
+ * numeric ownership only, hardlinks are preserved, and mount points below
+ * the root are not crossed.
+ *
+ * @param source_dir The directory to archive.
+ * @param output_path The path of the compressed tarball to create.
+ * @param compressor The compressor command line to filter through.
+ * @param out_sha256 The buffer receiving the hex SHA-256 of the tarball.
+ * @param out_size The size of the hash buffer.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates output file creation failure.
+ * @return - `-2` - Indicates archive setup failure.
+ * @return - `-3` - Indicates source tree read failure.
+ * @return - `-4` - Indicates archive write failure.
+ * @return - `-5` - Indicates archive finalization failure.
+ */
+int write_tar_archive(
+    const char *source_dir, const char *output_path, const char *compressor,
+    char *out_sha256, size_t out_size
+);
+
+/**
+ * Archives a directory tree into independently compressed tarball chunks.
+ *
+ * Walks the tree once like write_tar_archive(), starting a new chunk once
+ * the current one holds `chunk_size` bytes of file contents. Chunks are
+ * named `<name>.NNN<extension>` and can be extracted in any order and in
+ * parallel. An index named `<name>.index` lists, as tab-separated lines,
+ * every chunk (`chunk`, file name, compressed size, SHA-256) after its
+ * files (`file`, chunk number, path). Backslashes, tabs, and newlines in
+ * paths are escaped C-style (`\\`, `\t`, `\n`), so every line stays one
+ * record. Hardlinks are only preserved within a chunk; across chunks the
+ * contents are stored again.
+ *
+ * @param source_dir The directory to archive.
+ * @param output_dir The directory to write the chunks and index to.
+ * @param name The base name of the chunks and index.
+ * @param extension The chunk extension (e.g. ".tar.zst").
+ * @param compressor The compressor command line to filter through.
+ * @param chunk_size The uncompressed file content per chunk in bytes.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates output file creation failure.
+ * @return - `-2` - Indicates archive setup failure.
+ * @return - `-3` - Indicates source tree read failure.
+ * @return - `-4` - Indicates archive write failure.
+ * @return - `-5` - Indicates archive finalization failure.
+ */
+int write_chunked_tar_archive(
+    const char *source_dir, const char *output_dir, const char *name,
+    const char *extension, const char *compressor, off_t chunk_size
+);
+
+/**
+ * Reads the chunk file names listed in a chunk index.
+ *
+ * @param index_path The path of the index written by
+ * write_chunked_tar_archive().
+ * @param out_list The list receiving the chunk names, in chunk order. Free it
+ * with free_archive_chunk_list().
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates index read failure.
+ * @return - `-2` - Indicates memory allocation failure.
+ * @return - `-3` - Indicates a chunk name that is not a plain file name.
+ */
+int read_archive_chunk_list(const char *index_path, ArchiveChunkList *out_list);
+
+/**
+ * Frees the chunk names read by read_archive_chunk_list().
+ *
+ * @param list The list to free.
+ */
+void free_archive_chunk_list(ArchiveChunkList *list);
@@ -0,0 +1,213 @@
+/**
+ * This code is responsible for caching compressed squashfs data blocks
+ * across builds, keyed by their uncompressed contents.
+ */
+
+#include "all.h"
+
+/** A type representing a compressor that consults the block cache first. */
+typedef struct
+{
+    sqfs_compressor_t base;
+    sqfs_compressor_t *inner;
+    sqfs_compressor_config_t config;
+    const char *cache_dir;
+    BlockCacheStats *stats;
+} CachedCompressor;
+
+static sqfs_compressor_t *wrap_compressor(
+    sqfs_compressor_t *inner, const char *cache_dir, BlockCacheStats *stats
+);
+
+static int get_block_path(
+    CachedCompressor *self, const sqfs_u8 *block, sqfs_u32 size,
+    char *out_path, size_t out_size
+)
+{
+    // Hash the compressor configuration together with the block, so blocks
+    // compressed with other settings are never reused.
+    Fingerprint fingerprint;
+    char sha256[COMMON_SHA256_HEX_LENGTH];
+    if (init_fingerprint(&fingerprint) != 0)
+    {
+        return -1;
+    }
+    if (add_fingerprint_bytes(&fingerprint, &self->config, sizeof(self->config)) != 0
+        || add_fingerprint_bytes(&fingerprint, block, size) != 0)
+    {
+        discard_fingerprint(&fingerprint);
+        return -1;
+    }
+    if (finish_fingerprint(&fingerprint, sha256, sizeof(sha256)) != 0)
+    {
+        return -1;
+    }
+
+    // Spread blocks over subdirectories named after the first hash byte.
+    snprintf(out_path, out_size, "%s/%.2s/%s", self->cache_dir, sha256, sha256 + 2);
+
+    return 0;
+}
+
+static sqfs_s32 read_cached_block(const char *path, sqfs_u8 *out, sqfs_u32 out_size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    // Treat entries that would not fit as missing.
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size > (off_t)out_size)
+    {
+        close(fd);
+        return -1;
+    }
+
+    // Read the whole entry, retrying short reads.
+    size_t done = 0;
+    while (done < (size_t)st.st_size)
+    {
+        ssize_t result = read(fd, out + done, (size_t)st.st_size - done);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            close(fd);
+            return -1;
+        }
+        done += (size_t)result;
+    }
+    close(fd);
+
+    return (sqfs_s32)done;
+}
+
+static void store_cached_block(const char *path, const sqfs_u8 *data, sqfs_u32 size)
+{
+    // Create the subdirectory on first use.
+    char directory[COMMON_MAX_PATH_LENGTH];
+    snprintf(directory, sizeof(directory), "%s", path);
+    *strrchr(directory, '/') = '\0';
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST)
+    {
+        return;
+    }
+
+    store_cache_data(path, data, size);
+}
+
+static sqfs_s32 compress_block(
+    sqfs_compressor_t *base, const sqfs_u8 *in, sqfs_u32 size,
+    sqfs_u8 *out, sqfs_u32 out_size
+)
+{
+    CachedCompressor *self = (CachedCompressor *)base;
+    __atomic_fetch_add(&self->stats->blocks, 1, __ATOMIC_RELAXED);
+
+    // Reuse the compressed block when it is cached. An empty entry records
+    // a block the compressor could not shrink.
+    char path[COMMON_MAX_PATH_LENGTH];
+    int has_path = get_block_path(self, in, size, path, sizeof(path)) == 0;
+    if (has_path)
+    {
+        sqfs_s32 cached = read_cached_block(path, out, out_size);
+        if (cached >= 0)
+        {
+            touch_cache_entry(path);
+            __atomic_fetch_add(&self->stats->hits, 1, __ATOMIC_RELAXED);
+            return cached;
+        }
+    }
+
+    // Compress the block and store the result for later builds.
+    sqfs_s32 result = self->inner->do_block(self->inner, in, size, out, out_size);
+    if (result >= 0 && has_path)
+    {
+        store_cached_block(path, out, (sqfs_u32)result);
+    }
+
+    return result;
+}
+
+static void get_configuration(const sqfs_compressor_t *base, sqfs_compressor_config_t *config)
+{
+    const CachedCompressor *self = (const CachedCompressor *)base;
+    self->inner->get_configuration(self->inner, config);
+}
+
+static int write_options(sqfs_compressor_t *base, sqfs_file_t *file)
+{
+    CachedCompressor *self = (CachedCompressor *)base;
+    return self->inner->write_options(self->inner, file);
+}
+
+static int read_options(sqfs_compressor_t *base, sqfs_file_t *file)
+{
+    CachedCompressor *self = (CachedCompressor *)base;
+    return self->inner->read_options(self->inner, file);
+}
+
+static sqfs_object_t *copy_compressor(const sqfs_object_t *base)
+{
+    const CachedCompressor *self = (const CachedCompressor *)base;
+
+    // Give each worker its own copy of the wrapped compressor.
+    sqfs_compressor_t *inner = sqfs_copy(self->inner);
+    if (!inner)
+    {
+        return NULL;
+    }
+
+    return (sqfs_object_t *)wrap_compressor(inner, self->cache_dir, self->stats);
+}
+
+static void destroy_compressor(sqfs_object_t *base)
+{
+    CachedCompressor *self = (CachedCompressor *)base;
+    sqfs_destroy(self->inner);
+    free(self);
+}
+
+static sqfs_compressor_t *wrap_compressor(
+    sqfs_compressor_t *inner, const char *cache_dir, BlockCacheStats *stats
+)
+{
+    CachedCompressor *self = calloc(1, sizeof(*self));
+    if (!self)
+    {
+        sqfs_destroy(inner);
+        return NULL;
+    }
+
+    self->inner = inner;
+    self->cache_dir = cache_dir;
+    self->stats = stats;
+    inner->get_configuration(inner, &self->config);
+
+    self->base.base.destroy = destroy_compressor;
+    self->base.base.copy = copy_compressor;
+    self->base.get_configuration = get_configuration;
+    self->base.write_options = write_options;
+    self->base.read_options = read_options;
+    self->base.do_block = compress_block;
+
+    return &self->base;
+}
+
+int create_block_cache_compressor(
+    sqfs_compressor_t *inner, const char *cache_dir, BlockCacheStats *stats,
+    sqfs_compressor_t **out_compressor
+)
+{
+    *out_compressor = wrap_compressor(inner, cache_dir, stats);
+    if (!*out_compressor)
+    {
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "../all.h"
+
+/** A type representing how often a block cache was consulted and hit. */
+typedef struct
+{
+    unsigned long blocks;
+    unsigned long hits;
+} BlockCacheStats;
+
+/**
+ * Wraps a squashfs compressor with an on-disk cache of compressed blocks.
+ *
+ * Each block is looked up by the SHA-256 of the compressor configuration and
+ * the uncompressed bytes. On a hit, the stored compressed bytes are returned
+ * verbatim; on a miss, the wrapped compressor runs and its output is stored.
+ * Blocks the compressor could not shrink are remembered as well, so they are
+ * not compressed again either. Hits mark the entry as used, so the blocks of
+ * recent builds survive prune_cache().
+ *
+ * The wrapper can be copied for worker threads; copies share the cache and
+ * the statistics. The wrapped compressor is owned by the wrapper afterwards,
+ * even on failure.
+ *
+ * @param inner The compressor to wrap.
+ * @param cache_dir The directory holding cached blocks.
+ * @param stats The statistics to update, which must outlive the wrapper.
+ * @param out_compressor The pointer receiving the wrapper.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates allocation failure.
+ */
+int create_block_cache_compressor(
+    sqfs_compressor_t *inner, const char *cache_dir, BlockCacheStats *stats,
+    sqfs_compressor_t **out_compressor
+);
@@ -0,0 +1,186 @@
+/**
+ * This code is responsible for tracing file accesses during live boot and
+ * turning the trace into a squashfs file order.
+ */
+
+#define _GNU_SOURCE
+#include "all.h"
+
+/** The name of the boot trace service unit. */
+#define BOOT_TRACE_SERVICE_NAME "limeos-boot-trace.service"
+
+/** The highest mksquashfs sort priority, given to the first file read. */
+#define BOOT_TRACE_MAX_PRIORITY 32767
+
+/** Directories whose accesses are not backed by the squashfs. */
+static const char *const BOOT_TRACE_SKIPPED_PREFIXES[] = {
+    "/dev/", "/proc/", "/sys/", "/run/", "/tmp/"
+};
+
+/** The number of skipped directory prefixes. */
+#define BOOT_TRACE_SKIPPED_PREFIXES_COUNT \
+    (int)(sizeof(BOOT_TRACE_SKIPPED_PREFIXES) / sizeof(BOOT_TRACE_SKIPPED_PREFIXES[0]))
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+static const char *parse_trace_path(char *line)
+{
+    // Lines look like "[time ]process(pid): TYPES /path".
+    char *path = strstr(line, "): ");
+    if (!path)
+    {
+        return NULL;
+    }
+    path = strchr(path + 3, ' ');
+    if (!path || path[1] != '/')
+    {
+        return NULL;
+    }
+    path++;
+    path[strcspn(path, "\n")] = '\0';
+
+    // Map reads of the lower squashfs mount back to the squashfs root.
+    size_t prefix_length = strlen(BOOT_TRACE_ROOTFS_PREFIX);
+    if (strncmp(path, BOOT_TRACE_ROOTFS_PREFIX, prefix_length) == 0
+        && path[prefix_length] == '/')
+    {
+        path += prefix_length;
+    }
+
+    // Skip paths mksquashfs cannot parse from a sort file.
+    if (strpbrk(path, " \t"))
+    {
+        return NULL;
+    }
+
+    // Skip files that do not come from the squashfs.
+    for (int i = 0; i < BOOT_TRACE_SKIPPED_PREFIXES_COUNT; i++)
+    {
+        if (strncmp(path, BOOT_TRACE_SKIPPED_PREFIXES[i], strlen(BOOT_TRACE_SKIPPED_PREFIXES[i])) == 0)
+        {
+            return NULL;
+        }
+    }
+
+    return path;
+}
+
+int enable_boot_trace(const char *rootfs_path)
+{
+    char path[COMMON_MAX_PATH_LENGTH];
+
+    // Create the sysinit wants directory.
+    snprintf(path, sizeof(path), "%s/etc/systemd/system/sysinit.target.wants", rootfs_path);
+    if (common.mkdir_p(path) != 0)
+    {
+        return -1;
+    }
+
+    // Start tracing as early as systemd allows, for a fixed time.
+    char service_content[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        service_content, sizeof(service_content),
+        "[Unit]\n"
+        "Description=LimeOS boot file access trace\n"
+        "DefaultDependencies=no\n"
+        "Before=sysinit.target\n"
+        "\n"
+        "[Service]\n"
+        "Type=simple\n"
+        "ExecStart=/usr/sbin/fatrace --timestamp --filter=OR --seconds=%d --output=" BOOT_TRACE_LOG_PATH "\n"
+        "\n"
+        "[Install]\n"
+        "WantedBy=sysinit.target\n",
+        CONFIG_BOOT_TRACE_SECONDS
+    );
+    snprintf(path, sizeof(path), "%s/etc/systemd/system/" BOOT_TRACE_SERVICE_NAME, rootfs_path);
+    if (common.write_file(path, service_content) != 0)
+    {
+        return -2;
+    }
+
+    // Enable the service.
+    snprintf(
+        path, sizeof(path),
+        "%s/etc/systemd/system/sysinit.target.wants/" BOOT_TRACE_SERVICE_NAME,
+        rootfs_path
+    );
+    if (common.symlink_file("../" BOOT_TRACE_SERVICE_NAME, path) != 0)
+    {
+        return -3;
+    }
+
+    return 0;
+}
+
+int convert_boot_trace(const char *trace_path, const char *sort_path)
+{
+    FILE *trace = fopen(trace_path, "r");
+    if (!trace)
+    {
+        return -1;
+    }
+    FILE *sort = fopen(sort_path, "w");
+    if (!sort)
+    {
+        fclose(trace);
+        return -2;
+    }
+
+    // Give each path a priority by its first access, highest first.
+    void *seen = NULL;
+    int priority = BOOT_TRACE_MAX_PRIORITY;
+    int count = 0;
+    int result = 0;
+    char line[COMMON_MAX_PATH_LENGTH + 128];
+    while (result == 0 && fgets(line, sizeof(line), trace))
+    {
+        const char *path = parse_trace_path(line);
+        if (!path)
+        {
+            continue;
+        }
+
+        // Remember the path, skipping repeated accesses.
+        char *copy = strdup(path);
+        void *node = copy ? tsearch(copy, &seen, compare_paths) : NULL;
+        if (!node)
+        {
+            free(copy);
+            result = -1;
+            break;
+        }
+        if (*(char **)node != copy)
+        {
+            free(copy);
+            continue;
+        }
+
+        // Sort file paths are relative to the squashfs root.
+        if (fprintf(sort, "%s %d\n", path + 1, priority) < 0)
+        {
+            result = -2;
+        }
+        if (priority > 1)
+        {
+            priority--;
+        }
+        count++;
+    }
+    tdestroy(seen, free);
+    fclose(trace);
+
+    if (fclose(sort) != 0 && result == 0)
+    {
+        result = -2;
+    }
+    if (result == 0)
+    {
+        LOG_INFO("Converted boot trace with %d files into squashfs sort order", count);
+    }
+
+    return result;
+}
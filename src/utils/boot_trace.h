@@ -0,0 +1,47 @@
+#pragma once
+#include "../all.h"
+
+/** The package providing the fanotify-based file access tracer. */
+#define BOOT_TRACE_PACKAGE "fatrace"
+
+/** The path of the boot trace log inside the booted live system. */
+#define BOOT_TRACE_LOG_PATH "/run/limeos-boot-trace.log"
+
+/** The live-boot mount point of the squashfs inside the booted system. */
+#define BOOT_TRACE_ROOTFS_PREFIX "/run/live/rootfs/filesystem.squashfs"
+
+/**
+ * Enables a service that traces file accesses while the live system boots.
+ *
+ * The service starts before sysinit.target and runs `fatrace` for
+ * CONFIG_BOOT_TRACE_SECONDS, logging every open and read to
+ * BOOT_TRACE_LOG_PATH. The log can then be copied out of the booted image
+ * (e.g. from a QEMU run) and passed back with `--squashfs-sort`.
+ *
+ * @param rootfs_path The path to the live rootfs, with fatrace installed.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates directory creation failure.
+ * @return - `-2` - Indicates service file write failure.
+ * @return - `-3` - Indicates service enablement failure.
+ */
+int enable_boot_trace(const char *rootfs_path);
+
+/**
+ * Converts a boot trace log into a mksquashfs sort file.
+ *
+ * Each path gets a priority by its first access, highest first, so that
+ * mksquashfs lays out the files read during boot sequentially and in the
+ * order they are read. Reads overlayfs reports on the lower squashfs
+ * mount under BOOT_TRACE_ROOTFS_PREFIX count as reads of the same path
+ * from the root. Accesses to virtual and runtime filesystems and paths
+ * mksquashfs cannot parse are skipped.
+ *
+ * @param trace_path The path to the fatrace log.
+ * @param sort_path The path of the sort file to write.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates trace read failure.
+ * @return - `-2` - Indicates sort file write failure.
+ */
+int convert_boot_trace(const char *trace_path, const char *sort_path);
@@ -1,9 +1,8 @@
 /**
  * Configures the Plymouth boot splash screen.
  *
- * Creates theme files, sets the default theme, and regenerates initramfs
- * to embed the theme. The updated initrd is copied to the generic name
- * so the bootloader can find it.
+ * Creates theme files and sets the default theme. The initramfs that embeds
+ * the theme is generated once by run_deferred_triggers().
  */
 
 #include "../../all.h"
@@ -109,31 +108,5 @@ int configure_plymouth(const char *rootfs_path, const char *logo_path)
         LOG_WARNING("Failed to set Plymouth theme (plymouth may not be installed)");
     }
 
-    // Regenerate initramfs to embed the Plymouth theme.
-    if (common.run_chroot_indented(rootfs_path, "update-initramfs -u") != 0)
-    {
-        LOG_WARNING("Failed to regenerate initramfs");
-    }
-
-    // Copy the updated versioned initrd to the generic name.
-    // The live bootloader loads /boot/initrd.img directly.
-    // For target, this overwrites the symlink but content is identical.
-    char initrd_pattern[COMMON_MAX_PATH_LENGTH];
-    char initrd_src[COMMON_MAX_PATH_LENGTH];
-    char initrd_dst[COMMON_MAX_PATH_LENGTH];
-    snprintf(
-        initrd_pattern, sizeof(initrd_pattern),
-        "%s/boot/initrd.img-*",
-        rootfs_path
-    );
-    if (common.find_first_glob(initrd_pattern, initrd_src, sizeof(initrd_src)) == 0)
-    {
-        snprintf(initrd_dst, sizeof(initrd_dst), "%s/boot/initrd.img", rootfs_path);
-        if (common.copy_file(initrd_src, initrd_dst) != 0)
-        {
-            LOG_WARNING("Failed to copy updated initrd");
-        }
-    }
-
     return 0;
 }
@@ -3,8 +3,9 @@
 /**
  * Configures Plymouth boot splash for a rootfs.
  *
- * Creates the LimeOS Plymouth theme, sets it as default, and
- * regenerates the initramfs to include it.
+ * Creates the LimeOS Plymouth theme and sets it as default. The initramfs
+ * is not regenerated here; run_deferred_triggers() embeds the theme once
+ * all configuration is in place.
  *
  * @param rootfs_path The path to the rootfs directory.
  * @param logo_path The path to the splash logo PNG file.
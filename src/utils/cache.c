@@ -0,0 +1,232 @@
+/**
+ * This code is responsible for storing entries in the persistent build
+ * caches atomically and keeping the caches within their size limits.
+ */
+
+#include "all.h"
+
+/** A type representing a cache entry considered for pruning. */
+typedef struct
+{
+    char *path;
+    off_t size;
+    struct timespec used;
+} CacheEntry;
+
+/** A type representing the entries of a cache. */
+typedef struct
+{
+    CacheEntry *entries;
+    int count;
+    int capacity;
+    long long total_size;
+} CacheEntryList;
+
+/** A counter making temporary names unique across worker threads. */
+static unsigned long temp_counter = 0;
+
+static void get_temp_path(const char *cache_path, char *out_path, size_t out_size)
+{
+    snprintf(
+        out_path, out_size, "%s" CACHE_TEMP_MARKER "%d-%lu", cache_path, getpid(),
+        __atomic_fetch_add(&temp_counter, 1, __ATOMIC_RELAXED)
+    );
+}
+
+static int commit_temp_file(int result, const char *temp_path, const char *cache_path)
+{
+    // Move the complete entry into place, or drop what was written.
+    if (result == 0 && rename(temp_path, cache_path) != 0)
+    {
+        result = -1;
+    }
+    if (result != 0)
+    {
+        unlink(temp_path);
+    }
+
+    return result;
+}
+
+int store_cache_file(const char *src_path, const char *cache_path, int share)
+{
+    char temp_path[COMMON_MAX_PATH_LENGTH];
+    get_temp_path(cache_path, temp_path, sizeof(temp_path));
+
+    // Share the file when both paths are on the same filesystem.
+    int result = share && link(src_path, temp_path) == 0
+        ? 0
+        : common.copy_file(src_path, temp_path);
+
+    return commit_temp_file(result == 0 ? 0 : -1, temp_path, cache_path);
+}
+
+int store_cache_data(const char *cache_path, const void *data, size_t size)
+{
+    char temp_path[COMMON_MAX_PATH_LENGTH];
+    get_temp_path(cache_path, temp_path, sizeof(temp_path));
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    // Write the whole buffer, retrying short writes.
+    const unsigned char *bytes = data;
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t result = write(fd, bytes + done, size - done);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            break;
+        }
+        done += (size_t)result;
+    }
+
+    int result = close(fd) == 0 && done == size ? 0 : -1;
+    return commit_temp_file(result, temp_path, cache_path);
+}
+
+void touch_cache_entry(const char *cache_path)
+{
+    utimensat(AT_FDCWD, cache_path, NULL, 0);
+}
+
+static int has_suffix(const char *name, const char *suffix)
+{
+    size_t name_length = strlen(name);
+    size_t suffix_length = strlen(suffix);
+    return name_length >= suffix_length
+        && strcmp(name + name_length - suffix_length, suffix) == 0;
+}
+
+static int add_cache_entry(CacheEntryList *list, const char *path, const struct stat *st)
+{
+    if (list->count == list->capacity)
+    {
+        int capacity = list->capacity ? list->capacity * 2 : 256;
+        CacheEntry *entries = realloc(list->entries, capacity * sizeof(*entries));
+        if (!entries)
+        {
+            return -1;
+        }
+        list->entries = entries;
+        list->capacity = capacity;
+    }
+
+    char *copy = strdup(path);
+    if (!copy)
+    {
+        return -1;
+    }
+    list->entries[list->count++] = (CacheEntry){ copy, st->st_size, st->st_mtim };
+    list->total_size += st->st_size;
+
+    return 0;
+}
+
+static int collect_cache_entries(
+    const char *dir_path, const char *suffix, int nested, CacheEntryList *list
+)
+{
+    DIR *dir = opendir(dir_path);
+    if (!dir)
+    {
+        return -1;
+    }
+
+    int result = 0;
+    struct dirent *dirent;
+    while (result == 0 && (dirent = readdir(dir)) != NULL)
+    {
+        if (strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        char path[COMMON_MAX_PATH_LENGTH];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir_path, dirent->d_name);
+        if (lstat(path, &st) != 0)
+        {
+            continue;
+        }
+
+        // Descend one level into the subdirectories entries are spread over.
+        if (S_ISDIR(st.st_mode))
+        {
+            if (nested)
+            {
+                result = collect_cache_entries(path, suffix, 0, list);
+            }
+            continue;
+        }
+
+        // Count complete entries only.
+        if (!S_ISREG(st.st_mode) || strstr(dirent->d_name, CACHE_TEMP_MARKER)
+            || (suffix && !has_suffix(dirent->d_name, suffix)))
+        {
+            continue;
+        }
+        result = add_cache_entry(list, path, &st);
+    }
+    closedir(dir);
+
+    return result;
+}
+
+static int compare_entry_use(const void *a, const void *b)
+{
+    const CacheEntry *left = a;
+    const CacheEntry *right = b;
+    if (left->used.tv_sec != right->used.tv_sec)
+    {
+        return left->used.tv_sec < right->used.tv_sec ? -1 : 1;
+    }
+    if (left->used.tv_nsec != right->used.tv_nsec)
+    {
+        return left->used.tv_nsec < right->used.tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+int prune_cache(const char *cache_dir, const char *suffix, int nested, long max_mib)
+{
+    CacheEntryList list = { 0 };
+    int result = collect_cache_entries(cache_dir, suffix, nested, &list);
+
+    // Remove the least recently used entries until the rest fit.
+    long long max_size = (long long)max_mib * 1024 * 1024;
+    long long removed_size = 0;
+    int removed = 0;
+    if (result == 0 && list.total_size > max_size)
+    {
+        qsort(list.entries, list.count, sizeof(*list.entries), compare_entry_use);
+        for (int i = 0; i < list.count && list.total_size - removed_size > max_size; i++)
+        {
+            // Another build may have pruned the entry already.
+            if (unlink(list.entries[i].path) == 0 || errno == ENOENT)
+            {
+                removed_size += list.entries[i].size;
+                removed++;
+            }
+        }
+        LOG_INFO(
+            "Pruned %d cache entries (%.1f MiB) from %s", removed,
+            (double)removed_size / (1024.0 * 1024.0), cache_dir
+        );
+    }
+
+    for (int i = 0; i < list.count; i++)
+    {
+        free(list.entries[i].path);
+    }
+    free(list.entries);
+
+    return result;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "../all.h"
+
+/** The marker in the names of cache entries that are still being written. */
+#define CACHE_TEMP_MARKER ".tmp-"
+
+/**
+ * Stores a copy of a file in a cache.
+ *
+ * Entries are written under a temporary name next to the cache path and
+ * then renamed into place, so concurrent builds and worker threads never
+ * observe a partially written entry, and a failed write leaves none behind.
+ *
+ * @param src_path The file to store.
+ * @param cache_path The path of the cache entry.
+ * @param share Whether to hardlink the file instead of copying it when both
+ * paths are on the same filesystem. Only files that are never modified in
+ * place may be shared.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates copy or rename failure.
+ */
+int store_cache_file(const char *src_path, const char *cache_path, int share);
+
+/**
+ * Stores a buffer in a cache, the same way as store_cache_file().
+ *
+ * @param cache_path The path of the cache entry.
+ * @param data The bytes to store.
+ * @param size The number of bytes to store.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates write or rename failure.
+ */
+int store_cache_data(const char *cache_path, const void *data, size_t size);
+
+/**
+ * Marks a cache entry as just used.
+ *
+ * The modification time records the last use, since access times are not
+ * updated on most mounts. Failures are ignored; the entry then merely looks
+ * older to prune_cache().
+ *
+ * @param cache_path The path of the cache entry.
+ */
+void touch_cache_entry(const char *cache_path);
+
+/**
+ * Removes the least recently used entries of a cache above a size limit.
+ *
+ * Entries are the regular files of the cache directory that end with the
+ * suffix, or of its subdirectories when the cache spreads entries over them.
+ * Entries still being written are neither counted nor removed.
+ *
+ * @param cache_dir The cache directory.
+ * @param suffix The suffix of entry names, or NULL for any name.
+ * @param nested Whether entries are in subdirectories of the cache directory.
+ * @param max_mib The size the cache is pruned down to, in MiB.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates cache directory read or allocation failure.
+ */
+int prune_cache(const char *cache_dir, const char *suffix, int nested, long max_mib);
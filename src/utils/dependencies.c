@@ -17,12 +17,30 @@ const char *const REQUIRED_COMMANDS[] = {
     "debootstrap",
     "mksquashfs",
     "grub-mkrescue",
-    "tar",
+    "grub-mkimage",
+    "mkfs.vfat",
+    "mmd",
+    "mcopy",
+    "xorriso",
     "chroot"
 };
 const int REQUIRED_COMMANDS_COUNT =
     sizeof(REQUIRED_COMMANDS) / sizeof(REQUIRED_COMMANDS[0]);
 
+/** Commands that must be available in PATH to boot UEFI from a UKI. */
+const char *const UKI_REQUIRED_COMMANDS[] = {
+    "ukify"
+};
+const int UKI_REQUIRED_COMMANDS_COUNT =
+    sizeof(UKI_REQUIRED_COMMANDS) / sizeof(UKI_REQUIRED_COMMANDS[0]);
+
+/** Files that must exist on the host system to boot UEFI from a UKI. */
+const char *const UKI_REQUIRED_FILES[] = {
+    CONFIG_UKI_EFI_STUB_PATH
+};
+const int UKI_REQUIRED_FILES_COUNT =
+    sizeof(UKI_REQUIRED_FILES) / sizeof(UKI_REQUIRED_FILES[0]);
+
 int validate_dependencies(void)
 {
     int missing_files = 0;
@@ -60,3 +78,119 @@ int validate_dependencies(void)
     }
     return 0;
 }
+
+int validate_option_dependencies(void)
+{
+    int missing = 0;
+
+    // Check that the payload codec and format exist.
+    const PayloadCodec *codec = find_payload_codec(build_options.payload_codec);
+    if (!codec)
+    {
+        LOG_ERROR("Unknown payload codec: %s", build_options.payload_codec);
+        return -1;
+    }
+    const PayloadFormat *format = find_payload_format(build_options.payload_format);
+    if (!format)
+    {
+        LOG_ERROR("Unknown payload format: %s", build_options.payload_format);
+        return -1;
+    }
+    if (strcmp(build_options.payload_placement, "squashfs") != 0
+        && strcmp(build_options.payload_placement, "iso") != 0)
+    {
+        LOG_ERROR("Unknown payload placement: %s", build_options.payload_placement);
+        return -1;
+    }
+    if (!find_squashfs_profile(build_options.squashfs_profile))
+    {
+        LOG_ERROR("Unknown squashfs profile: %s", build_options.squashfs_profile);
+        return -1;
+    }
+    if (strcmp(build_options.squashfs_writer, "mksquashfs") != 0
+        && strcmp(build_options.squashfs_writer, "native") != 0)
+    {
+        LOG_ERROR("Unknown squashfs writer: %s", build_options.squashfs_writer);
+        return -1;
+    }
+    if (build_options.squashfs_sort && !common.file_exists(build_options.squashfs_sort))
+    {
+        LOG_ERROR("Boot trace not found: %s", build_options.squashfs_sort);
+        return -1;
+    }
+    if (!find_grub_profile(build_options.grub_profile))
+    {
+        LOG_ERROR("Unknown GRUB profile: %s", build_options.grub_profile);
+        return -1;
+    }
+    if (strcmp(build_options.efi_boot, "grub") != 0
+        && strcmp(build_options.efi_boot, "uki") != 0)
+    {
+        LOG_ERROR("Unknown EFI boot path: %s", build_options.efi_boot);
+        return -1;
+    }
+    if (strcmp(build_options.initramfs_modules, "list") != 0
+        && strcmp(build_options.initramfs_modules, "most") != 0)
+    {
+        LOG_ERROR("Unknown initramfs module policy: %s", build_options.initramfs_modules);
+        return -1;
+    }
+    if (!find_initramfs_codec(build_options.initramfs_codec))
+    {
+        LOG_ERROR("Unknown initramfs codec: %s", build_options.initramfs_codec);
+        return -1;
+    }
+    if (validate_initramfs_classes(CONFIG_LIVE_INITRAMFS_CLASSES) != 0
+        || validate_initramfs_classes(CONFIG_TARGET_INITRAMFS_CLASSES) != 0)
+    {
+        return -1;
+    }
+    if (strcmp(build_options.assembly_mode, "staging") != 0
+        && strcmp(build_options.assembly_mode, "graft") != 0
+        && strcmp(build_options.assembly_mode, "stream") != 0)
+    {
+        LOG_ERROR("Unknown assembly mode: %s", build_options.assembly_mode);
+        return -1;
+    }
+    if (strcmp(build_options.assembly_mode, "stream") == 0
+        && strcmp(build_options.squashfs_writer, "native") != 0)
+    {
+        LOG_ERROR("Streamed assembly needs the native squashfs writer");
+        return -1;
+    }
+
+    // Check that images can be built, or that tarballs can be compressed.
+    if (format->is_image && !common.is_command_available(format->command))
+    {
+        LOG_ERROR("Missing required command for payload format %s: %s", format->name, format->command);
+        missing = 1;
+    }
+    if (!format->is_image && !get_payload_compressor(codec))
+    {
+        LOG_ERROR("Missing required command for payload codec %s: %s", codec->name, codec->command);
+        missing = 1;
+    }
+
+    // Check that a unified kernel image and its EFI stub are available.
+    if (strcmp(build_options.efi_boot, "uki") == 0)
+    {
+        for (int i = 0; i < UKI_REQUIRED_COMMANDS_COUNT; i++)
+        {
+            if (!common.is_command_available(UKI_REQUIRED_COMMANDS[i]))
+            {
+                LOG_ERROR("Missing required command for UKI boot: %s", UKI_REQUIRED_COMMANDS[i]);
+                missing = 1;
+            }
+        }
+        for (int i = 0; i < UKI_REQUIRED_FILES_COUNT; i++)
+        {
+            if (!common.file_exists(UKI_REQUIRED_FILES[i]))
+            {
+                LOG_ERROR("Missing required file for UKI boot: %s", UKI_REQUIRED_FILES[i]);
+                missing = 1;
+            }
+        }
+    }
+
+    return missing ? -2 : 0;
+}
@@ -11,6 +11,16 @@ extern const char *const REQUIRED_COMMANDS[];
 /** Number of entries in REQUIRED_COMMANDS. */
 extern const int REQUIRED_COMMANDS_COUNT;
 
+/** Commands that must be available in PATH to boot UEFI from a UKI. */
+extern const char *const UKI_REQUIRED_COMMANDS[];
+/** Number of entries in UKI_REQUIRED_COMMANDS. */
+extern const int UKI_REQUIRED_COMMANDS_COUNT;
+
+/** Files that must exist on the host system to boot UEFI from a UKI. */
+extern const char *const UKI_REQUIRED_FILES[];
+/** Number of entries in UKI_REQUIRED_FILES. */
+extern const int UKI_REQUIRED_FILES_COUNT;
+
 /**
  * Validates that all required dependencies are available.
  *
@@ -25,3 +35,14 @@ extern const int REQUIRED_COMMANDS_COUNT;
  */
 int validate_dependencies(void);
 
+/**
+ * Validates that the dependencies of the selected runtime options are met.
+ *
+ * Checks that option values are known and that host commands needed only
+ * by some options are available. Logs each problem it finds.
+ *
+ * @return - `0` - All option dependencies are satisfied.
+ * @return - `-1` - An option has an unknown value.
+ * @return - `-2` - Missing command(s) required by the selected options.
+ */
+int validate_option_dependencies(void);
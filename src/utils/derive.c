@@ -0,0 +1,357 @@
+/**
+ * This code is responsible for deriving the target and live rootfs from the
+ * base rootfs without physically duplicating it where the host allows.
+ */
+
+#include "all.h"
+
+/** The filesystem magic number identifying btrfs in statfs(). */
+#define DERIVE_BTRFS_SUPER_MAGIC 0x9123683E
+
+/** The filesystem magic number identifying overlayfs in statfs(). */
+#define DERIVE_OVERLAY_SUPER_MAGIC 0x794C7630
+
+/** The inode number of the root directory of every btrfs subvolume. */
+#define DERIVE_BTRFS_SUBVOLUME_INODE 256
+
+/** The suffix of the directory holding overlay upper and work layers. */
+#define DERIVE_LAYERS_SUFFIX "-layers"
+
+static int is_btrfs(const char *path)
+{
+    struct statfs fs_info;
+    if (statfs(path, &fs_info) != 0)
+    {
+        return 0;
+    }
+    return (unsigned long)fs_info.f_type == DERIVE_BTRFS_SUPER_MAGIC;
+}
+
+static int is_btrfs_subvolume(const char *path)
+{
+    struct stat path_stat;
+    if (lstat(path, &path_stat) != 0 || !S_ISDIR(path_stat.st_mode))
+    {
+        return 0;
+    }
+    return is_btrfs(path) && path_stat.st_ino == DERIVE_BTRFS_SUBVOLUME_INODE;
+}
+
+static int is_overlay(const char *path)
+{
+    struct statfs fs_info;
+    if (statfs(path, &fs_info) != 0)
+    {
+        return 0;
+    }
+    return (unsigned long)fs_info.f_type == DERIVE_OVERLAY_SUPER_MAGIC;
+}
+
+static int is_overlay_supported(void)
+{
+    // Read the list of filesystems known to the running kernel.
+    FILE *filesystems = fopen("/proc/filesystems", "r");
+    if (!filesystems)
+    {
+        return 0;
+    }
+
+    // Look for an overlay entry (format: "nodev\toverlay").
+    char line[128];
+    int supported = 0;
+    while (fgets(line, sizeof(line), filesystems))
+    {
+        if (strstr(line, "\toverlay\n"))
+        {
+            supported = 1;
+            break;
+        }
+    }
+    fclose(filesystems);
+
+    return supported;
+}
+
+static int derive_overlay(const char *base_path, const char *path)
+{
+    char layers_path[COMMON_MAX_PATH_LENGTH];
+    char upper_path[COMMON_MAX_PATH_LENGTH];
+    char work_path[COMMON_MAX_PATH_LENGTH];
+
+    // Skip the backend when the kernel has no overlayfs support.
+    if (!is_overlay_supported())
+    {
+        return -1;
+    }
+
+    // Create the merged, upper, and work directories.
+    snprintf(layers_path, sizeof(layers_path), "%s" DERIVE_LAYERS_SUFFIX, path);
+    snprintf(upper_path, sizeof(upper_path), "%s/upper", layers_path);
+    snprintf(work_path, sizeof(work_path), "%s/work", layers_path);
+    if (common.mkdir_p(path) != 0
+        || common.mkdir_p(upper_path) != 0
+        || common.mkdir_p(work_path) != 0)
+    {
+        common.rm_rf(layers_path);
+        common.rm_rf(path);
+        return -2;
+    }
+
+    // Quote the mount options and the mount point for shell safety.
+    char options[COMMON_MAX_COMMAND_LENGTH];
+    char quoted_options[COMMON_MAX_QUOTED_LENGTH];
+    char quoted_path[COMMON_MAX_QUOTED_LENGTH];
+    snprintf(
+        options, sizeof(options),
+        "lowerdir=%s,upperdir=%s,workdir=%s",
+        base_path, upper_path, work_path
+    );
+    if (common.shell_escape_path(options, quoted_options, sizeof(quoted_options)) != 0
+        || common.shell_escape_path(path, quoted_path, sizeof(quoted_path)) != 0)
+    {
+        common.rm_rf(layers_path);
+        common.rm_rf(path);
+        return -3;
+    }
+
+    // Mount the overlay with the base rootfs as the read-only lower layer.
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        command, sizeof(command),
+        "mount -t overlay overlay -o %s %s",
+        quoted_options, quoted_path
+    );
+    if (common.run_command_indented(command) != 0)
+    {
+        LOG_WARNING("Failed to mount overlay, trying the next backend");
+        common.rm_rf(layers_path);
+        common.rm_rf(path);
+        return -4;
+    }
+
+    return 0;
+}
+
+static int derive_snapshot(
+    const char *quoted_base, const char *base_path, const char *quoted_path
+)
+{
+    // Snapshots are only possible when the base rootfs is a subvolume.
+    if (!is_btrfs_subvolume(base_path) || !common.is_command_available("btrfs"))
+    {
+        return -1;
+    }
+
+    // Create a writable snapshot of the base subvolume.
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        command, sizeof(command),
+        "btrfs -q subvolume snapshot %s %s",
+        quoted_base, quoted_path
+    );
+    if (common.run_command(command) != 0)
+    {
+        return -2;
+    }
+
+    return 0;
+}
+
+static int derive_copy(
+    const char *quoted_base, const char *quoted_path, const char *path,
+    int reflink
+)
+{
+    // Copy the base rootfs, sharing extents when reflinks are requested.
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        command, sizeof(command),
+        "cp -a %s %s %s",
+        reflink ? "--reflink=always" : "",
+        quoted_base, quoted_path
+    );
+    if (common.run_command_indented(command) != 0)
+    {
+        LOG_WARNING("Failed to %s base rootfs", reflink ? "reflink" : "copy");
+        // Remove any partial copy so the next backend starts clean.
+        common.rm_rf(path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int create_base_volume(const char *path)
+{
+    // Quote the path for shell safety.
+    char quoted_path[COMMON_MAX_QUOTED_LENGTH];
+    if (common.shell_escape_path(path, quoted_path, sizeof(quoted_path)) != 0)
+    {
+        return -1;
+    }
+
+    // Create a subvolume when the build directory lives on btrfs.
+    char parent_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(parent_path, sizeof(parent_path), "%s/..", path);
+    if (is_btrfs(parent_path) && common.is_command_available("btrfs"))
+    {
+        char command[COMMON_MAX_COMMAND_LENGTH];
+        snprintf(command, sizeof(command), "btrfs -q subvolume create %s", quoted_path);
+        if (common.run_command(command) == 0)
+        {
+            return 0;
+        }
+        LOG_WARNING("Failed to create btrfs subvolume, using a plain directory");
+    }
+
+    // Fall back to a plain directory.
+    if (common.mkdir_p(path) != 0)
+    {
+        return -2;
+    }
+
+    return 0;
+}
+
+int derive_rootfs(
+    const char *base_path, const char *path, RootfsBackend *out_backend
+)
+{
+    RootfsBackend backend;
+
+    // Quote the base path for shell safety.
+    char quoted_base[COMMON_MAX_QUOTED_LENGTH];
+    if (common.shell_escape_path(base_path, quoted_base, sizeof(quoted_base)) != 0)
+    {
+        return -1;
+    }
+
+    // Quote the destination path for shell safety.
+    char quoted_path[COMMON_MAX_QUOTED_LENGTH];
+    if (common.shell_escape_path(path, quoted_path, sizeof(quoted_path)) != 0)
+    {
+        return -1;
+    }
+
+    // Try each backend, cheapest first.
+    if (derive_overlay(base_path, path) == 0)
+    {
+        backend = ROOTFS_BACKEND_OVERLAY;
+    }
+    else if (derive_snapshot(quoted_base, base_path, quoted_path) == 0)
+    {
+        backend = ROOTFS_BACKEND_SNAPSHOT;
+    }
+    else if (derive_copy(quoted_base, quoted_path, path, 1) == 0)
+    {
+        backend = ROOTFS_BACKEND_REFLINK;
+    }
+    else if (derive_copy(quoted_base, quoted_path, path, 0) == 0)
+    {
+        backend = ROOTFS_BACKEND_COPY;
+    }
+    else
+    {
+        return -2;
+    }
+
+    LOG_INFO("Derived rootfs using %s backend", get_rootfs_backend_name(backend));
+
+    if (out_backend)
+    {
+        *out_backend = backend;
+    }
+
+    return 0;
+}
+
+int release_rootfs(const char *path)
+{
+    // Treat a missing rootfs as already released.
+    struct stat path_stat;
+    if (lstat(path, &path_stat) != 0)
+    {
+        return 0;
+    }
+
+    // Quote the path for shell safety.
+    char quoted_path[COMMON_MAX_QUOTED_LENGTH];
+    if (common.shell_escape_path(path, quoted_path, sizeof(quoted_path)) != 0)
+    {
+        return -1;
+    }
+
+    char command[COMMON_MAX_COMMAND_LENGTH];
+
+    // Unmount overlay-derived rootfs and drop their layers.
+    if (is_overlay(path))
+    {
+        // Fall back to a lazy unmount if something still holds the mount.
+        snprintf(command, sizeof(command), "umount -R %s 2>/dev/null", quoted_path);
+        if (common.run_command(command) != 0)
+        {
+            snprintf(command, sizeof(command), "umount -R -l %s", quoted_path);
+            if (common.run_command(command) != 0)
+            {
+                return -2;
+            }
+        }
+
+        char layers_path[COMMON_MAX_PATH_LENGTH];
+        snprintf(layers_path, sizeof(layers_path), "%s" DERIVE_LAYERS_SUFFIX, path);
+        if (common.rm_rf(layers_path) != 0 || common.rm_rf(path) != 0)
+        {
+            return -3;
+        }
+        return 0;
+    }
+
+    // Delete btrfs subvolumes in one metadata operation.
+    if (is_btrfs_subvolume(path) && common.is_command_available("btrfs"))
+    {
+        snprintf(command, sizeof(command), "btrfs -q subvolume delete %s", quoted_path);
+        if (common.run_command(command) == 0)
+        {
+            return 0;
+        }
+    }
+
+    // Remove plain directories recursively.
+    if (common.rm_rf(path) != 0)
+    {
+        return -3;
+    }
+
+    return 0;
+}
+
+int is_overlay_rootfs(const char *path)
+{
+    return is_overlay(path);
+}
+
+int get_overlay_upper_dir(const char *path, char *out_path, size_t out_size)
+{
+    if (!is_overlay(path))
+    {
+        return -1;
+    }
+    snprintf(out_path, out_size, "%s" DERIVE_LAYERS_SUFFIX "/upper", path);
+    return 0;
+}
+
+const char *get_rootfs_backend_name(RootfsBackend backend)
+{
+    switch (backend)
+    {
+        case ROOTFS_BACKEND_OVERLAY:
+            return "overlay";
+        case ROOTFS_BACKEND_SNAPSHOT:
+            return "btrfs snapshot";
+        case ROOTFS_BACKEND_REFLINK:
+            return "reflink";
+        case ROOTFS_BACKEND_COPY:
+            return "copy";
+    }
+    return "unknown";
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "../all.h"
+
+/** A type representing the mechanism used to derive a rootfs from base. */
+typedef enum
+{
+    ROOTFS_BACKEND_OVERLAY,
+    ROOTFS_BACKEND_SNAPSHOT,
+    ROOTFS_BACKEND_REFLINK,
+    ROOTFS_BACKEND_COPY
+} RootfsBackend;
+
+/**
+ * Creates an empty directory to hold the base rootfs.
+ *
+ * On btrfs, the directory is created as a subvolume so that derived rootfs
+ * can later be created as O(1) snapshots of it. Elsewhere, a plain directory
+ * is created.
+ *
+ * @param path The path of the base rootfs directory to create.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates path quoting failure.
+ * @return - `-2` - Indicates directory creation failure.
+ */
+int create_base_volume(const char *path);
+
+/**
+ * Derives a new rootfs from the base rootfs.
+ *
+ * Tries each backend in order of cost: an overlayfs mount with the base as
+ * lowerdir, a btrfs snapshot, a reflink clone (btrfs/XFS), and finally a
+ * plain `cp -a`. The first backend that succeeds is used.
+ *
+ * @param base_path The path to the base rootfs to derive from.
+ * @param path The path where the derived rootfs will appear.
+ * @param out_backend The backend that was used (may be NULL).
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates path quoting failure.
+ * @return - `-2` - Indicates that every backend failed.
+ *
+ * @note An overlay-derived rootfs depends on the base rootfs, which must
+ * outlive it. Use is_overlay_rootfs() to check before removing the base.
+ */
+int derive_rootfs(
+    const char *base_path, const char *path, RootfsBackend *out_backend
+);
+
+/**
+ * Releases a rootfs created by derive_rootfs() or create_base_volume().
+ *
+ * Unmounts overlay-derived rootfs and removes their layer directories,
+ * deletes btrfs subvolumes, and removes plain directories. Releasing a path
+ * that does not exist is not an error.
+ *
+ * @param path The path to the rootfs to release.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates path quoting failure.
+ * @return - `-2` - Indicates unmount failure.
+ * @return - `-3` - Indicates removal failure.
+ */
+int release_rootfs(const char *path);
+
+/**
+ * Checks whether a rootfs is an overlay mount on top of the base rootfs.
+ *
+ * @param path The path to the rootfs.
+ *
+ * @return - `1` - Indicates the rootfs is overlay-derived.
+ * @return - `0` - Indicates the rootfs is self-contained.
+ */
+int is_overlay_rootfs(const char *path);
+
+/**
+ * Gets the upper layer of an overlay-derived rootfs.
+ *
+ * The upper layer holds only what changed relative to the base rootfs,
+ * with deletions recorded as overlayfs whiteouts, so it can be stacked on
+ * top of the base again as a lower layer.
+ *
+ * @param path The path to the rootfs.
+ * @param out_path The buffer receiving the upper layer path.
+ * @param out_size The size of the output buffer.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates the rootfs is not overlay-derived.
+ */
+int get_overlay_upper_dir(const char *path, char *out_path, size_t out_size);
+
+/** Returns a human-readable name for a rootfs backend. */
+const char *get_rootfs_backend_name(RootfsBackend backend);
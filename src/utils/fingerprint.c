@@ -0,0 +1,431 @@
+/**
+ * This code is responsible for computing stable SHA-256 fingerprints over
+ * strings, files, and directory trees used as cache keys.
+ */
+
+#define _GNU_SOURCE
+#include "all.h"
+
+/** The size of the buffer used to stream file contents into the digest. */
+#define FINGERPRINT_READ_BUFFER_SIZE 65536
+
+int add_fingerprint_bytes(
+    Fingerprint *fingerprint, const void *data, size_t length
+)
+{
+    if (EVP_DigestUpdate(fingerprint->context, data, length) != 1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static int add_fingerprint_record(
+    Fingerprint *fingerprint, const char *kind, const char *label
+)
+{
+    // Terminate each field so adjacent records cannot be confused.
+    if (add_fingerprint_bytes(fingerprint, kind, strlen(kind) + 1) != 0
+        || add_fingerprint_bytes(fingerprint, label, strlen(label) + 1) != 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int init_fingerprint(Fingerprint *fingerprint)
+{
+    fingerprint->context = EVP_MD_CTX_new();
+    if (!fingerprint->context)
+    {
+        return -1;
+    }
+
+    if (EVP_DigestInit_ex(fingerprint->context, EVP_sha256(), NULL) != 1)
+    {
+        discard_fingerprint(fingerprint);
+        return -1;
+    }
+
+    return 0;
+}
+
+int add_fingerprint_string(
+    Fingerprint *fingerprint, const char *label, const char *value
+)
+{
+    if (add_fingerprint_record(fingerprint, "string", label) != 0
+        || add_fingerprint_bytes(fingerprint, value, strlen(value) + 1) != 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int add_fingerprint_file(
+    Fingerprint *fingerprint, const char *label, const char *path
+)
+{
+    // Record missing files explicitly.
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        if (errno == ENOENT)
+        {
+            return add_fingerprint_record(fingerprint, "missing", label);
+        }
+        return -2;
+    }
+
+    if (add_fingerprint_record(fingerprint, "file", label) != 0)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    // Stream the file contents into the digest.
+    unsigned char buffer[FINGERPRINT_READ_BUFFER_SIZE];
+    size_t bytes;
+    while ((bytes = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        if (add_fingerprint_bytes(fingerprint, buffer, bytes) != 0)
+        {
+            fclose(file);
+            return -1;
+        }
+    }
+
+    // Distinguish read errors from end of file.
+    int read_failed = ferror(file);
+    fclose(file);
+
+    return read_failed ? -2 : 0;
+}
+
+int add_fingerprint_tree(
+    Fingerprint *fingerprint, const char *label, const char *path
+)
+{
+    // Record missing directories explicitly.
+    struct stat st;
+    if (lstat(path, &st) != 0)
+    {
+        if (errno == ENOENT)
+        {
+            return add_fingerprint_record(fingerprint, "missing", label);
+        }
+        return -2;
+    }
+
+    // Hash symbolic links by their target, never following them.
+    if (S_ISLNK(st.st_mode))
+    {
+        char target[COMMON_MAX_PATH_LENGTH];
+        ssize_t length = readlink(path, target, sizeof(target) - 1);
+        if (length < 0)
+        {
+            return -2;
+        }
+        target[length] = '\0';
+        return add_fingerprint_string(fingerprint, label, target);
+    }
+
+    // Hash regular files by their contents.
+    if (!S_ISDIR(st.st_mode))
+    {
+        return add_fingerprint_file(fingerprint, label, path);
+    }
+
+    if (add_fingerprint_record(fingerprint, "directory", label) != 0)
+    {
+        return -1;
+    }
+
+    // List the directory in sorted order.
+    struct dirent **entries;
+    int count = scandir(path, &entries, NULL, alphasort);
+    if (count < 0)
+    {
+        return -2;
+    }
+
+    // Recurse into each entry, skipping the self and parent links.
+    int result = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const char *name = entries[i]->d_name;
+        if (result == 0 && strcmp(name, ".") != 0 && strcmp(name, "..") != 0)
+        {
+            char child_label[COMMON_MAX_PATH_LENGTH];
+            char child_path[COMMON_MAX_PATH_LENGTH];
+            snprintf(child_label, sizeof(child_label), "%s/%s", label, name);
+            snprintf(child_path, sizeof(child_path), "%s/%s", path, name);
+            result = add_fingerprint_tree(fingerprint, child_label, child_path);
+        }
+        free(entries[i]);
+    }
+    free(entries);
+
+    return result;
+}
+
+int finish_fingerprint(Fingerprint *fingerprint, char *out_hex, size_t out_size)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_length = 0;
+
+    // Finalize the digest and release the context.
+    int result = EVP_DigestFinal_ex(fingerprint->context, digest, &digest_length);
+    discard_fingerprint(fingerprint);
+    if (result != 1)
+    {
+        return -1;
+    }
+
+    // Ensure the output buffer fits the hex digest and terminator.
+    if (out_size < (size_t)digest_length * 2 + 1)
+    {
+        return -2;
+    }
+
+    // Encode the digest as lowercase hex.
+    for (unsigned int i = 0; i < digest_length; i++)
+    {
+        snprintf(out_hex + i * 2, 3, "%02x", digest[i]);
+    }
+
+    return 0;
+}
+
+void discard_fingerprint(Fingerprint *fingerprint)
+{
+    if (fingerprint->context)
+    {
+        EVP_MD_CTX_free(fingerprint->context);
+        fingerprint->context = NULL;
+    }
+}
+
+static void keep_memo_entry(void *entry)
+{
+    // Entries are owned by the memo's list and freed from there.
+    (void)entry;
+}
+
+static int compare_memo_entries(const void *a, const void *b)
+{
+    const FingerprintMemoEntry *left = a;
+    const FingerprintMemoEntry *right = b;
+    return strcmp(left->key, right->key);
+}
+
+static FingerprintMemoEntry *add_memo_entry(
+    FingerprintMemo *memo, const char *key, const char *sha256, int used
+)
+{
+    // Grow the entry list as needed.
+    if (memo->count == memo->capacity)
+    {
+        int capacity = memo->capacity ? memo->capacity * 2 : 1024;
+        FingerprintMemoEntry **entries = realloc(memo->entries, capacity * sizeof(*entries));
+        if (!entries)
+        {
+            return NULL;
+        }
+        memo->entries = entries;
+        memo->capacity = capacity;
+    }
+
+    FingerprintMemoEntry *entry = calloc(1, sizeof(*entry));
+    if (!entry || !(entry->key = strdup(key)))
+    {
+        free(entry);
+        return NULL;
+    }
+    snprintf(entry->sha256, sizeof(entry->sha256), "%s", sha256);
+    entry->used = used;
+
+    // Index the entry, keeping the first one for a repeated key.
+    FingerprintMemoEntry **found = tsearch(entry, &memo->index, compare_memo_entries);
+    if (!found || *found != entry)
+    {
+        free(entry->key);
+        free(entry);
+        return found ? *found : NULL;
+    }
+    memo->entries[memo->count++] = entry;
+
+    return entry;
+}
+
+int load_fingerprint_memo(FingerprintMemo *memo, const char *path)
+{
+    memset(memo, 0, sizeof(*memo));
+
+    // Start empty when there is no memo yet.
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    // Each line holds a content hash followed by its key.
+    char line[COMMON_SHA256_HEX_LENGTH + COMMON_MAX_PATH_LENGTH + 64];
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\n")] = '\0';
+        if (strlen(line) < COMMON_SHA256_HEX_LENGTH || line[COMMON_SHA256_HEX_LENGTH - 1] != ' ')
+        {
+            continue;
+        }
+        line[COMMON_SHA256_HEX_LENGTH - 1] = '\0';
+        if (!add_memo_entry(memo, line + COMMON_SHA256_HEX_LENGTH, line, 0))
+        {
+            fclose(file);
+            free_fingerprint_memo(memo);
+            return -1;
+        }
+    }
+    fclose(file);
+
+    return 0;
+}
+
+int save_fingerprint_memo(const FingerprintMemo *memo, const char *path)
+{
+    // Write to a temporary name, then move it into place.
+    char temp_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp-%d", path, getpid());
+    FILE *file = fopen(temp_path, "w");
+    if (!file)
+    {
+        return -1;
+    }
+    for (int i = 0; i < memo->count; i++)
+    {
+        if (memo->entries[i]->used)
+        {
+            fprintf(file, "%s %s\n", memo->entries[i]->sha256, memo->entries[i]->key);
+        }
+    }
+    if (fclose(file) != 0 || rename(temp_path, path) != 0)
+    {
+        common.rm_file(temp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+void free_fingerprint_memo(FingerprintMemo *memo)
+{
+    tdestroy(memo->index, keep_memo_entry);
+    for (int i = 0; i < memo->count; i++)
+    {
+        free(memo->entries[i]->key);
+        free(memo->entries[i]);
+    }
+    free(memo->entries);
+    memset(memo, 0, sizeof(*memo));
+}
+
+static int get_file_content_hash(
+    const char *label, const char *path, const struct stat *st,
+    FingerprintMemo *memo, char *out_sha256, size_t out_size
+)
+{
+    // Reuse the remembered hash while the size and modification time match.
+    char key[COMMON_MAX_PATH_LENGTH + 64];
+    snprintf(
+        key, sizeof(key), "%lld %lld.%09ld %s",
+        (long long)st->st_size, (long long)st->st_mtim.tv_sec, st->st_mtim.tv_nsec, label
+    );
+    FingerprintMemoEntry lookup = { .key = key };
+    FingerprintMemoEntry **found = tfind(&lookup, &memo->index, compare_memo_entries);
+    if (found)
+    {
+        (*found)->used = 1;
+        snprintf(out_sha256, out_size, "%s", (*found)->sha256);
+        return 0;
+    }
+
+    // Hash the contents and remember the result.
+    if (common.compute_file_sha256(path, out_sha256, out_size) != 0)
+    {
+        return -2;
+    }
+    if (!add_memo_entry(memo, key, out_sha256, 1))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int add_fingerprint_manifest_entry(
+    Fingerprint *fingerprint, const ManifestEntry *entry, FingerprintMemo *memo
+)
+{
+    const char *label = entry->relative_path;
+    const struct stat *st = &entry->st;
+
+    // Hash the metadata every entry has.
+    char metadata[128];
+    snprintf(
+        metadata, sizeof(metadata), "%o %u %u %lld %llx",
+        (unsigned int)st->st_mode, (unsigned int)st->st_uid, (unsigned int)st->st_gid,
+        S_ISREG(st->st_mode) ? (long long)st->st_size : 0LL,
+        (unsigned long long)st->st_rdev
+    );
+    if (add_fingerprint_string(fingerprint, label, metadata) != 0)
+    {
+        return -1;
+    }
+
+    // Hash each extended attribute name and value.
+    for (int i = 0; i < entry->xattr_count; i++)
+    {
+        if (add_fingerprint_record(fingerprint, "xattr", entry->xattrs[i].name) != 0
+            || add_fingerprint_bytes(fingerprint, entry->xattrs[i].value, entry->xattrs[i].size) != 0)
+        {
+            return -1;
+        }
+    }
+
+    // Hash symbolic links by their target.
+    if (S_ISLNK(st->st_mode))
+    {
+        return add_fingerprint_string(fingerprint, "target", entry->target);
+    }
+
+    // Hash regular files by their remembered or computed content hash.
+    if (S_ISREG(st->st_mode))
+    {
+        char sha256[COMMON_SHA256_HEX_LENGTH];
+        int result = get_file_content_hash(label, entry->path, st, memo, sha256, sizeof(sha256));
+        if (result != 0)
+        {
+            return result;
+        }
+        return add_fingerprint_string(fingerprint, "content", sha256);
+    }
+
+    // Recurse into directory entries, which are already sorted.
+    for (int i = 0; i < entry->child_count; i++)
+    {
+        int result = add_fingerprint_manifest_entry(fingerprint, entry->children[i], memo);
+        if (result != 0)
+        {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+int add_fingerprint_manifest(
+    Fingerprint *fingerprint, const Manifest *manifest, FingerprintMemo *memo
+)
+{
+    return add_fingerprint_manifest_entry(fingerprint, manifest->root, memo);
+}
@@ -0,0 +1,186 @@
+#pragma once
+#include "../all.h"
+
+/** A type representing an incremental SHA-256 fingerprint of build inputs. */
+typedef struct
+{
+    EVP_MD_CTX *context;
+} Fingerprint;
+
+/** A type representing a remembered content hash of one file. */
+typedef struct
+{
+    char *key;
+    char sha256[COMMON_SHA256_HEX_LENGTH];
+    int used;
+} FingerprintMemoEntry;
+
+/**
+ * A type representing content hashes remembered across builds.
+ *
+ * Entries are keyed by path, size, and modification time. Files installed
+ * from packages keep their packaged modification time, so they are only
+ * hashed again when they change.
+ */
+typedef struct
+{
+    FingerprintMemoEntry **entries;
+    int count;
+    int capacity;
+    void *index;
+} FingerprintMemo;
+
+/**
+ * Starts a new fingerprint.
+ *
+ * @param fingerprint The fingerprint to initialize.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates digest initialization failure.
+ */
+int init_fingerprint(Fingerprint *fingerprint);
+
+/**
+ * Adds raw bytes to a fingerprint.
+ *
+ * @param fingerprint The fingerprint to update.
+ * @param data The bytes to add.
+ * @param length The number of bytes to add.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates digest update failure.
+ */
+int add_fingerprint_bytes(
+    Fingerprint *fingerprint, const void *data, size_t length
+);
+
+/**
+ * Adds a labelled string to a fingerprint.
+ *
+ * @param fingerprint The fingerprint to update.
+ * @param label The label identifying the value.
+ * @param value The string value to add.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates digest update failure.
+ */
+int add_fingerprint_string(
+    Fingerprint *fingerprint, const char *label, const char *value
+);
+
+/**
+ * Adds a file to a fingerprint.
+ *
+ * The label and file contents are both hashed. A missing file is recorded as
+ * such, so that creating it later changes the fingerprint.
+ *
+ * @param fingerprint The fingerprint to update.
+ * @param label The label identifying the file (e.g. its rootfs path).
+ * @param path The host path to the file.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates digest update failure.
+ * @return - `-2` - Indicates file read failure.
+ */
+int add_fingerprint_file(
+    Fingerprint *fingerprint, const char *label, const char *path
+);
+
+/**
+ * Adds a directory tree to a fingerprint.
+ *
+ * Entries are visited in sorted order so the result does not depend on
+ * directory iteration order. Regular files contribute their contents,
+ * symbolic links their targets, and directories their names. A missing
+ * directory is recorded as such.
+ *
+ * @param fingerprint The fingerprint to update.
+ * @param label The label identifying the tree (e.g. its rootfs path).
+ * @param path The host path to the directory.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates digest update failure.
+ * @return - `-2` - Indicates file or directory read failure.
+ */
+int add_fingerprint_tree(
+    Fingerprint *fingerprint, const char *label, const char *path
+);
+
+/**
+ * Finishes a fingerprint and releases its resources.
+ *
+ * @param fingerprint The fingerprint to finish.
+ * @param out_hex The buffer receiving the lowercase hex digest.
+ * @param out_size The size of the output buffer.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates digest finalization failure.
+ * @return - `-2` - Indicates the output buffer is too small.
+ */
+int finish_fingerprint(Fingerprint *fingerprint, char *out_hex, size_t out_size);
+
+/**
+ * Releases a fingerprint without producing a digest.
+ *
+ * Safe to call on a fingerprint that was already finished.
+ *
+ * @param fingerprint The fingerprint to release.
+ */
+void discard_fingerprint(Fingerprint *fingerprint);
+
+/**
+ * Loads a content hash memo from a file.
+ *
+ * A missing file yields an empty memo.
+ *
+ * @param memo The memo to initialize.
+ * @param path The path of the memo file.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates memo read failure.
+ */
+int load_fingerprint_memo(FingerprintMemo *memo, const char *path);
+
+/**
+ * Saves the entries of a memo that were used since it was loaded.
+ *
+ * Dropping unused entries keeps the memo to the size of the trees of one
+ * build. A build hashing several trees keeps one memo across them, so
+ * every save holds the entries of all of them. The file is replaced
+ * atomically.
+ *
+ * @param memo The memo to save.
+ * @param path The path of the memo file.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates memo write failure.
+ */
+int save_fingerprint_memo(const FingerprintMemo *memo, const char *path);
+
+/**
+ * Releases a memo.
+ *
+ * @param memo The memo to release.
+ */
+void free_fingerprint_memo(FingerprintMemo *memo);
+
+/**
+ * Adds a complete tree read into a manifest to a fingerprint.
+ *
+ * Entries are visited in manifest order. Each contributes its relative path,
+ * mode, owner, size, device number, and extended attributes, plus the target
+ * of symbolic links and the content hash of regular files. Modification
+ * times are left out. Content hashes are looked up in the memo first and
+ * added to it when computed.
+ *
+ * @param fingerprint The fingerprint to update.
+ * @param manifest The manifest of the tree.
+ * @param memo The content hash memo.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates digest update failure.
+ * @return - `-2` - Indicates file read failure.
+ */
+int add_fingerprint_manifest(
+    Fingerprint *fingerprint, const Manifest *manifest, FingerprintMemo *memo
+);
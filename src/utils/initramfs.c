@@ -0,0 +1,455 @@
+/**
+ * This code is responsible for generating initramfs images, reusing images
+ * from a persistent cache when their inputs have not changed.
+ */
+
+#include "all.h"
+
+/**
+ * The supported initramfs codecs.
+ *
+ * zstd is used at level 12. Levels above that switch to much slower match
+ * finders, which multiply the generation time of every uncached initrd for
+ * a few percent of size, and decompression speed is the same at any level.
+ */
+static const InitramfsCodec INITRAMFS_CODECS[] = {
+    { "zstd", "12", "zstd" },
+    { "lz4", "9", "lz4" },
+    { "xz", "6", "xz-utils" }
+};
+
+/** The number of supported initramfs codecs. */
+#define INITRAMFS_CODECS_COUNT \
+    (int)(sizeof(INITRAMFS_CODECS) / sizeof(INITRAMFS_CODECS[0]))
+
+/** A type representing a named set of initramfs modules. */
+typedef struct
+{
+    const char *name;
+    const char *modules;
+} InitramfsModuleClass;
+
+/** The initramfs module classes images can declare. */
+static const InitramfsModuleClass INITRAMFS_MODULE_CLASSES[] = {
+    { "storage", CONFIG_INITRAMFS_STORAGE_MODULES },
+    { "usb", CONFIG_INITRAMFS_USB_MODULES },
+    { "input", CONFIG_INITRAMFS_INPUT_MODULES },
+    { "virtio", CONFIG_INITRAMFS_VIRTIO_MODULES },
+    { "nvme", CONFIG_INITRAMFS_NVME_MODULES },
+    { "gpu", CONFIG_INITRAMFS_GPU_MODULES },
+    { "live-media", CONFIG_INITRAMFS_LIVE_MEDIA_MODULES },
+    { "root-fs", CONFIG_INITRAMFS_ROOT_FS_MODULES }
+};
+
+/** The number of initramfs module classes. */
+#define INITRAMFS_MODULE_CLASSES_COUNT \
+    (int)(sizeof(INITRAMFS_MODULE_CLASSES) / sizeof(INITRAMFS_MODULE_CLASSES[0]))
+
+/**
+ * The rootfs configuration that initramfs hooks copy into the image: the
+ * initramfs-tools configuration and module list, module options, live-boot
+ * settings, udev rules, the console keymap and font, the Plymouth theme
+ * selection, and the OS identity, which is rewritten for every version.
+ * /etc/os-release is usually a link to /usr/lib/os-release, which is hashed
+ * for its contents.
+ */
+static const char *const INITRAMFS_HOOK_INPUTS[] = {
+    "/etc/initramfs-tools",
+    "/etc/modprobe.d",
+    "/etc/live",
+    "/etc/udev/rules.d",
+    "/etc/default/keyboard",
+    "/etc/default/console-setup",
+    "/etc/console-setup",
+    "/etc/plymouth/plymouthd.conf",
+    "/etc/os-release",
+    "/usr/lib/os-release"
+};
+
+/** The number of rootfs paths hashed into the initramfs cache key. */
+#define INITRAMFS_HOOK_INPUTS_COUNT \
+    (int)(sizeof(INITRAMFS_HOOK_INPUTS) / sizeof(INITRAMFS_HOOK_INPUTS[0]))
+
+/** The directory where initrd sizes are recorded per image and policy. */
+#define INITRAMFS_SIZE_RECORD_DIR CONFIG_INITRAMFS_CACHE_DIR "/sizes"
+
+static const InitramfsModuleClass *find_initramfs_module_class(const char *name)
+{
+    for (int i = 0; i < INITRAMFS_MODULE_CLASSES_COUNT; i++)
+    {
+        if (strcmp(INITRAMFS_MODULE_CLASSES[i].name, name) == 0)
+        {
+            return &INITRAMFS_MODULE_CLASSES[i];
+        }
+    }
+    return NULL;
+}
+
+static int append_initramfs_modules(FILE *file, const char *modules)
+{
+    // Write one module name per line, as initramfs-tools expects.
+    char names[COMMON_MAX_PATH_LENGTH];
+    snprintf(names, sizeof(names), "%s", modules);
+    char *saveptr;
+    for (char *name = strtok_r(names, " ", &saveptr); name; name = strtok_r(NULL, " ", &saveptr))
+    {
+        if (fprintf(file, "%s\n", name) < 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static long long read_initrd_size_record(const char *image_name, const char *policy)
+{
+    char path[COMMON_MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), INITRAMFS_SIZE_RECORD_DIR "/%s-%s", image_name, policy);
+
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return -1;
+    }
+    long long size;
+    if (fscanf(file, "%lld", &size) != 1)
+    {
+        size = -1;
+    }
+    fclose(file);
+
+    return size;
+}
+
+static void write_initrd_size_record(const char *image_name, const char *policy, off_t size)
+{
+    char path[COMMON_MAX_PATH_LENGTH];
+    char content[32];
+    snprintf(path, sizeof(path), INITRAMFS_SIZE_RECORD_DIR "/%s-%s", image_name, policy);
+    snprintf(content, sizeof(content), "%lld\n", (long long)size);
+    if (common.mkdir_p(INITRAMFS_SIZE_RECORD_DIR) != 0 || common.write_file(path, content) != 0)
+    {
+        LOG_WARNING("Failed to record initrd size");
+    }
+}
+
+static int compute_initramfs_key(
+    const char *rootfs_path, const char *kernel_version,
+    char *out_key, size_t out_size
+)
+{
+    char path[COMMON_MAX_PATH_LENGTH];
+    Fingerprint fingerprint;
+
+    if (init_fingerprint(&fingerprint) != 0)
+    {
+        return -1;
+    }
+
+    // Hash the kernel version the image is built for.
+    int result = add_fingerprint_string(&fingerprint, "kernel", kernel_version);
+
+    // Hash the package database, which covers the kernel, initramfs hooks,
+    // firmware, and Plymouth package versions.
+    if (result == 0)
+    {
+        snprintf(path, sizeof(path), "%s/var/lib/dpkg/status", rootfs_path);
+        result = add_fingerprint_file(&fingerprint, "/var/lib/dpkg/status", path);
+    }
+
+    // Hash the configuration that initramfs hooks copy into the image.
+    for (int i = 0; i < INITRAMFS_HOOK_INPUTS_COUNT && result == 0; i++)
+    {
+        snprintf(path, sizeof(path), "%s%s", rootfs_path, INITRAMFS_HOOK_INPUTS[i]);
+        result = add_fingerprint_tree(&fingerprint, INITRAMFS_HOOK_INPUTS[i], path);
+    }
+
+    // Hash the Plymouth theme.
+    if (result == 0)
+    {
+        snprintf(
+            path, sizeof(path),
+            "%s" CONFIG_PLYMOUTH_THEMES_DIR "/" CONFIG_PLYMOUTH_THEME_NAME,
+            rootfs_path
+        );
+        result = add_fingerprint_tree(
+            &fingerprint,
+            CONFIG_PLYMOUTH_THEMES_DIR "/" CONFIG_PLYMOUTH_THEME_NAME, path
+        );
+    }
+
+    if (result != 0)
+    {
+        discard_fingerprint(&fingerprint);
+        return -1;
+    }
+
+    return finish_fingerprint(&fingerprint, out_key, out_size) == 0 ? 0 : -1;
+}
+
+static int restore_cached_initramfs(
+    const char *rootfs_path, const char *kernel_version, const char *cache_path
+)
+{
+    char path[COMMON_MAX_PATH_LENGTH];
+    char command[COMMON_MAX_COMMAND_LENGTH];
+
+    // Copy the cached image to the versioned initrd path.
+    snprintf(path, sizeof(path), "%s/boot/initrd.img-%s", rootfs_path, kernel_version);
+    if (common.copy_file(cache_path, path) != 0)
+    {
+        return -1;
+    }
+
+    // Record the image checksum the way update-initramfs does, so later
+    // `update-initramfs -u` runs on the installed system recognize it.
+    snprintf(path, sizeof(path), "%s/var/lib/initramfs-tools", rootfs_path);
+    if (common.mkdir_p(path) != 0)
+    {
+        return -2;
+    }
+    snprintf(
+        command, sizeof(command),
+        "sha1sum /boot/initrd.img-%s > /var/lib/initramfs-tools/%s",
+        kernel_version, kernel_version
+    );
+    if (common.run_chroot(rootfs_path, command) != 0)
+    {
+        return -2;
+    }
+
+    return 0;
+}
+
+static void store_cached_initramfs(
+    const char *rootfs_path, const char *kernel_version, const char *cache_path
+)
+{
+    char image_path[COMMON_MAX_PATH_LENGTH];
+
+    // Ensure the cache directory exists.
+    if (common.mkdir_p(CONFIG_INITRAMFS_CACHE_DIR) != 0)
+    {
+        LOG_WARNING("Failed to create initramfs cache directory");
+        return;
+    }
+
+    // Copy the image, since update-initramfs may rewrite it in the rootfs.
+    snprintf(image_path, sizeof(image_path), "%s/boot/initrd.img-%s", rootfs_path, kernel_version);
+    if (store_cache_file(image_path, cache_path, 0) != 0)
+    {
+        LOG_WARNING("Failed to store initramfs in cache");
+        return;
+    }
+
+    // Keep the cache within its size limit.
+    if (prune_cache(CONFIG_INITRAMFS_CACHE_DIR, ".img", 0, CONFIG_INITRAMFS_CACHE_MAX_MIB) != 0)
+    {
+        LOG_WARNING("Failed to prune initramfs cache");
+    }
+}
+
+static int generate_kernel_initramfs(const char *rootfs_path, const char *kernel_version)
+{
+    char key[COMMON_SHA256_HEX_LENGTH];
+    char cache_path[COMMON_MAX_PATH_LENGTH];
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    int cacheable = 1;
+
+    // Compute the cache key from the image inputs.
+    if (compute_initramfs_key(rootfs_path, kernel_version, key, sizeof(key)) != 0)
+    {
+        LOG_WARNING("Failed to fingerprint initramfs inputs, cache disabled");
+        cacheable = 0;
+    }
+    else
+    {
+        snprintf(cache_path, sizeof(cache_path), CONFIG_INITRAMFS_CACHE_DIR "/%s.img", key);
+    }
+
+    // Reuse the cached image when the inputs are unchanged.
+    if (cacheable && common.file_exists(cache_path))
+    {
+        LOG_INFO("Reusing cached initramfs for kernel %s", kernel_version);
+        touch_cache_entry(cache_path);
+        if (restore_cached_initramfs(rootfs_path, kernel_version, cache_path) != 0)
+        {
+            return -3;
+        }
+        return 0;
+    }
+
+    // Generate the image from scratch, letting zstd and xz compress on every
+    // online CPU. lz4 has no multi-threaded mode and ignores these.
+    LOG_INFO("Generating initramfs for kernel %s", kernel_version);
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    snprintf(
+        command, sizeof(command),
+        "ZSTD_NBTHREADS=%ld XZ_DEFAULTS=--threads=0 update-initramfs -c -k %s",
+        threads > 0 ? threads : 1, kernel_version
+    );
+    if (common.run_chroot_indented(rootfs_path, command) != 0)
+    {
+        return -2;
+    }
+
+    // Store the new image for later builds.
+    if (cacheable)
+    {
+        store_cached_initramfs(rootfs_path, kernel_version, cache_path);
+    }
+
+    return 0;
+}
+
+int generate_rootfs_initramfs(const char *rootfs_path)
+{
+    char modules_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(modules_path, sizeof(modules_path), "%s/lib/modules", rootfs_path);
+
+    // List installed kernels by their module directories.
+    struct dirent **entries;
+    int count = scandir(modules_path, &entries, NULL, alphasort);
+    if (count < 0)
+    {
+        return -1;
+    }
+
+    // Generate one image per kernel.
+    int result = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const char *name = entries[i]->d_name;
+        if (result == 0 && name[0] != '.')
+        {
+            result = generate_kernel_initramfs(rootfs_path, name);
+        }
+        free(entries[i]);
+    }
+    free(entries);
+
+    return result;
+}
+
+const InitramfsCodec *find_initramfs_codec(const char *name)
+{
+    for (int i = 0; i < INITRAMFS_CODECS_COUNT; i++)
+    {
+        if (strcmp(INITRAMFS_CODECS[i].name, name) == 0)
+        {
+            return &INITRAMFS_CODECS[i];
+        }
+    }
+    return NULL;
+}
+
+const InitramfsCodec *get_initramfs_codec(void)
+{
+    return find_initramfs_codec(build_options.initramfs_codec);
+}
+
+int validate_initramfs_classes(const char *classes)
+{
+    char names[COMMON_MAX_PATH_LENGTH];
+    snprintf(names, sizeof(names), "%s", classes);
+    char *saveptr;
+    for (char *name = strtok_r(names, " ", &saveptr); name; name = strtok_r(NULL, " ", &saveptr))
+    {
+        if (!find_initramfs_module_class(name))
+        {
+            LOG_ERROR("Unknown initramfs module class: %s", name);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int configure_initramfs_modules(const char *rootfs_path, const char *classes)
+{
+    int is_list = strcmp(build_options.initramfs_modules, "list") == 0;
+    LOG_INFO(
+        "Configuring initramfs modules (MODULES=%s, classes: %s)",
+        build_options.initramfs_modules, is_list ? classes : "gpu"
+    );
+
+    // Select the module policy with a conf.d drop-in, which survives
+    // package installation.
+    char path[COMMON_MAX_PATH_LENGTH];
+    char policy[64];
+    snprintf(
+        path, sizeof(path),
+        "%s/etc/initramfs-tools/conf.d/driver-policy.conf", rootfs_path
+    );
+    snprintf(policy, sizeof(policy), "MODULES=%s\n", build_options.initramfs_modules);
+    if (common.write_file(path, policy) != 0)
+    {
+        return -2;
+    }
+
+    // Append the modules of each declared class to the module list. Under
+    // MODULES=most, only GPU drivers are added, for early KMS.
+    snprintf(path, sizeof(path), "%s/etc/initramfs-tools/modules", rootfs_path);
+    FILE *file = fopen(path, "a");
+    if (!file)
+    {
+        return -2;
+    }
+    int result = 0;
+    char names[COMMON_MAX_PATH_LENGTH];
+    snprintf(names, sizeof(names), "%s", is_list ? classes : "gpu");
+    char *saveptr;
+    for (char *name = strtok_r(names, " ", &saveptr); name && result == 0;
+         name = strtok_r(NULL, " ", &saveptr))
+    {
+        const InitramfsModuleClass *module_class = find_initramfs_module_class(name);
+        if (!module_class)
+        {
+            LOG_ERROR("Unknown initramfs module class: %s", name);
+            result = -1;
+        }
+        else if (append_initramfs_modules(file, module_class->modules) != 0)
+        {
+            result = -2;
+        }
+    }
+    if (fclose(file) != 0 && result == 0)
+    {
+        result = -2;
+    }
+
+    return result;
+}
+
+void report_initrd_size(const char *rootfs_path, const char *image_name)
+{
+    char path[COMMON_MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/boot/initrd.img", rootfs_path);
+    off_t size = get_file_size(path);
+    if (size < 0)
+    {
+        return;
+    }
+
+    // Compare with the last build of this image under the other policy.
+    const char *policy = build_options.initramfs_modules;
+    const char *other_policy = strcmp(policy, "list") == 0 ? "most" : "list";
+    long long other_size = read_initrd_size_record(image_name, other_policy);
+    double size_mib = (double)size / (1024.0 * 1024.0);
+    if (other_size > 0)
+    {
+        LOG_INFO(
+            "Initrd size (%s, MODULES=%s): %.1f MiB, %.1f MiB with MODULES=%s (%+.0f%%)",
+            image_name, policy, size_mib, (double)other_size / (1024.0 * 1024.0), other_policy,
+            ((double)size - (double)other_size) * 100.0 / (double)other_size
+        );
+    }
+    else
+    {
+        LOG_INFO(
+            "Initrd size (%s, MODULES=%s): %.1f MiB, no MODULES=%s build to compare with",
+            image_name, policy, size_mib, other_policy
+        );
+    }
+
+    write_initrd_size_record(image_name, policy, size);
+}
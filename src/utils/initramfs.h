@@ -0,0 +1,96 @@
+#pragma once
+#include "../all.h"
+
+/**
+ * A type representing a compressor for initramfs images.
+ *
+ * Holds the initramfs-tools COMPRESS name, the COMPRESSLEVEL it is used
+ * at, and the package that installs the compressor inside the rootfs.
+ */
+typedef struct
+{
+    const char *name;
+    const char *level;
+    const char *package;
+} InitramfsCodec;
+
+/**
+ * Finds an initramfs codec by name.
+ *
+ * @param name The codec name (e.g. "zstd").
+ *
+ * @return The codec, or NULL if no codec has that name.
+ */
+const InitramfsCodec *find_initramfs_codec(const char *name);
+
+/**
+ * Gets the initramfs codec selected for the current build.
+ *
+ * @return The selected codec. Options are validated at startup, so this never
+ * returns NULL during a build.
+ */
+const InitramfsCodec *get_initramfs_codec(void);
+
+/**
+ * Generates the initramfs for every kernel installed in a rootfs.
+ *
+ * Each image is keyed by a fingerprint of its inputs: the kernel version,
+ * the dpkg status database (package versions, hooks, and firmware), the
+ * configuration hooks copy into the image (initramfs-tools, modprobe,
+ * live-boot, udev rules, keymap and console font), and the Plymouth theme. A
+ * cached image with the same key is copied into /boot instead of running
+ * `update-initramfs`; otherwise the image is generated and stored in
+ * CONFIG_INITRAMFS_CACHE_DIR for later builds, dropping the least recently
+ * used images beyond CONFIG_INITRAMFS_CACHE_MAX_MIB. Cache failures only
+ * disable caching and never fail the build.
+ *
+ * @param rootfs_path The path to the rootfs directory.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates the kernel modules directory could not be read.
+ * @return - `-2` - Indicates initramfs generation failure.
+ * @return - `-3` - Indicates cached initramfs restoration failure.
+ */
+int generate_rootfs_initramfs(const char *rootfs_path);
+
+/**
+ * Checks that every name in a module class list is a known class.
+ *
+ * @param classes The space-separated class names (e.g. "storage nvme").
+ *
+ * @return - `0` - Indicates every class is known.
+ * @return - `-1` - Indicates an unknown class, which is logged.
+ */
+int validate_initramfs_classes(const char *classes);
+
+/**
+ * Configures which kernel modules an image's initramfs includes.
+ *
+ * Selects the module policy of --initramfs-modules with a conf.d drop-in.
+ * With the list policy, the modules of each declared class (storage, usb,
+ * input, virtio, nvme, gpu, live-media, root-fs) are appended to
+ * /etc/initramfs-tools/modules, which then names every module besides
+ * those initramfs hooks add themselves. With the most policy, only the GPU
+ * class is appended, for early KMS. Call this after package installation,
+ * since dpkg replaces the module list.
+ *
+ * @param rootfs_path The path to the rootfs directory.
+ * @param classes The space-separated module classes the image declares.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates an unknown module class.
+ * @return - `-2` - Indicates initramfs configuration write failure.
+ */
+int configure_initramfs_modules(const char *rootfs_path, const char *classes);
+
+/**
+ * Logs the size of an image's initrd against its other module policy.
+ *
+ * The size is recorded per image and policy in the initramfs cache, so a
+ * build compares its initrd with the last one of the same image built
+ * under the other policy.
+ *
+ * @param rootfs_path The path to the rootfs directory holding /boot/initrd.img.
+ * @param image_name The name of the image (e.g. "live").
+ */
+void report_initrd_size(const char *rootfs_path, const char *image_name);
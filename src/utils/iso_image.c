@@ -0,0 +1,464 @@
+/**
+ * This code is responsible for patching written ISO images, so data can be
+ * appended to them in place instead of being copied in by the ISO writer.
+ */
+
+#include "all.h"
+
+/** The ISO 9660 logical sector size. */
+#define ISO_IMAGE_SECTOR 2048
+
+/** The sector size of the MBR and GPT partition tables. */
+#define ISO_IMAGE_DISK_SECTOR 512
+
+/** The sector holding the first volume descriptor. */
+#define ISO_IMAGE_FIRST_DESCRIPTOR 16
+
+/** The volume descriptor types holding a directory tree. */
+#define ISO_IMAGE_PRIMARY_DESCRIPTOR 1
+#define ISO_IMAGE_SUPPLEMENTARY_DESCRIPTOR 2
+
+/** The volume descriptor type ending the descriptor set. */
+#define ISO_IMAGE_TERMINATOR_DESCRIPTOR 255
+
+/** The offset of the volume size in a volume descriptor. */
+#define ISO_IMAGE_VOLUME_SIZE_OFFSET 80
+
+/** The offset of the root directory record in a volume descriptor. */
+#define ISO_IMAGE_ROOT_RECORD_OFFSET 156
+
+/** The size of a directory record without its name. */
+#define ISO_IMAGE_RECORD_HEADER_SIZE 33
+
+/** The directory flag of a directory record. */
+#define ISO_IMAGE_RECORD_DIRECTORY 0x02
+
+/** The deepest directory nesting searched for placeholders. */
+#define ISO_IMAGE_MAX_DEPTH 64
+
+/** The text placeholder files start with. */
+#define ISO_IMAGE_PLACEHOLDER_MAGIC "limeos-iso-placeholder:"
+
+/** The number of random bytes in a volume ID. */
+#define ISO_IMAGE_VOLUME_ID_RANDOM_BYTES 4
+
+/** The size of a GPT partition table header. */
+#define ISO_IMAGE_GPT_HEADER_SIZE 92
+
+static int read_exact(int fd, off_t offset, void *buffer, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t result = pread(fd, (char *)buffer + done, size - done, offset + (off_t)done);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            return -1;
+        }
+        done += (size_t)result;
+    }
+    return 0;
+}
+
+static int write_exact(int fd, off_t offset, const void *buffer, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t result = pwrite(fd, (const char *)buffer + done, size - done, offset + (off_t)done);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            return -1;
+        }
+        done += (size_t)result;
+    }
+    return 0;
+}
+
+static uint32_t get_le32(const unsigned char *data)
+{
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8
+        | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static uint64_t get_le64(const unsigned char *data)
+{
+    return (uint64_t)get_le32(data) | (uint64_t)get_le32(data + 4) << 32;
+}
+
+static void put_le32(unsigned char *data, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        data[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static void put_le64(unsigned char *data, uint64_t value)
+{
+    put_le32(data, (uint32_t)value);
+    put_le32(data + 4, (uint32_t)(value >> 32));
+}
+
+static void put_both32(unsigned char *data, uint32_t value)
+{
+    // ISO 9660 stores numbers little-endian, then again big-endian.
+    put_le32(data, value);
+    for (int i = 0; i < 4; i++)
+    {
+        data[4 + i] = (unsigned char)(value >> (8 * (3 - i)));
+    }
+}
+
+static uint32_t get_crc32(const unsigned char *data, size_t size)
+{
+    // Compute the CRC-32 that GPT headers and partition arrays carry.
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static void get_placeholder_marker(const char *name, char *out_marker, size_t out_size)
+{
+    snprintf(out_marker, out_size, ISO_IMAGE_PLACEHOLDER_MAGIC "%s\n", name);
+}
+
+static int read_descriptor(int fd, int index, unsigned char *out_descriptor)
+{
+    // Read a volume descriptor, stopping at the end of the set.
+    off_t offset = (off_t)(ISO_IMAGE_FIRST_DESCRIPTOR + index) * ISO_IMAGE_SECTOR;
+    if (read_exact(fd, offset, out_descriptor, ISO_IMAGE_SECTOR) != 0
+        || memcmp(out_descriptor + 1, "CD001", 5) != 0)
+    {
+        return -1;
+    }
+    return out_descriptor[0] == ISO_IMAGE_TERMINATOR_DESCRIPTOR ? 1 : 0;
+}
+
+static int is_placeholder(int fd, uint32_t extent, const char *marker)
+{
+    char contents[COMMON_MAX_PATH_LENGTH];
+    size_t length = strlen(marker);
+    return read_exact(fd, (off_t)extent * ISO_IMAGE_SECTOR, contents, length) == 0
+        && memcmp(contents, marker, length) == 0;
+}
+
+static int patch_directory(
+    int fd, uint32_t extent, uint32_t length, const char *marker,
+    off_t offset, off_t size, int depth
+)
+{
+    unsigned char *records = malloc(length);
+    if (!records || read_exact(fd, (off_t)extent * ISO_IMAGE_SECTOR, records, length) != 0)
+    {
+        free(records);
+        return -1;
+    }
+
+    // Visit every record, which never crosses a sector boundary.
+    int found = 0;
+    uint32_t position = 0;
+    while (found >= 0 && position + ISO_IMAGE_RECORD_HEADER_SIZE < length)
+    {
+        unsigned char *record = records + position;
+        uint32_t record_length = record[0];
+        if (record_length == 0)
+        {
+            position = (position / ISO_IMAGE_SECTOR + 1) * ISO_IMAGE_SECTOR;
+            continue;
+        }
+        if (record_length <= ISO_IMAGE_RECORD_HEADER_SIZE || position + record_length > length)
+        {
+            break;
+        }
+        position += record_length;
+
+        // Skip the self and parent records.
+        if (record[32] == 1 && record[33] <= 1)
+        {
+            continue;
+        }
+
+        // Search subdirectories, and point matching placeholders at the data.
+        uint32_t record_extent = get_le32(record + 2);
+        uint32_t record_size = get_le32(record + 10);
+        if (record[25] & ISO_IMAGE_RECORD_DIRECTORY)
+        {
+            int result = depth < ISO_IMAGE_MAX_DEPTH
+                ? patch_directory(fd, record_extent, record_size, marker, offset, size, depth + 1)
+                : 0;
+            found = result < 0 ? result : found + result;
+        }
+        else if (record_size == strlen(marker) && is_placeholder(fd, record_extent, marker))
+        {
+            put_both32(record + 2, (uint32_t)(offset / ISO_IMAGE_SECTOR));
+            put_both32(record + 10, (uint32_t)size);
+            off_t record_offset = (off_t)extent * ISO_IMAGE_SECTOR + (record - records);
+            found = write_exact(fd, record_offset + 2, record + 2, 16) == 0 ? found + 1 : -1;
+        }
+    }
+    free(records);
+
+    return found;
+}
+
+int create_iso_placeholder(const char *path, const char *name)
+{
+    char marker[COMMON_MAX_PATH_LENGTH];
+    get_placeholder_marker(name, marker, sizeof(marker));
+    return common.write_file(path, marker) == 0 ? 0 : -1;
+}
+
+int get_iso_append_offset(const char *iso_path, off_t *out_offset)
+{
+    struct stat st;
+    if (stat(iso_path, &st) != 0)
+    {
+        return -1;
+    }
+
+    // Start on the next whole ISO sector.
+    *out_offset = (st.st_size + ISO_IMAGE_SECTOR - 1) / ISO_IMAGE_SECTOR * ISO_IMAGE_SECTOR;
+
+    return 0;
+}
+
+int create_iso_volume_id(char *out_id, size_t out_size)
+{
+    // Read the random part of the ID.
+    unsigned char random[ISO_IMAGE_VOLUME_ID_RANDOM_BYTES];
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int result = read_exact(fd, 0, random, sizeof(random));
+    close(fd);
+    if (result != 0)
+    {
+        return -1;
+    }
+
+    // Append it to the prefix as uppercase hexadecimal digits.
+    snprintf(
+        out_id, out_size, CONFIG_ISO_VOLUME_ID_PREFIX "%02X%02X%02X%02X",
+        random[0], random[1], random[2], random[3]
+    );
+
+    return 0;
+}
+
+int set_iso_placeholder_extent(
+    const char *iso_path, const char *name, off_t offset, off_t size
+)
+{
+    // Larger files would need multi-extent records.
+    if (size > (off_t)UINT32_MAX)
+    {
+        return -3;
+    }
+
+    int fd = open(iso_path, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    // Patch the placeholder in each directory tree.
+    char marker[COMMON_MAX_PATH_LENGTH];
+    get_placeholder_marker(name, marker, sizeof(marker));
+    unsigned char descriptor[ISO_IMAGE_SECTOR];
+    int found = 0;
+    int end = 0;
+    for (int i = 0; found >= 0 && (end = read_descriptor(fd, i, descriptor)) == 0; i++)
+    {
+        if (descriptor[0] != ISO_IMAGE_PRIMARY_DESCRIPTOR
+            && descriptor[0] != ISO_IMAGE_SUPPLEMENTARY_DESCRIPTOR)
+        {
+            continue;
+        }
+        const unsigned char *root = descriptor + ISO_IMAGE_ROOT_RECORD_OFFSET;
+        int result = patch_directory(
+            fd, get_le32(root + 2), get_le32(root + 10), marker, offset, size, 0
+        );
+        found = result < 0 ? result : found + result;
+    }
+    close(fd);
+
+    if (found < 0 || end < 0)
+    {
+        return -1;
+    }
+    return found > 0 ? 0 : -2;
+}
+
+static int resize_descriptors(int fd, off_t new_size)
+{
+    // Record the new size in every volume descriptor.
+    unsigned char descriptor[ISO_IMAGE_SECTOR];
+    int end = 0;
+    for (int i = 0; (end = read_descriptor(fd, i, descriptor)) == 0; i++)
+    {
+        if (descriptor[0] != ISO_IMAGE_PRIMARY_DESCRIPTOR
+            && descriptor[0] != ISO_IMAGE_SUPPLEMENTARY_DESCRIPTOR)
+        {
+            continue;
+        }
+        put_both32(descriptor + ISO_IMAGE_VOLUME_SIZE_OFFSET, (uint32_t)(new_size / ISO_IMAGE_SECTOR));
+        off_t offset = (off_t)(ISO_IMAGE_FIRST_DESCRIPTOR + i) * ISO_IMAGE_SECTOR;
+        if (write_exact(fd, offset + ISO_IMAGE_VOLUME_SIZE_OFFSET, descriptor + ISO_IMAGE_VOLUME_SIZE_OFFSET, 8) != 0)
+        {
+            return -1;
+        }
+    }
+
+    return end < 0 ? -1 : 0;
+}
+
+static void resize_mbr(unsigned char *mbr, off_t old_size, off_t new_size)
+{
+    if (mbr[510] != 0x55 || mbr[511] != 0xAA)
+    {
+        return;
+    }
+
+    // Extend the partitions reaching the old end, such as the hybrid ISO
+    // partition or the GPT protective partition.
+    uint64_t old_sectors = (uint64_t)old_size / ISO_IMAGE_DISK_SECTOR;
+    uint64_t new_sectors = (uint64_t)new_size / ISO_IMAGE_DISK_SECTOR;
+    for (int i = 0; i < 4; i++)
+    {
+        unsigned char *entry = mbr + 446 + 16 * i;
+        uint64_t start = get_le32(entry + 8);
+        uint64_t count = get_le32(entry + 12);
+        if (entry[4] == 0 || start + count < old_sectors || start >= new_sectors)
+        {
+            continue;
+        }
+        uint64_t new_count = new_sectors - start;
+        put_le32(entry + 12, new_count > UINT32_MAX ? UINT32_MAX : (uint32_t)new_count);
+    }
+}
+
+static int resize_gpt(int fd, unsigned char *header, off_t new_size)
+{
+    uint32_t header_size = get_le32(header + 12);
+    uint64_t entries_lba = get_le64(header + 72);
+    uint32_t entry_count = get_le32(header + 80);
+    uint32_t entry_size = get_le32(header + 84);
+    if (header_size < ISO_IMAGE_GPT_HEADER_SIZE || header_size > ISO_IMAGE_DISK_SECTOR
+        || entry_size < 128 || entry_count == 0 || entry_count > 1024)
+    {
+        return -2;
+    }
+
+    // Read the partition array following the primary header.
+    size_t entries_size = (size_t)entry_count * entry_size;
+    uint64_t entries_sectors = (entries_size + ISO_IMAGE_DISK_SECTOR - 1) / ISO_IMAGE_DISK_SECTOR;
+    unsigned char *entries = calloc(entries_sectors, ISO_IMAGE_DISK_SECTOR);
+    if (!entries || read_exact(fd, (off_t)entries_lba * ISO_IMAGE_DISK_SECTOR, entries, entries_size) != 0)
+    {
+        free(entries);
+        return -1;
+    }
+
+    // Move the backup to the new end and extend the partitions that
+    // reached the old last usable sector.
+    uint64_t old_last_usable = get_le64(header + 48);
+    uint64_t backup_lba = (uint64_t)new_size / ISO_IMAGE_DISK_SECTOR - 1;
+    uint64_t last_usable = backup_lba - entries_sectors - 1;
+    for (uint32_t i = 0; i < entry_count; i++)
+    {
+        unsigned char *entry = entries + (size_t)i * entry_size;
+        if (get_le64(entry + 40) >= old_last_usable && get_le64(entry + 32) != 0)
+        {
+            put_le64(entry + 40, last_usable);
+        }
+    }
+    put_le64(header + 32, backup_lba);
+    put_le64(header + 48, last_usable);
+    put_le32(header + 88, get_crc32(entries, entries_size));
+    put_le32(header + 16, 0);
+    put_le32(header + 16, get_crc32(header, header_size));
+
+    // Build the backup header, which points the other way.
+    unsigned char backup[ISO_IMAGE_DISK_SECTOR];
+    memcpy(backup, header, sizeof(backup));
+    put_le64(backup + 24, backup_lba);
+    put_le64(backup + 32, 1);
+    put_le64(backup + 72, backup_lba - entries_sectors);
+    put_le32(backup + 16, 0);
+    put_le32(backup + 16, get_crc32(backup, header_size));
+
+    // Write the primary table, then the backup at the end.
+    int result = write_exact(fd, ISO_IMAGE_DISK_SECTOR, header, ISO_IMAGE_DISK_SECTOR) == 0
+        && write_exact(fd, (off_t)entries_lba * ISO_IMAGE_DISK_SECTOR, entries, entries_size) == 0
+        && write_exact(fd, (off_t)(backup_lba - entries_sectors) * ISO_IMAGE_DISK_SECTOR, entries, entries_size) == 0
+        && write_exact(fd, (off_t)backup_lba * ISO_IMAGE_DISK_SECTOR, backup, sizeof(backup)) == 0
+        ? 0 : -1;
+    free(entries);
+
+    return result;
+}
+
+int resize_iso_image(const char *iso_path, off_t old_size, off_t data_end)
+{
+    int fd = open(iso_path, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    // Read the MBR and the GPT header that may follow it.
+    unsigned char tables[2 * ISO_IMAGE_DISK_SECTOR];
+    if (read_exact(fd, 0, tables, sizeof(tables)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    unsigned char *gpt_header = tables + ISO_IMAGE_DISK_SECTOR;
+    int has_gpt = memcmp(gpt_header, "EFI PART", 8) == 0;
+
+    // Leave room after the data for a backup GPT, ending on a whole sector.
+    off_t reserved = 0;
+    if (has_gpt)
+    {
+        uint64_t entries_size = (uint64_t)get_le32(gpt_header + 80) * get_le32(gpt_header + 84);
+        reserved = (off_t)((entries_size + ISO_IMAGE_DISK_SECTOR - 1) / ISO_IMAGE_DISK_SECTOR + 1)
+            * ISO_IMAGE_DISK_SECTOR;
+    }
+    off_t new_size = (data_end + reserved + ISO_IMAGE_SECTOR - 1) / ISO_IMAGE_SECTOR * ISO_IMAGE_SECTOR;
+
+    // Grow the file, then every structure recording the image size.
+    int result = ftruncate(fd, new_size) == 0 && resize_descriptors(fd, new_size) == 0 ? 0 : -1;
+    if (result == 0)
+    {
+        resize_mbr(tables, old_size, new_size);
+        result = write_exact(fd, 0, tables, ISO_IMAGE_DISK_SECTOR) == 0 ? 0 : -1;
+    }
+    if (result == 0 && has_gpt)
+    {
+        result = resize_gpt(fd, gpt_header, new_size);
+    }
+    if (close(fd) != 0 && result == 0)
+    {
+        result = -1;
+    }
+
+    return result;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "../all.h"
+
+/** The buffer size a volume ID needs, including its terminator. */
+#define ISO_VOLUME_ID_SIZE 33
+
+/**
+ * Writes a placeholder file for data that is appended to an ISO later.
+ *
+ * The placeholder holds a short marker naming it, so its directory records
+ * can be found in the written ISO regardless of how names were mangled.
+ *
+ * @param path The path of the placeholder file to write.
+ * @param name The name identifying the placeholder.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates write failure.
+ */
+int create_iso_placeholder(const char *path, const char *name);
+
+/**
+ * Gets the offset at which data can be appended to an ISO image.
+ *
+ * @param iso_path The path of the ISO image.
+ * @param out_offset The offset of the first free sector after the image.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates image read failure.
+ */
+int get_iso_append_offset(const char *iso_path, off_t *out_offset);
+
+/**
+ * Creates a volume ID unique to one build.
+ *
+ * The ID is CONFIG_ISO_VOLUME_ID_PREFIX followed by random hexadecimal
+ * digits, so it is a valid ISO 9660 volume ID and a udev label link name
+ * that needs no escaping.
+ *
+ * @param out_id The buffer receiving the volume ID.
+ * @param out_size The size of the output buffer, at least
+ * ISO_VOLUME_ID_SIZE bytes.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates random source read failure.
+ */
+int create_iso_volume_id(char *out_id, size_t out_size);
+
+/**
+ * Points a placeholder's directory records at data appended to an ISO.
+ *
+ * Every ISO 9660 directory tree of the image (primary and Joliet) is
+ * searched, and each record of the placeholder gets the new extent and size.
+ *
+ * @param iso_path The path of the ISO image.
+ * @param name The name the placeholder was created with.
+ * @param offset The sector-aligned offset of the appended data.
+ * @param size The size of the appended data.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates image read or write failure.
+ * @return - `-2` - Indicates the placeholder was not found.
+ * @return - `-3` - Indicates data too large for a single extent (4 GiB).
+ */
+int set_iso_placeholder_extent(
+    const char *iso_path, const char *name, off_t offset, off_t size
+);
+
+/**
+ * Grows an ISO image over data appended after its end.
+ *
+ * Updates the volume size in every volume descriptor, extends the MBR and
+ * GPT partitions that reached the old end of the image, and writes the
+ * backup GPT at the new end, as GRUB's hybrid images need.
+ *
+ * @param iso_path The path of the ISO image.
+ * @param old_size The size of the image before data was appended.
+ * @param data_end The end of the appended data.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates image read or write failure.
+ * @return - `-2` - Indicates an invalid GPT.
+ */
+int resize_iso_image(const char *iso_path, off_t old_size, off_t data_end);
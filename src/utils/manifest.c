@@ -0,0 +1,362 @@
+/**
+ * This code is responsible for walking a directory tree once into an
+ * in-memory manifest shared by fingerprinting and image writing.
+ */
+
+#define _GNU_SOURCE
+#include "all.h"
+
+/** A type representing the state of one tree walk. */
+typedef struct
+{
+    size_t root_length;
+    dev_t device;
+    void *hardlinks;
+    const char *const *excluded_paths;
+    int excluded_count;
+} ManifestWalk;
+
+static int compare_inodes(const void *a, const void *b)
+{
+    const ManifestEntry *first = a;
+    const ManifestEntry *second = b;
+
+    if (first->st.st_dev != second->st.st_dev)
+    {
+        return first->st.st_dev < second->st.st_dev ? -1 : 1;
+    }
+    if (first->st.st_ino != second->st.st_ino)
+    {
+        return first->st.st_ino < second->st.st_ino ? -1 : 1;
+    }
+    return 0;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    const ManifestEntry *first = *(const ManifestEntry *const *)a;
+    const ManifestEntry *second = *(const ManifestEntry *const *)b;
+
+    // Compare bytes, regardless of locale, as image formats expect.
+    return strcmp(first->name, second->name);
+}
+
+static void keep_entry(void *entry)
+{
+    (void)entry;
+}
+
+static void free_entry(ManifestEntry *entry)
+{
+    for (int i = 0; i < entry->child_count; i++)
+    {
+        free_entry(entry->children[i]);
+    }
+    for (int i = 0; i < entry->xattr_count; i++)
+    {
+        free(entry->xattrs[i].name);
+        free(entry->xattrs[i].value);
+    }
+    free(entry->xattrs);
+    free(entry->children);
+    free(entry->target);
+    free(entry->path);
+    free(entry);
+}
+
+static ssize_t read_xattr_data(const char *path, const char *name, char **out_data)
+{
+    // List the names when no name is given, or read the named value.
+    *out_data = NULL;
+    for (;;)
+    {
+        // Size the buffer first, and start over if the data grows before it
+        // is read.
+        ssize_t size = name ? lgetxattr(path, name, NULL, 0) : llistxattr(path, NULL, 0);
+        if (size < 0)
+        {
+            free(*out_data);
+            *out_data = NULL;
+            return -1;
+        }
+        char *data = realloc(*out_data, size > 0 ? (size_t)size : 1);
+        if (!data)
+        {
+            free(*out_data);
+            *out_data = NULL;
+            errno = ENOMEM;
+            return -1;
+        }
+        *out_data = data;
+
+        ssize_t length = name
+            ? lgetxattr(path, name, data, (size_t)size)
+            : llistxattr(path, data, (size_t)size);
+        if (length >= 0)
+        {
+            return length;
+        }
+        if (errno != ERANGE)
+        {
+            free(*out_data);
+            *out_data = NULL;
+            return -1;
+        }
+    }
+}
+
+static int read_xattrs(ManifestEntry *entry)
+{
+    // List the extended attribute names, which may be none.
+    char *names;
+    ssize_t length = read_xattr_data(entry->path, NULL, &names);
+    if (length < 0)
+    {
+        return errno == ENOTSUP ? 0 : -1;
+    }
+
+    // Keep each name and value, in the order the filesystem lists them.
+    int result = 0;
+    for (ssize_t offset = 0; result == 0 && offset < length; offset += strlen(names + offset) + 1)
+    {
+        char *value;
+        ssize_t value_length = read_xattr_data(entry->path, names + offset, &value);
+        if (value_length < 0)
+        {
+            // Skip attributes removed since they were listed.
+            result = errno == ENODATA ? 0 : -1;
+            continue;
+        }
+
+        ManifestXattr *xattrs = realloc(
+            entry->xattrs, (entry->xattr_count + 1) * sizeof(*xattrs)
+        );
+        if (!xattrs)
+        {
+            free(value);
+            result = -1;
+            break;
+        }
+        entry->xattrs = xattrs;
+
+        ManifestXattr *xattr = &entry->xattrs[entry->xattr_count];
+        xattr->name = strdup(names + offset);
+        xattr->value = value;
+        xattr->size = (size_t)value_length;
+        entry->xattr_count++;
+        if (!xattr->name)
+        {
+            result = -1;
+        }
+    }
+    free(names);
+
+    return result;
+}
+
+static int is_excluded(const ManifestWalk *walk, const char *path)
+{
+    for (int i = 0; i < walk->excluded_count; i++)
+    {
+        if (strcmp(path + walk->root_length, walk->excluded_paths[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static ManifestEntry *read_entry(ManifestWalk *walk, const char *path, size_t name_offset);
+
+static int read_children(ManifestWalk *walk, ManifestEntry *entry)
+{
+    DIR *directory = opendir(entry->path);
+    if (!directory)
+    {
+        LOG_ERROR("Failed to read %s", entry->path);
+        return -1;
+    }
+
+    // Read every entry except the self and parent links.
+    int capacity = 0;
+    int result = 0;
+    struct dirent *child_entry;
+    while (result == 0 && (child_entry = readdir(directory)) != NULL)
+    {
+        const char *name = child_entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        {
+            continue;
+        }
+
+        // Leave out excluded entries, along with everything below them.
+        char child_path[COMMON_MAX_PATH_LENGTH];
+        snprintf(child_path, sizeof(child_path), "%s/%s", entry->path, name);
+        if (is_excluded(walk, child_path))
+        {
+            continue;
+        }
+
+        if (entry->child_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+            ManifestEntry **children = realloc(entry->children, capacity * sizeof(*children));
+            if (!children)
+            {
+                result = -1;
+                break;
+            }
+            entry->children = children;
+        }
+
+        ManifestEntry *child = read_entry(walk, child_path, strlen(entry->path) + 1);
+        if (!child)
+        {
+            result = -1;
+            break;
+        }
+        entry->children[entry->child_count++] = child;
+    }
+    closedir(directory);
+
+    qsort(entry->children, entry->child_count, sizeof(*entry->children), compare_names);
+
+    return result;
+}
+
+static ManifestEntry *read_entry(ManifestWalk *walk, const char *path, size_t name_offset)
+{
+    ManifestEntry *entry = calloc(1, sizeof(*entry));
+    if (!entry)
+    {
+        return NULL;
+    }
+    entry->path = strdup(path);
+    entry->link_count = 1;
+    if (!entry->path || lstat(path, &entry->st) != 0 || read_xattrs(entry) != 0)
+    {
+        LOG_ERROR("Failed to read %s", path);
+        free_entry(entry);
+        return NULL;
+    }
+    entry->name = entry->path + name_offset;
+    entry->relative_path = entry->path + walk->root_length;
+
+    // Keep symbolic link targets.
+    if (S_ISLNK(entry->st.st_mode))
+    {
+        char target[COMMON_MAX_PATH_LENGTH];
+        ssize_t length = readlink(path, target, sizeof(target) - 1);
+        if (length >= 0)
+        {
+            target[length] = '\0';
+            entry->target = strdup(target);
+        }
+        if (!entry->target)
+        {
+            LOG_ERROR("Failed to read %s", path);
+            free_entry(entry);
+            return NULL;
+        }
+    }
+
+    // Descend into directories on the same filesystem.
+    if (S_ISDIR(entry->st.st_mode) && entry->st.st_dev == walk->device
+        && read_children(walk, entry) != 0)
+    {
+        free_entry(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+static int link_entries(ManifestWalk *walk, ManifestEntry *entry)
+{
+    // Point further names of a hardlinked file at the first one in sorted
+    // order, so the choice does not depend on the order of readdir().
+    if (S_ISREG(entry->st.st_mode) && entry->st.st_nlink > 1)
+    {
+        ManifestEntry **found = tsearch(entry, &walk->hardlinks, compare_inodes);
+        if (!found)
+        {
+            return -1;
+        }
+        if (*found != entry)
+        {
+            entry->link = *found;
+            entry->link->link_count++;
+        }
+    }
+
+    for (int i = 0; i < entry->child_count; i++)
+    {
+        if (link_entries(walk, entry->children[i]) != 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void number_entries(ManifestEntry *entry, int *count)
+{
+    entry->index = (*count)++;
+    for (int i = 0; i < entry->child_count; i++)
+    {
+        number_entries(entry->children[i], count);
+    }
+}
+
+int create_manifest(
+    const char *root_path, const char *const *excluded_paths, int excluded_count,
+    Manifest *out_manifest
+)
+{
+    struct stat st;
+    if (lstat(root_path, &st) != 0)
+    {
+        LOG_ERROR("Failed to read %s", root_path);
+        return -1;
+    }
+
+    ManifestWalk walk = {
+        .root_length = strlen(root_path),
+        .device = st.st_dev,
+        .hardlinks = NULL,
+        .excluded_paths = excluded_paths,
+        .excluded_count = excluded_count
+    };
+    out_manifest->root = read_entry(&walk, root_path, walk.root_length);
+    out_manifest->count = 0;
+    if (!out_manifest->root)
+    {
+        return -1;
+    }
+
+    // Resolve hardlinks once every directory is sorted.
+    int result = link_entries(&walk, out_manifest->root);
+    tdestroy(walk.hardlinks, keep_entry);
+    if (result != 0)
+    {
+        LOG_ERROR("Failed to read %s", root_path);
+        free_manifest(out_manifest);
+        return -1;
+    }
+
+    // Number entries in sorted pre-order.
+    number_entries(out_manifest->root, &out_manifest->count);
+
+    return 0;
+}
+
+void free_manifest(Manifest *manifest)
+{
+    if (manifest->root)
+    {
+        free_entry(manifest->root);
+    }
+    manifest->root = NULL;
+    manifest->count = 0;
+}
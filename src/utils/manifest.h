@@ -0,0 +1,72 @@
+#pragma once
+#include "../all.h"
+
+/** A type representing one extended attribute of a manifest entry. */
+typedef struct
+{
+    char *name;
+    void *value;
+    size_t size;
+} ManifestXattr;
+
+/** A type representing one file, directory, or special file of a tree. */
+typedef struct ManifestEntry
+{
+    int index;
+    char *path;
+    const char *name;
+    const char *relative_path;
+    struct stat st;
+    char *target;
+    ManifestXattr *xattrs;
+    int xattr_count;
+    struct ManifestEntry **children;
+    int child_count;
+    struct ManifestEntry *link;
+    int link_count;
+} ManifestEntry;
+
+/**
+ * A type representing a directory tree read once into memory.
+ *
+ * Entries are numbered in pre-order from 0 (the root) to `count - 1`, so
+ * consumers can keep per-entry state in arrays. Relative paths start with a
+ * slash (e.g. `/etc/hostname`); the root's is empty.
+ */
+typedef struct
+{
+    ManifestEntry *root;
+    int count;
+} Manifest;
+
+/**
+ * Reads a directory tree into a manifest.
+ *
+ * The tree is walked physically without crossing mount points, recording
+ * each entry's metadata, symbolic link target, and extended attributes.
+ * Directory entries are sorted in byte order. Further names of a hardlinked
+ * file point at the first one in that order, which counts them.
+ *
+ * Excluded paths are relative paths as the manifest records them (e.g.
+ * `/boot/vmlinuz`). An excluded entry is left out together with everything
+ * below it.
+ *
+ * @param root_path The directory to read.
+ * @param excluded_paths The relative paths to leave out, or NULL.
+ * @param excluded_count The number of excluded paths.
+ * @param out_manifest The manifest to fill in.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates tree read or allocation failure.
+ */
+int create_manifest(
+    const char *root_path, const char *const *excluded_paths, int excluded_count,
+    Manifest *out_manifest
+);
+
+/**
+ * Releases a manifest.
+ *
+ * @param manifest The manifest to release.
+ */
+void free_manifest(Manifest *manifest);
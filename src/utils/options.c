@@ -0,0 +1,23 @@
+/**
+ * This code is responsible for holding the runtime options of the build.
+ */
+
+#include "all.h"
+
+BuildOptions build_options = {
+    .unsafe_io = 0,
+    .layered = 0,
+    .boot_trace = 0,
+    .ram_budget_mib = 0,
+    .payload_codec = CONFIG_PAYLOAD_CODEC,
+    .payload_format = CONFIG_PAYLOAD_FORMAT,
+    .payload_placement = CONFIG_PAYLOAD_PLACEMENT,
+    .squashfs_profile = CONFIG_SQUASHFS_PROFILE,
+    .squashfs_writer = CONFIG_SQUASHFS_WRITER,
+    .squashfs_sort = NULL,
+    .assembly_mode = CONFIG_ASSEMBLY_MODE,
+    .grub_profile = CONFIG_GRUB_PROFILE,
+    .efi_boot = CONFIG_EFI_BOOT,
+    .initramfs_modules = CONFIG_INITRAMFS_MODULES,
+    .initramfs_codec = CONFIG_INITRAMFS_CODEC
+};
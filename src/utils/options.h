@@ -0,0 +1,30 @@
+#pragma once
+#include "../all.h"
+
+/** A type representing the runtime options selected on the command line. */
+typedef struct
+{
+    int unsafe_io;
+    int layered;
+    int boot_trace;
+    long ram_budget_mib;
+    const char *payload_codec;
+    const char *payload_format;
+    const char *payload_placement;
+    const char *squashfs_profile;
+    const char *squashfs_writer;
+    const char *squashfs_sort;
+    const char *assembly_mode;
+    const char *grub_profile;
+    const char *efi_boot;
+    const char *initramfs_modules;
+    const char *initramfs_codec;
+} BuildOptions;
+
+/**
+ * The runtime options for the current build.
+ *
+ * Populated by main() before any phase runs and treated as read-only
+ * afterwards. Scheduler tasks inherit it when they are forked.
+ */
+extern BuildOptions build_options;
@@ -0,0 +1,89 @@
+/**
+ * This code is responsible for describing the formats and codecs the target
+ * payload can be stored with and where the payload is stored.
+ */
+
+#include "all.h"
+
+/** The supported payload codecs. */
+static const PayloadCodec PAYLOAD_CODECS[] = {
+    { "gzip", ".gz", "pigz", "pigz -6", "gzip -6", "-comp gzip", "-zdeflate" },
+    { "zstd", ".zst", "zstd", "zstd -T0 -12", NULL, "-comp zstd -Xcompression-level 15", "-zzstd" },
+    { "xz", ".xz", "xz", "xz -T0 -6", NULL, "-comp xz", "-zlzma" }
+};
+
+/** The number of supported payload codecs. */
+#define PAYLOAD_CODECS_COUNT \
+    (int)(sizeof(PAYLOAD_CODECS) / sizeof(PAYLOAD_CODECS[0]))
+
+/** The supported payload formats. */
+static const PayloadFormat PAYLOAD_FORMATS[] = {
+    { "tar", ".tar", NULL, 0, 0 },
+    { "chunked", ARCHIVER_INDEX_EXTENSION, NULL, 0, 1 },
+    { "squashfs", ".squashfs", "mksquashfs", 1, 0 },
+    { "erofs", ".erofs", "mkfs.erofs", 1, 0 }
+};
+
+/** The number of supported payload formats. */
+#define PAYLOAD_FORMATS_COUNT \
+    (int)(sizeof(PAYLOAD_FORMATS) / sizeof(PAYLOAD_FORMATS[0]))
+
+const PayloadCodec *find_payload_codec(const char *name)
+{
+    for (int i = 0; i < PAYLOAD_CODECS_COUNT; i++)
+    {
+        if (strcmp(PAYLOAD_CODECS[i].name, name) == 0)
+        {
+            return &PAYLOAD_CODECS[i];
+        }
+    }
+    return NULL;
+}
+
+const PayloadCodec *get_payload_codec(void)
+{
+    return find_payload_codec(build_options.payload_codec);
+}
+
+const char *get_payload_compressor(const PayloadCodec *codec)
+{
+    if (common.is_command_available(codec->command))
+    {
+        return codec->compressor;
+    }
+    return codec->fallback_compressor;
+}
+
+const PayloadFormat *find_payload_format(const char *name)
+{
+    for (int i = 0; i < PAYLOAD_FORMATS_COUNT; i++)
+    {
+        if (strcmp(PAYLOAD_FORMATS[i].name, name) == 0)
+        {
+            return &PAYLOAD_FORMATS[i];
+        }
+    }
+    return NULL;
+}
+
+const PayloadFormat *get_payload_format(void)
+{
+    return find_payload_format(build_options.payload_format);
+}
+
+void get_target_payload_name(char *out_name, size_t out_size)
+{
+    const PayloadFormat *format = get_payload_format();
+    snprintf(
+        out_name, out_size, CONFIG_TARGET_PAYLOAD_NAME "%s%s",
+        format->extension,
+        format->is_image || format->is_chunked ? "" : get_payload_codec()->extension
+    );
+}
+
+void get_target_payload_path(const char *root, char *out_path, size_t out_size)
+{
+    char name[COMMON_MAX_PATH_LENGTH];
+    get_target_payload_name(name, sizeof(name));
+    snprintf(out_path, out_size, "%s" CONFIG_TARGET_PAYLOAD_DIR "/%s", root, name);
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "../all.h"
+
+/** A type representing a compression codec for the target payload. */
+typedef struct
+{
+    const char *name;
+    const char *extension;
+    const char *command;
+    const char *compressor;
+    const char *fallback_compressor;
+    const char *squashfs_options;
+    const char *erofs_options;
+} PayloadCodec;
+
+/** A type representing a container format for the target payload. */
+typedef struct
+{
+    const char *name;
+    const char *extension;
+    const char *command;
+    int is_image;
+    int is_chunked;
+} PayloadFormat;
+
+/**
+ * Finds a payload codec by name.
+ *
+ * @param name The codec name (e.g. "zstd").
+ *
+ * @return The codec, or NULL if no codec has that name.
+ */
+const PayloadCodec *find_payload_codec(const char *name);
+
+/**
+ * Gets the payload codec selected for the current build.
+ *
+ * @return The selected codec. Options are validated at startup, so this never
+ * returns NULL during a build.
+ */
+const PayloadCodec *get_payload_codec(void);
+
+/**
+ * Gets the compressor command line for a payload codec.
+ *
+ * Prefers the codec's multi-threaded compressor and falls back to its
+ * single-threaded one when the former is not installed.
+ *
+ * @param codec The payload codec.
+ *
+ * @return The compressor command line, or NULL if neither is available.
+ */
+const char *get_payload_compressor(const PayloadCodec *codec);
+
+/**
+ * Finds a payload format by name.
+ *
+ * @param name The format name (e.g. "squashfs").
+ *
+ * @return The format, or NULL if no format has that name.
+ */
+const PayloadFormat *find_payload_format(const char *name);
+
+/**
+ * Gets the payload format selected for the current build.
+ *
+ * @return The selected format. Options are validated at startup, so this
+ * never returns NULL during a build.
+ */
+const PayloadFormat *get_payload_format(void);
+
+/**
+ * Builds the file name of the target payload for the selected format.
+ *
+ * Tarballs carry the codec extension (e.g. "rootfs.tar.gz"), while images
+ * compress internally and only carry the format's (e.g. "rootfs.squashfs").
+ * Chunked payloads are named after their index (e.g. "rootfs.index").
+ *
+ * @param out_name The buffer receiving the file name.
+ * @param out_size The size of the output buffer.
+ */
+void get_target_payload_name(char *out_name, size_t out_size);
+
+/**
+ * Builds the path of the target payload for the selected format and codec.
+ *
+ * @param root The directory the payload path is relative to (a rootfs, or
+ * an empty string for the path as seen by the installer).
+ * @param out_path The buffer receiving the path.
+ * @param out_size The size of the output buffer.
+ */
+void get_target_payload_path(const char *root, char *out_path, size_t out_size);
@@ -0,0 +1,124 @@
+/**
+ * This code is responsible for placing build directories in a RAM-backed
+ * tmpfs within a memory budget, spilling the rest to disk.
+ */
+
+#include "all.h"
+
+long get_available_memory_mib(void)
+{
+    FILE *meminfo = fopen("/proc/meminfo", "r");
+    if (!meminfo)
+    {
+        return -1;
+    }
+
+    // Find the MemAvailable line, reported in KiB.
+    char line[256];
+    long available_kib = -1;
+    while (fgets(line, sizeof(line), meminfo))
+    {
+        if (sscanf(line, "MemAvailable: %ld kB", &available_kib) == 1)
+        {
+            break;
+        }
+    }
+    fclose(meminfo);
+
+    return available_kib < 0 ? -1 : available_kib / 1024;
+}
+
+long mount_ramdisk(
+    const char *build_dir, long budget_mib, char *out_path, size_t out_size
+)
+{
+    // Cap the budget to what the host can spare.
+    long available_mib = get_available_memory_mib();
+    if (available_mib >= 0)
+    {
+        long spare_mib = available_mib - CONFIG_RAM_RESERVE_MIB;
+        if (spare_mib < budget_mib)
+        {
+            LOG_WARNING(
+                "Only %ld MiB of RAM can be spared, reducing budget from %ld MiB",
+                spare_mib > 0 ? spare_mib : 0, budget_mib
+            );
+            budget_mib = spare_mib;
+        }
+    }
+    if (budget_mib <= 0)
+    {
+        return -1;
+    }
+
+    // Create the mount point.
+    snprintf(out_path, out_size, "%s/" RAMDISK_DIR_NAME, build_dir);
+    if (common.mkdir_p(out_path) != 0)
+    {
+        return -2;
+    }
+
+    // Mount the tmpfs, sized to the budget so underestimates still fit.
+    char quoted_path[COMMON_MAX_QUOTED_LENGTH];
+    if (common.shell_escape_path(out_path, quoted_path, sizeof(quoted_path)) != 0)
+    {
+        return -3;
+    }
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        command, sizeof(command),
+        "mount -t tmpfs -o size=%ldm,mode=0700 tmpfs %s",
+        budget_mib, quoted_path
+    );
+    if (common.run_command(command) != 0)
+    {
+        return -3;
+    }
+
+    LOG_INFO("Mounted %ld MiB tmpfs at %s", budget_mib, out_path);
+
+    return budget_mib;
+}
+
+int reserve_ramdisk_space(long *remaining_mib, const char *name, long estimate_mib)
+{
+    // Stay silent when no RAM budget is in use.
+    if (*remaining_mib <= 0)
+    {
+        return 0;
+    }
+
+    if (estimate_mib > *remaining_mib)
+    {
+        LOG_INFO("Placing %s on disk (~%ld MiB exceeds remaining RAM budget)", name, estimate_mib);
+        return 0;
+    }
+
+    *remaining_mib -= estimate_mib;
+    LOG_INFO("Placing %s in RAM (~%ld MiB)", name, estimate_mib);
+
+    return 1;
+}
+
+int unmount_ramdisk(const char *path)
+{
+    char quoted_path[COMMON_MAX_QUOTED_LENGTH];
+    if (common.shell_escape_path(path, quoted_path, sizeof(quoted_path)) != 0)
+    {
+        return -1;
+    }
+
+    // Unmount, detaching lazily if something still holds the tmpfs open.
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(command, sizeof(command), "umount %s", quoted_path);
+    if (common.run_command(command) != 0)
+    {
+        snprintf(command, sizeof(command), "umount -l %s", quoted_path);
+        if (common.run_command(command) != 0)
+        {
+            return -2;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "../all.h"
+
+/** The name of the RAM-backed directory inside the build directory. */
+#define RAMDISK_DIR_NAME "ram"
+
+/**
+ * Gets the memory currently available to new allocations.
+ *
+ * Reads `MemAvailable` from /proc/meminfo.
+ *
+ * @return The available memory in MiB, or `-1` if it cannot be determined.
+ */
+long get_available_memory_mib(void);
+
+/**
+ * Mounts a sized tmpfs inside the build directory.
+ *
+ * The requested budget is capped so that at least CONFIG_RAM_RESERVE_MIB of
+ * the currently available memory stays free for the build processes
+ * themselves. The tmpfs is mounted at `<build_dir>/` RAMDISK_DIR_NAME.
+ *
+ * @param build_dir The path to the build directory.
+ * @param budget_mib The requested budget in MiB.
+ * @param out_path The buffer receiving the tmpfs mount point.
+ * @param out_size The size of the output buffer.
+ *
+ * @return The effective budget in MiB on success.
+ * @return - `-1` - Indicates too little memory is available for any budget.
+ * @return - `-2` - Indicates mount point creation failure.
+ * @return - `-3` - Indicates tmpfs mount failure.
+ */
+long mount_ramdisk(
+    const char *build_dir, long budget_mib, char *out_path, size_t out_size
+);
+
+/**
+ * Reserves space in the RAM budget for a build directory.
+ *
+ * Deducts the estimate from the remaining budget if it fits, so callers can
+ * place the most valuable directories first and let the rest spill to disk.
+ * Logs the placement decision unless the budget is already exhausted.
+ *
+ * @param remaining_mib The remaining budget in MiB, updated on success.
+ * @param name The name of the directory, used for logging.
+ * @param estimate_mib The estimated peak size of the directory in MiB.
+ *
+ * @return - `1` - Indicates the directory fits and should be placed in RAM.
+ * @return - `0` - Indicates the directory should be placed on disk.
+ */
+int reserve_ramdisk_space(long *remaining_mib, const char *name, long estimate_mib);
+
+/**
+ * Unmounts a tmpfs mounted by mount_ramdisk().
+ *
+ * Falls back to a lazy unmount if the tmpfs is still busy.
+ *
+ * @param path The tmpfs mount point.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates path quoting failure.
+ * @return - `-2` - Indicates unmount failure.
+ */
+int unmount_ramdisk(const char *path);
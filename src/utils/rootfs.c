@@ -32,6 +32,49 @@ int cleanup_apt_directories(const char *rootfs_path)
     return 0;
 }
 
+off_t get_file_size(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        return -1;
+    }
+    return st.st_size;
+}
+
+void log_file_size(const char *label, const char *path)
+{
+    off_t size = get_file_size(path);
+    if (size >= 0)
+    {
+        LOG_INFO("%s size: %.1f MiB", label, (double)size / (1024.0 * 1024.0));
+    }
+}
+
+int copy_initrd(const char *rootfs_path)
+{
+    char pattern[COMMON_MAX_PATH_LENGTH];
+    char src[COMMON_MAX_PATH_LENGTH];
+    char dst[COMMON_MAX_PATH_LENGTH];
+
+    // Find the versioned initrd.
+    snprintf(pattern, sizeof(pattern), "%s/boot/initrd.img-*", rootfs_path);
+    if (common.find_first_glob(pattern, src, sizeof(src)) != 0)
+    {
+        return -1;
+    }
+
+    // Copy it to the generic name.
+    snprintf(dst, sizeof(dst), "%s/boot/initrd.img", rootfs_path);
+    if (common.copy_file(src, dst) != 0)
+    {
+        return -2;
+    }
+    log_file_size("Initrd", dst);
+
+    return 0;
+}
+
 int copy_kernel_and_initrd(const char *rootfs_path)
 {
     char pattern[COMMON_MAX_PATH_LENGTH];
@@ -49,17 +92,17 @@ int copy_kernel_and_initrd(const char *rootfs_path)
     {
         return -2;
     }
+    log_file_size("Kernel", dst);
 
     // Copy initrd to standard path.
-    snprintf(pattern, sizeof(pattern), "%s/boot/initrd.img-*", rootfs_path);
-    if (common.find_first_glob(pattern, src, sizeof(src)) != 0)
-    {
-        return -3;
-    }
-    snprintf(dst, sizeof(dst), "%s/boot/initrd.img", rootfs_path);
-    if (common.copy_file(src, dst) != 0)
+    switch (copy_initrd(rootfs_path))
     {
-        return -4;
+        case 0:
+            break;
+        case -1:
+            return -3;
+        default:
+            return -4;
     }
 
     return 0;
@@ -15,13 +15,47 @@
  */
 int cleanup_apt_directories(const char *rootfs_path);
 
+/**
+ * Gets the size of a file.
+ *
+ * @param path The path to the file.
+ *
+ * @return The size of the file in bytes, or `-1` if it cannot be determined.
+ */
+off_t get_file_size(const char *path);
+
+/**
+ * Logs the size of a file in MiB.
+ *
+ * Logs nothing if the size cannot be determined.
+ *
+ * @param label The label to prefix the size with (e.g. "Initrd").
+ * @param path The path to the file.
+ */
+void log_file_size(const char *label, const char *path);
+
+/**
+ * Copies the initrd to its standard boot path.
+ *
+ * Finds initrd.img-* using a glob pattern and copies it to /boot/initrd.img,
+ * logging its size. The versioned source file is preserved.
+ *
+ * @param rootfs_path The path to the rootfs directory.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates the initrd was not found.
+ * @return - `-2` - Indicates the initrd copy failed.
+ */
+int copy_initrd(const char *rootfs_path);
+
 /**
  * Copies kernel and initrd to standard boot paths.
  *
  * Finds vmlinuz-* and initrd.img-* using glob patterns and copies them
- * to /boot/vmlinuz and /boot/initrd.img respectively. The versioned
- * source files are preserved for update-initramfs; use
- * cleanup_versioned_boot_files() to remove them after Plymouth theming.
+ * to /boot/vmlinuz and /boot/initrd.img respectively, logging their sizes.
+ * The versioned source files are preserved for update-initramfs; use
+ * cleanup_versioned_boot_files() to remove them once the initramfs has been
+ * generated.
  *
  * @param rootfs_path The path to the rootfs directory.
  *
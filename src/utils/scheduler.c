@@ -0,0 +1,381 @@
+/**
+ * This code is responsible for running the build as a dependency graph of
+ * tasks, executing independent branches concurrently in child processes.
+ */
+
+#include "all.h"
+
+static int is_task_ready(const Scheduler *scheduler, const SchedulerTask *task)
+{
+    // Ensure every dependency has already succeeded.
+    for (int i = 0; i < task->dependency_count; i++)
+    {
+        const SchedulerTask *dependency = &scheduler->tasks[task->dependencies[i]];
+        if (dependency->state != SCHEDULER_TASK_SUCCEEDED)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void write_prefixed(
+    const char *name, const char *data, size_t length, int *at_line_start
+)
+{
+    // Prefix each line with the task name as it starts.
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (*at_line_start)
+        {
+            fwrite(data + start, 1, i - start, stdout);
+            printf("[%s] ", name);
+            start = i;
+            *at_line_start = 0;
+        }
+        if (data[i] == '\n')
+        {
+            *at_line_start = 1;
+        }
+    }
+    fwrite(data + start, 1, length - start, stdout);
+    fflush(stdout);
+}
+
+static int relay_task_output(const char *name, int fd, pid_t pid)
+{
+    char buffer[SCHEDULER_RELAY_BUFFER_SIZE];
+    int at_line_start = 1;
+    int status = 0;
+    int exited = 0;
+
+    // Relay output until the task has exited and its pipe is drained. Stray
+    // daemons may keep the pipe open, so the exit is what ends the relay.
+    while (1)
+    {
+        struct pollfd poll_fd = { .fd = fd, .events = POLLIN };
+        int ready = poll(&poll_fd, 1, exited ? 0 : SCHEDULER_POLL_INTERVAL_MS);
+        if (ready > 0)
+        {
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length > 0)
+            {
+                write_prefixed(name, buffer, (size_t)length, &at_line_start);
+                continue;
+            }
+            if (length < 0 && errno == EINTR)
+            {
+                continue;
+            }
+        }
+        else if (ready < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (ready == 0 && !exited)
+        {
+            exited = waitpid(pid, &status, WNOHANG) == pid;
+            continue;
+        }
+
+        // Stop at end of file, on errors, or once the exited task's pipe is
+        // empty, then collect the task if it has not been yet.
+        break;
+    }
+    if (!at_line_start)
+    {
+        write_prefixed(name, "\n", 1, &at_line_start);
+    }
+    close(fd);
+    if (!exited && waitpid(pid, &status, 0) != pid)
+    {
+        return 1;
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+static int run_task(SchedulerTask *task)
+{
+    // Route the task's output, and its commands', through a pipe.
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        return 1;
+    }
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return 1;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[1]);
+        int result = task->function(task->context);
+        fflush(NULL);
+        _exit(result == 0 ? 0 : 1);
+    }
+    close(fds[1]);
+
+    // Relay it to the build log with the task name on every line.
+    return relay_task_output(task->name, fds[0], pid);
+}
+
+static int start_task(SchedulerTask *task)
+{
+    LOG_INFO("Starting task: %s", task->name);
+
+    // Flush buffered output so it is not duplicated in the child.
+    fflush(NULL);
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        // Lead a new process group so cancellation reaches every descendant.
+        setpgid(0, 0);
+
+        // Restore default signal dispositions; the scheduler owns shutdown.
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+
+        // Disable package prompts since tasks cannot own the terminal.
+        setenv("DEBIAN_FRONTEND", "noninteractive", 1);
+
+        // Run the task and exit without running the parent's exit handlers.
+        _exit(run_task(task));
+    }
+
+    // Mirror setpgid() in the parent to avoid racing the child.
+    setpgid(pid, pid);
+
+    task->pid = pid;
+    task->state = SCHEDULER_TASK_RUNNING;
+
+    return 0;
+}
+
+static void cancel_tasks(Scheduler *scheduler)
+{
+    for (int i = 0; i < scheduler->task_count; i++)
+    {
+        SchedulerTask *task = &scheduler->tasks[i];
+
+        // Terminate the whole process group of running tasks.
+        if (task->state == SCHEDULER_TASK_RUNNING)
+        {
+            LOG_WARNING("Cancelling task: %s", task->name);
+            kill(-task->pid, SIGTERM);
+        }
+
+        // Prevent pending tasks from ever starting.
+        if (task->state == SCHEDULER_TASK_PENDING)
+        {
+            task->state = SCHEDULER_TASK_CANCELLED;
+        }
+    }
+}
+
+static int collect_finished_tasks(Scheduler *scheduler)
+{
+    int failures = 0;
+
+    for (int i = 0; i < scheduler->task_count; i++)
+    {
+        SchedulerTask *task = &scheduler->tasks[i];
+        if (task->state != SCHEDULER_TASK_RUNNING)
+        {
+            continue;
+        }
+
+        // Check whether the task process has exited.
+        int status;
+        pid_t result = waitpid(task->pid, &status, WNOHANG);
+        if (result == 0 || (result < 0 && errno == EINTR))
+        {
+            continue;
+        }
+
+        // Record the outcome of the task.
+        if (result == task->pid && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        {
+            task->state = SCHEDULER_TASK_SUCCEEDED;
+            LOG_INFO("Task complete: %s", task->name);
+        }
+        else
+        {
+            task->state = SCHEDULER_TASK_FAILED;
+            failures++;
+            LOG_ERROR("Task failed: %s", task->name);
+        }
+    }
+
+    return failures;
+}
+
+static int count_running_tasks(const Scheduler *scheduler)
+{
+    int running = 0;
+    for (int i = 0; i < scheduler->task_count; i++)
+    {
+        if (scheduler->tasks[i].state == SCHEDULER_TASK_RUNNING)
+        {
+            running++;
+        }
+    }
+    return running;
+}
+
+void init_scheduler(Scheduler *scheduler)
+{
+    memset(scheduler, 0, sizeof(*scheduler));
+}
+
+int add_scheduler_task(
+    Scheduler *scheduler,
+    const char *name,
+    SchedulerTaskFunction function,
+    void *context
+)
+{
+    // Ensure there is room for another task.
+    if (scheduler->task_count >= SCHEDULER_MAX_TASKS)
+    {
+        return -1;
+    }
+
+    // Append the task in the pending state.
+    int task_id = scheduler->task_count++;
+    SchedulerTask *task = &scheduler->tasks[task_id];
+    memset(task, 0, sizeof(*task));
+    task->name = name;
+    task->function = function;
+    task->context = context;
+    task->state = SCHEDULER_TASK_PENDING;
+
+    return task_id;
+}
+
+int add_scheduler_dependency(Scheduler *scheduler, int task_id, int dependency_id)
+{
+    // Validate both task identifiers.
+    if (task_id < 0 || task_id >= scheduler->task_count
+        || dependency_id < 0 || dependency_id >= scheduler->task_count)
+    {
+        return -1;
+    }
+
+    // Ensure there is room for another dependency.
+    SchedulerTask *task = &scheduler->tasks[task_id];
+    if (task->dependency_count >= SCHEDULER_MAX_DEPENDENCIES)
+    {
+        return -2;
+    }
+
+    task->dependencies[task->dependency_count++] = dependency_id;
+
+    return 0;
+}
+
+int run_scheduler(Scheduler *scheduler)
+{
+    int failed = 0;
+    int interrupted = 0;
+    int start_failed = 0;
+
+    while (1)
+    {
+        // Cancel everything once the build is interrupted.
+        if (!interrupted && common.check_interrupted())
+        {
+            interrupted = 1;
+            cancel_tasks(scheduler);
+        }
+
+        // Start every pending task whose dependencies have succeeded.
+        if (!failed && !interrupted && !start_failed)
+        {
+            for (int i = 0; i < scheduler->task_count; i++)
+            {
+                SchedulerTask *task = &scheduler->tasks[i];
+                if (task->state != SCHEDULER_TASK_PENDING || !is_task_ready(scheduler, task))
+                {
+                    continue;
+                }
+                if (start_task(task) != 0)
+                {
+                    LOG_ERROR("Failed to start task: %s", task->name);
+                    start_failed = 1;
+                    cancel_tasks(scheduler);
+                    break;
+                }
+            }
+        }
+
+        // Reap finished tasks and propagate failures.
+        if (collect_finished_tasks(scheduler) > 0 && !failed)
+        {
+            failed = 1;
+            cancel_tasks(scheduler);
+        }
+
+        // Stop once nothing is running and nothing more can start.
+        if (count_running_tasks(scheduler) == 0)
+        {
+            int startable = 0;
+            for (int i = 0; i < scheduler->task_count; i++)
+            {
+                const SchedulerTask *task = &scheduler->tasks[i];
+                if (task->state == SCHEDULER_TASK_PENDING && is_task_ready(scheduler, task))
+                {
+                    startable = 1;
+                }
+            }
+            if (!startable || failed || interrupted || start_failed)
+            {
+                break;
+            }
+            continue;
+        }
+
+        // Wait before polling the running tasks again.
+        usleep(SCHEDULER_POLL_INTERVAL_MS * 1000);
+    }
+
+    // Report why the graph stopped early, if it did.
+    if (interrupted)
+    {
+        return -2;
+    }
+    if (start_failed)
+    {
+        return -3;
+    }
+    if (failed)
+    {
+        return -1;
+    }
+
+    // Detect tasks that could never start because of a dependency cycle.
+    for (int i = 0; i < scheduler->task_count; i++)
+    {
+        if (scheduler->tasks[i].state == SCHEDULER_TASK_PENDING)
+        {
+            LOG_ERROR("Task never became ready: %s", scheduler->tasks[i].name);
+            return -4;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "../all.h"
+
+/** The maximum number of tasks a scheduler can hold. */
+#define SCHEDULER_MAX_TASKS 32
+
+/** The maximum number of dependencies a single task can declare. */
+#define SCHEDULER_MAX_DEPENDENCIES 8
+
+/** The interval between task status polls, in milliseconds. */
+#define SCHEDULER_POLL_INTERVAL_MS 100
+
+/** The size of the buffer relaying a task's output to the build log. */
+#define SCHEDULER_RELAY_BUFFER_SIZE 4096
+
+/** A type representing the function a task runs in its own process. */
+typedef int (*SchedulerTaskFunction)(void *context);
+
+/** A type representing the lifecycle state of a scheduler task. */
+typedef enum
+{
+    SCHEDULER_TASK_PENDING,
+    SCHEDULER_TASK_RUNNING,
+    SCHEDULER_TASK_SUCCEEDED,
+    SCHEDULER_TASK_FAILED,
+    SCHEDULER_TASK_CANCELLED
+} SchedulerTaskState;
+
+/** A type representing a single node of the build dependency graph. */
+typedef struct
+{
+    const char *name;
+    SchedulerTaskFunction function;
+    void *context;
+    int dependencies[SCHEDULER_MAX_DEPENDENCIES];
+    int dependency_count;
+    SchedulerTaskState state;
+    pid_t pid;
+} SchedulerTask;
+
+/** A type representing a dependency graph of tasks and its execution. */
+typedef struct
+{
+    SchedulerTask tasks[SCHEDULER_MAX_TASKS];
+    int task_count;
+} Scheduler;
+
+/** Initializes an empty scheduler. */
+void init_scheduler(Scheduler *scheduler);
+
+/**
+ * Adds a task to the scheduler.
+ *
+ * @param scheduler The scheduler to add the task to.
+ * @param name The task name used in log messages.
+ * @param function The function to run for the task.
+ * @param context The opaque context passed to the function.
+ *
+ * @return - `>=0` - The identifier of the new task.
+ * @return - `-1` - Indicates the scheduler is full.
+ */
+int add_scheduler_task(
+    Scheduler *scheduler,
+    const char *name,
+    SchedulerTaskFunction function,
+    void *context
+);
+
+/**
+ * Declares that a task must not start before another task has succeeded.
+ *
+ * @param scheduler The scheduler holding both tasks.
+ * @param task_id The identifier of the dependent task.
+ * @param dependency_id The identifier of the task it depends on.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates an invalid task identifier.
+ * @return - `-2` - Indicates the task has too many dependencies.
+ */
+int add_scheduler_dependency(Scheduler *scheduler, int task_id, int dependency_id);
+
+/**
+ * Runs all tasks, starting each one as soon as its dependencies succeed.
+ *
+ * Every task runs in a forked child placed in its own process group, so
+ * independent branches of the graph execute concurrently. When a task fails
+ * or the build is interrupted, every running task's process group receives
+ * SIGTERM and tasks that have not started yet are cancelled.
+ *
+ * Everything a task and its commands print is relayed to the build log with
+ * each line prefixed by the task name, so the output of concurrent tasks
+ * can be told apart.
+ *
+ * @param scheduler The scheduler to run.
+ *
+ * @return - `0` - Indicates every task succeeded.
+ * @return - `-1` - Indicates a task failed.
+ * @return - `-2` - Indicates the build was interrupted.
+ * @return - `-3` - Indicates a task process could not be started.
+ * @return - `-4` - Indicates a dependency cycle.
+ *
+ * @note Tasks share no memory with the scheduler; all state passed between
+ * tasks must live on disk.
+ */
+int run_scheduler(Scheduler *scheduler);
@@ -0,0 +1,836 @@
+/**
+ * This code is responsible for writing squashfs images in-process with
+ * libsquashfs from a manifest of the tree, as an alternative to running
+ * mksquashfs.
+ */
+
+#define _GNU_SOURCE
+#include "all.h"
+
+/** The size the image is padded to a multiple of, so it can be loop mounted. */
+#define SQUASHFS_WRITER_DEVICE_BLOCK 4096
+
+/** The number of data blocks each worker may have in flight by default. */
+#define SQUASHFS_WRITER_BACKLOG 10
+
+/** Extensions of files whose contents are already compressed. */
+static const char *const SQUASHFS_WRITER_COMPRESSED_EXTENSIONS[] = {
+    ".gz", ".xz", ".zst", ".bz2", ".lz4", ".lzma", ".zip", ".jar", ".deb",
+    ".squashfs", ".png", ".jpg", ".jpeg", ".webp", ".woff2", ".ogg", ".mp3",
+    ".mp4"
+};
+
+/** The number of already-compressed extensions. */
+#define SQUASHFS_WRITER_COMPRESSED_EXTENSIONS_COUNT \
+    (int)(sizeof(SQUASHFS_WRITER_COMPRESSED_EXTENSIONS) \
+        / sizeof(SQUASHFS_WRITER_COMPRESSED_EXTENSIONS[0]))
+
+/** A type representing the image state of one manifest entry. */
+typedef struct
+{
+    sqfs_inode_generic_t *inode;
+    sqfs_u32 inode_number;
+    sqfs_u64 inode_ref;
+    int written;
+    int priority;
+} SquashfsNode;
+
+/** A type representing the libsquashfs objects of one image being written. */
+typedef struct
+{
+    sqfs_file_t *file;
+    sqfs_super_t super;
+    sqfs_compressor_t *compressor;
+    sqfs_compressor_t *data_compressor;
+    sqfs_block_writer_t *block_writer;
+    sqfs_frag_table_t *fragments;
+    sqfs_block_processor_t *processor;
+    sqfs_id_table_t *ids;
+    sqfs_xattr_writer_t *xattrs;
+    sqfs_meta_writer_t *inode_writer;
+    sqfs_meta_writer_t *directory_table;
+    sqfs_dir_writer_t *directory_writer;
+    SquashfsNode *nodes;
+    sqfs_u32 inode_count;
+    BlockCacheStats cache_stats;
+} SquashfsWriter;
+
+/** A type representing the region of an existing file an image is written to. */
+typedef struct
+{
+    sqfs_file_t base;
+    int fd;
+    sqfs_u64 offset;
+    sqfs_u64 size;
+} SquashfsRegion;
+
+/** A type representing a file whose data is written in a given order. */
+typedef struct
+{
+    const ManifestEntry *entry;
+    int priority;
+} SquashfsDataOrder;
+
+static SquashfsNode *get_node(SquashfsWriter *writer, const ManifestEntry *entry)
+{
+    return &writer->nodes[entry->index];
+}
+
+static const ManifestEntry *resolve_link(const ManifestEntry *entry)
+{
+    return entry->link ? entry->link : entry;
+}
+
+static void number_nodes(SquashfsWriter *writer, const ManifestEntry *entry)
+{
+    // Number children before their directory, so the root comes last.
+    for (int i = 0; i < entry->child_count; i++)
+    {
+        const ManifestEntry *child = entry->children[i];
+        if (S_ISDIR(child->st.st_mode))
+        {
+            number_nodes(writer, child);
+            continue;
+        }
+        SquashfsNode *target = get_node(writer, resolve_link(child));
+        if (target->inode_number == 0)
+        {
+            target->inode_number = ++writer->inode_count;
+        }
+    }
+    get_node(writer, entry)->inode_number = ++writer->inode_count;
+}
+
+static int compare_sort_paths(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+static void assign_priorities(SquashfsWriter *writer, const ManifestEntry *entry, void *priorities)
+{
+    // Sort file paths are relative to the image root, without a slash.
+    if (S_ISREG(entry->st.st_mode) && !entry->link)
+    {
+        char **found = tfind(entry->relative_path + 1, &priorities, compare_sort_paths);
+        if (found)
+        {
+            get_node(writer, entry)->priority = atoi(*found + strlen(*found) + 1);
+        }
+    }
+    for (int i = 0; i < entry->child_count; i++)
+    {
+        assign_priorities(writer, entry->children[i], priorities);
+    }
+}
+
+static int load_priorities(SquashfsWriter *writer, const Manifest *manifest, const char *sort_path)
+{
+    FILE *sort = fopen(sort_path, "r");
+    if (!sort)
+    {
+        return -1;
+    }
+
+    // Index the "path priority" lines by path, keeping the priority right
+    // after the path's terminator.
+    void *priorities = NULL;
+    int result = 0;
+    char line[COMMON_MAX_PATH_LENGTH + 32];
+    while (result == 0 && fgets(line, sizeof(line), sort))
+    {
+        line[strcspn(line, "\n")] = '\0';
+        char *separator = strrchr(line, ' ');
+        if (!separator)
+        {
+            continue;
+        }
+        *separator = '\0';
+
+        size_t path_length = (size_t)(separator - line);
+        char *copy = malloc(path_length + strlen(separator + 1) + 2);
+        if (!copy)
+        {
+            result = -1;
+            break;
+        }
+        memcpy(copy, line, path_length + 1);
+        strcpy(copy + path_length + 1, separator + 1);
+        char **found = tsearch(copy, &priorities, compare_sort_paths);
+        if (!found)
+        {
+            free(copy);
+            result = -1;
+        }
+        else if (*found != copy)
+        {
+            free(copy);
+        }
+    }
+    fclose(sort);
+
+    if (result == 0)
+    {
+        assign_priorities(writer, manifest->root, priorities);
+    }
+    tdestroy(priorities, free);
+
+    return result;
+}
+
+static void collect_data_order(
+    SquashfsWriter *writer, const ManifestEntry *entry,
+    SquashfsDataOrder *order, int *count
+)
+{
+    if (S_ISREG(entry->st.st_mode) && !entry->link)
+    {
+        order[*count].entry = entry;
+        order[*count].priority = get_node(writer, entry)->priority;
+        (*count)++;
+    }
+    for (int i = 0; i < entry->child_count; i++)
+    {
+        collect_data_order(writer, entry->children[i], order, count);
+    }
+}
+
+static int compare_data_order(const void *a, const void *b)
+{
+    const SquashfsDataOrder *first = a;
+    const SquashfsDataOrder *second = b;
+
+    // Place higher priorities first, keeping tree order among equals.
+    if (first->priority != second->priority)
+    {
+        return first->priority > second->priority ? -1 : 1;
+    }
+    return first->entry->index - second->entry->index;
+}
+
+static int is_compressed_file(const char *name)
+{
+    size_t name_length = strlen(name);
+    for (int i = 0; i < SQUASHFS_WRITER_COMPRESSED_EXTENSIONS_COUNT; i++)
+    {
+        size_t extension_length = strlen(SQUASHFS_WRITER_COMPRESSED_EXTENSIONS[i]);
+        if (name_length > extension_length
+            && strcmp(name + name_length - extension_length, SQUASHFS_WRITER_COMPRESSED_EXTENSIONS[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int write_file_data(
+    SquashfsWriter *writer, const ManifestEntry *entry, sqfs_u8 *buffer, size_t buffer_size
+)
+{
+    int fd = open(entry->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    // Store already-compressed files as they are, instead of spending a
+    // worker on blocks that will not shrink.
+    sqfs_u32 flags = is_compressed_file(entry->name) ? SQFS_BLK_DONT_COMPRESS : 0;
+
+    // Stream the contents through the block processor, whose workers
+    // compress the blocks and fill in the file inode once they are written.
+    SquashfsNode *node = get_node(writer, entry);
+    int result = sqfs_block_processor_begin_file(writer->processor, &node->inode, node, flags);
+    while (result == 0)
+    {
+        ssize_t length = read(fd, buffer, buffer_size);
+        if (length < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (length <= 0)
+        {
+            result = length < 0 ? -1 : sqfs_block_processor_end_file(writer->processor);
+            break;
+        }
+        result = sqfs_block_processor_append(writer->processor, buffer, (size_t)length);
+    }
+    close(fd);
+
+    return result;
+}
+
+static int write_tree_data(
+    SquashfsWriter *writer, const Manifest *manifest, sqfs_u8 *buffer, size_t buffer_size
+)
+{
+    // Write the contents of each file once, at its first name, in priority
+    // order.
+    SquashfsDataOrder *order = malloc((size_t)manifest->count * sizeof(*order));
+    if (!order)
+    {
+        return -1;
+    }
+    int count = 0;
+    collect_data_order(writer, manifest->root, order, &count);
+    qsort(order, (size_t)count, sizeof(*order), compare_data_order);
+
+    int result = 0;
+    for (int i = 0; result == 0 && i < count; i++)
+    {
+        if (write_file_data(writer, order[i].entry, buffer, buffer_size) != 0)
+        {
+            LOG_ERROR("Failed to squash %s", order[i].entry->path);
+            result = -1;
+        }
+    }
+    free(order);
+
+    return result;
+}
+
+static int get_xattr_index(
+    SquashfsWriter *writer, const ManifestEntry *entry, sqfs_u32 *out_index
+)
+{
+    // Add each attribute, skipping namespaces squashfs cannot store.
+    if (sqfs_xattr_writer_begin(writer->xattrs, 0) != 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < entry->xattr_count; i++)
+    {
+        const ManifestXattr *xattr = &entry->xattrs[i];
+        int result = sqfs_xattr_writer_add(writer->xattrs, xattr->name, xattr->value, xattr->size);
+        if (result == SQFS_ERROR_UNSUPPORTED)
+        {
+            LOG_WARNING("Skipping extended attribute %s of %s", xattr->name, entry->path);
+            continue;
+        }
+        if (result != 0)
+        {
+            return -1;
+        }
+    }
+
+    return sqfs_xattr_writer_end(writer->xattrs, out_index) == 0 ? 0 : -1;
+}
+
+static int write_inode(
+    SquashfsWriter *writer, const ManifestEntry *entry, sqfs_inode_generic_t *inode,
+    sqfs_u32 xattr_index
+)
+{
+    SquashfsNode *node = get_node(writer, entry);
+
+    // Fill in the metadata every inode type shares.
+    inode->base.mode = (sqfs_u16)entry->st.st_mode;
+    inode->base.mod_time = (sqfs_u32)entry->st.st_mtime;
+    inode->base.inode_number = node->inode_number;
+    if (sqfs_id_table_id_to_index(writer->ids, entry->st.st_uid, &inode->base.uid_idx) != 0
+        || sqfs_id_table_id_to_index(writer->ids, entry->st.st_gid, &inode->base.gid_idx) != 0
+        || sqfs_inode_set_xattr_index(inode, xattr_index) != 0)
+    {
+        return -1;
+    }
+
+    // Remember where the inode lands, for the directory entries naming it.
+    sqfs_u64 block_start;
+    sqfs_u32 offset;
+    sqfs_meta_writer_get_position(writer->inode_writer, &block_start, &offset);
+    node->inode_ref = (block_start << 16) | offset;
+    node->written = 1;
+
+    return sqfs_meta_writer_write_inode(writer->inode_writer, inode) == 0 ? 0 : -1;
+}
+
+static sqfs_inode_generic_t *create_leaf_inode(const ManifestEntry *entry)
+{
+    size_t target_size = entry->target ? strlen(entry->target) : 0;
+    sqfs_inode_generic_t *inode = calloc(1, sizeof(*inode) + target_size);
+    if (!inode)
+    {
+        return NULL;
+    }
+    inode->payload_bytes_available = (sqfs_u32)target_size;
+    inode->payload_bytes_used = (sqfs_u32)target_size;
+
+    switch (entry->st.st_mode & S_IFMT)
+    {
+        case S_IFLNK:
+            inode->base.type = SQFS_INODE_SLINK;
+            inode->data.slink.nlink = 1;
+            inode->data.slink.target_size = (sqfs_u32)target_size;
+            memcpy(inode->extra, entry->target, target_size);
+            break;
+        case S_IFBLK:
+        case S_IFCHR:
+            inode->base.type = S_ISBLK(entry->st.st_mode) ? SQFS_INODE_BDEV : SQFS_INODE_CDEV;
+            inode->data.dev.nlink = 1;
+            inode->data.dev.devno = (sqfs_u32)entry->st.st_rdev;
+            break;
+        case S_IFIFO:
+        case S_IFSOCK:
+            inode->base.type = S_ISFIFO(entry->st.st_mode) ? SQFS_INODE_FIFO : SQFS_INODE_SOCKET;
+            inode->data.ipc.nlink = 1;
+            break;
+        default:
+            free(inode);
+            return NULL;
+    }
+
+    return inode;
+}
+
+static int write_leaf(SquashfsWriter *writer, const ManifestEntry *entry)
+{
+    sqfs_u32 xattr_index;
+    int result = get_xattr_index(writer, entry, &xattr_index);
+
+    // Complete the file inode the block processor created, counting the
+    // names that share it.
+    if (result == 0 && S_ISREG(entry->st.st_mode))
+    {
+        sqfs_inode_generic_t *inode = get_node(writer, entry)->inode;
+        if (entry->link_count > 1)
+        {
+            result = sqfs_inode_make_extended(inode);
+            inode->data.file_ext.nlink = (sqfs_u32)entry->link_count;
+        }
+        if (result == 0)
+        {
+            result = write_inode(writer, entry, inode, xattr_index);
+        }
+    }
+    else if (result == 0)
+    {
+        sqfs_inode_generic_t *inode = create_leaf_inode(entry);
+        result = inode ? write_inode(writer, entry, inode, xattr_index) : -1;
+        free(inode);
+    }
+
+    if (result != 0)
+    {
+        LOG_ERROR("Failed to write squashfs inode for %s", entry->path);
+    }
+    return result;
+}
+
+static int write_directory(
+    SquashfsWriter *writer, const ManifestEntry *entry, sqfs_u32 parent_number
+)
+{
+    // Write the inodes of all entries first, so the listing can refer to
+    // them.
+    int subdirectories = 0;
+    for (int i = 0; i < entry->child_count; i++)
+    {
+        const ManifestEntry *child = entry->children[i];
+        const ManifestEntry *target = resolve_link(child);
+        if (S_ISDIR(child->st.st_mode))
+        {
+            if (write_directory(writer, child, get_node(writer, entry)->inode_number) != 0)
+            {
+                return -1;
+            }
+            subdirectories++;
+        }
+        else if (!get_node(writer, target)->written && write_leaf(writer, target) != 0)
+        {
+            return -1;
+        }
+    }
+
+    // List the entries, pointing hardlinks at their shared inode.
+    int result = sqfs_dir_writer_begin(writer->directory_writer, 0);
+    for (int i = 0; result == 0 && i < entry->child_count; i++)
+    {
+        const ManifestEntry *child = entry->children[i];
+        const SquashfsNode *target = get_node(writer, resolve_link(child));
+        result = sqfs_dir_writer_add_entry(
+            writer->directory_writer, child->name, target->inode_number,
+            target->inode_ref, (sqfs_u16)child->st.st_mode
+        );
+    }
+    if (result == 0)
+    {
+        result = sqfs_dir_writer_end(writer->directory_writer);
+    }
+
+    // Write the directory inode itself.
+    sqfs_u32 xattr_index;
+    if (result == 0)
+    {
+        result = get_xattr_index(writer, entry, &xattr_index);
+    }
+    if (result == 0)
+    {
+        sqfs_inode_generic_t *inode = sqfs_dir_writer_create_inode(
+            writer->directory_writer, subdirectories + 2, xattr_index, parent_number
+        );
+        result = inode ? write_inode(writer, entry, inode, xattr_index) : -1;
+        sqfs_free(inode);
+    }
+
+    if (result != 0)
+    {
+        LOG_ERROR("Failed to write squashfs directory for %s", entry->path);
+    }
+    return result;
+}
+
+static int read_region(sqfs_file_t *base, sqfs_u64 position, void *buffer, size_t size)
+{
+    SquashfsRegion *self = (SquashfsRegion *)base;
+    if (position + size > self->size)
+    {
+        return SQFS_ERROR_IO;
+    }
+
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t result = pread(
+            self->fd, (char *)buffer + done, size - done,
+            (off_t)(self->offset + position + done)
+        );
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            return SQFS_ERROR_IO;
+        }
+        done += (size_t)result;
+    }
+
+    return 0;
+}
+
+static int write_region(sqfs_file_t *base, sqfs_u64 position, const void *buffer, size_t size)
+{
+    SquashfsRegion *self = (SquashfsRegion *)base;
+
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t result = pwrite(
+            self->fd, (const char *)buffer + done, size - done,
+            (off_t)(self->offset + position + done)
+        );
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            return SQFS_ERROR_IO;
+        }
+        done += (size_t)result;
+    }
+    if (position + size > self->size)
+    {
+        self->size = position + size;
+    }
+
+    return 0;
+}
+
+static sqfs_u64 get_region_size(const sqfs_file_t *base)
+{
+    return ((const SquashfsRegion *)base)->size;
+}
+
+static int truncate_region(sqfs_file_t *base, sqfs_u64 size)
+{
+    SquashfsRegion *self = (SquashfsRegion *)base;
+    if (ftruncate(self->fd, (off_t)(self->offset + size)) != 0)
+    {
+        return SQFS_ERROR_IO;
+    }
+    self->size = size;
+    return 0;
+}
+
+static sqfs_object_t *copy_region(const sqfs_object_t *base)
+{
+    // Regions are written by one writer only.
+    (void)base;
+    return NULL;
+}
+
+static void destroy_region(sqfs_object_t *base)
+{
+    SquashfsRegion *self = (SquashfsRegion *)base;
+    close(self->fd);
+    free(self);
+}
+
+static sqfs_file_t *open_region(const char *path, off_t offset)
+{
+    SquashfsRegion *self = calloc(1, sizeof(*self));
+    if (!self)
+    {
+        return NULL;
+    }
+
+    // Drop anything after the offset, so the image ends the file.
+    self->fd = open(path, O_RDWR | O_CLOEXEC);
+    if (self->fd < 0 || ftruncate(self->fd, offset) != 0)
+    {
+        if (self->fd >= 0)
+        {
+            close(self->fd);
+        }
+        free(self);
+        return NULL;
+    }
+    self->offset = (sqfs_u64)offset;
+
+    self->base.base.destroy = destroy_region;
+    self->base.base.copy = copy_region;
+    self->base.read_at = read_region;
+    self->base.write_at = write_region;
+    self->base.get_size = get_region_size;
+    self->base.truncate = truncate_region;
+
+    return &self->base;
+}
+
+static int open_writer(
+    SquashfsWriter *writer, const char *output_path, const SquashfsWriterConfig *config
+)
+{
+    // Set up one compressor for metadata and one for file data.
+    int id = sqfs_compressor_id_from_name(config->compressor);
+    if (id < 0)
+    {
+        return -1;
+    }
+    sqfs_compressor_config_t compressor_config;
+    if (sqfs_compressor_config_init(
+            &compressor_config, (SQFS_COMPRESSOR)id, (size_t)config->block_size,
+            (sqfs_u16)config->flags) != 0)
+    {
+        return -1;
+    }
+    if (config->level > 0)
+    {
+        compressor_config.level = (sqfs_u32)config->level;
+    }
+    if (sqfs_compressor_create(&compressor_config, &writer->compressor) != 0
+        || sqfs_compressor_create(&compressor_config, &writer->data_compressor) != 0)
+    {
+        return -1;
+    }
+
+    // Look data blocks up in the cache before compressing them.
+    if (config->block_cache_dir
+        && create_block_cache_compressor(
+            writer->data_compressor, config->block_cache_dir, &writer->cache_stats,
+            &writer->data_compressor) != 0)
+    {
+        return -1;
+    }
+
+    // Write a provisional superblock and the compressor options, which
+    // the data blocks follow.
+    writer->file = config->offset > 0
+        ? open_region(output_path, config->offset)
+        : sqfs_open_file(output_path, SQFS_FILE_OPEN_OVERWRITE);
+    if (!writer->file
+        || sqfs_super_init(
+            &writer->super, (size_t)config->block_size, (sqfs_u32)time(NULL),
+            (SQFS_COMPRESSOR)id) != 0
+        || sqfs_super_write(&writer->super, writer->file) != 0)
+    {
+        return -1;
+    }
+    int options_size = writer->compressor->write_options(writer->compressor, writer->file);
+    if (options_size < 0)
+    {
+        return -1;
+    }
+    if (options_size > 0)
+    {
+        writer->super.flags |= SQFS_FLAG_COMPRESSOR_OPTIONS;
+    }
+
+    // Create the data path, with a pool of compression workers, and the
+    // tables written after it.
+    int workers = config->workers > 0 ? config->workers : 1;
+    writer->block_writer = sqfs_block_writer_create(writer->file, SQUASHFS_WRITER_DEVICE_BLOCK, 0);
+    writer->fragments = sqfs_frag_table_create(0);
+    if (!writer->block_writer || !writer->fragments)
+    {
+        return -1;
+    }
+    size_t backlog = (size_t)workers * SQUASHFS_WRITER_BACKLOG;
+    if (config->memory_mib > 0)
+    {
+        // Fit the blocks in flight, uncompressed and compressed, into the
+        // memory limit.
+        backlog = (size_t)config->memory_mib * 1024 * 1024 / (2 * (size_t)config->block_size);
+        if (backlog < (size_t)workers)
+        {
+            backlog = (size_t)workers;
+        }
+    }
+    writer->processor = sqfs_block_processor_create(
+        (size_t)config->block_size, writer->data_compressor, (unsigned int)workers,
+        backlog, writer->block_writer, writer->fragments
+    );
+    writer->ids = sqfs_id_table_create(0);
+    writer->xattrs = sqfs_xattr_writer_create(0);
+    writer->inode_writer = sqfs_meta_writer_create(writer->file, writer->compressor, 0);
+    writer->directory_table = sqfs_meta_writer_create(
+        writer->file, writer->compressor, SQFS_META_WRITER_KEEP_IN_MEMORY
+    );
+    if (!writer->processor || !writer->ids || !writer->xattrs
+        || !writer->inode_writer || !writer->directory_table)
+    {
+        return -1;
+    }
+    writer->directory_writer = sqfs_dir_writer_create(writer->directory_table, 0);
+    if (!writer->directory_writer)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int finish_image(SquashfsWriter *writer, const ManifestEntry *root)
+{
+    sqfs_file_t *file = writer->file;
+    sqfs_super_t *super = &writer->super;
+
+    // Write the inode table after the data, keeping directories in memory
+    // until it is complete.
+    super->inode_table_start = file->get_size(file);
+    if (write_directory(writer, root, writer->inode_count + 1) != 0
+        || sqfs_meta_writer_flush(writer->inode_writer) != 0
+        || sqfs_meta_writer_flush(writer->directory_table) != 0)
+    {
+        return -1;
+    }
+    super->root_inode_ref = get_node(writer, root)->inode_ref;
+    super->inode_count = writer->inode_count;
+    super->directory_table_start = file->get_size(file);
+    if (sqfs_meta_writer_write_to_file(writer->directory_table) != 0)
+    {
+        return -1;
+    }
+
+    // Write the fragment, ownership, and extended attribute tables.
+    if (sqfs_frag_table_write(writer->fragments, file, super, writer->compressor) != 0
+        || sqfs_id_table_write(writer->ids, file, super, writer->compressor) != 0
+        || sqfs_xattr_writer_flush(writer->xattrs, file, super, writer->compressor) != 0)
+    {
+        return -1;
+    }
+
+    // Pad the image to whole device blocks and rewrite the superblock.
+    static const sqfs_u8 padding[SQUASHFS_WRITER_DEVICE_BLOCK];
+    super->bytes_used = file->get_size(file);
+    size_t padding_size = (SQUASHFS_WRITER_DEVICE_BLOCK
+        - super->bytes_used % SQUASHFS_WRITER_DEVICE_BLOCK) % SQUASHFS_WRITER_DEVICE_BLOCK;
+    if (padding_size > 0
+        && file->write_at(file, super->bytes_used, padding, padding_size) != 0)
+    {
+        return -1;
+    }
+
+    return sqfs_super_write(super, file) == 0 ? 0 : -1;
+}
+
+static void destroy_object(void *object)
+{
+    if (object)
+    {
+        sqfs_destroy(object);
+    }
+}
+
+static void close_writer(SquashfsWriter *writer, const Manifest *manifest)
+{
+    // Release the block processor before the compressors it uses.
+    destroy_object(writer->processor);
+    destroy_object(writer->block_writer);
+    destroy_object(writer->fragments);
+    destroy_object(writer->directory_writer);
+    destroy_object(writer->directory_table);
+    destroy_object(writer->inode_writer);
+    destroy_object(writer->ids);
+    destroy_object(writer->xattrs);
+    destroy_object(writer->data_compressor);
+    destroy_object(writer->compressor);
+    destroy_object(writer->file);
+
+    // Release the file inodes the block processor created.
+    for (int i = 0; writer->nodes && i < manifest->count; i++)
+    {
+        sqfs_free(writer->nodes[i].inode);
+    }
+    free(writer->nodes);
+}
+
+int write_squashfs_image(
+    const Manifest *manifest, const char *output_path,
+    const SquashfsWriterConfig *config
+)
+{
+    SquashfsWriter writer = {0};
+    int result = 0;
+
+    // Number the inodes and order the file data.
+    writer.nodes = calloc((size_t)manifest->count, sizeof(*writer.nodes));
+    if (!writer.nodes)
+    {
+        result = -2;
+    }
+    if (result == 0)
+    {
+        number_nodes(&writer, manifest->root);
+    }
+    if (result == 0 && config->sort_path
+        && load_priorities(&writer, manifest, config->sort_path) != 0)
+    {
+        LOG_ERROR("Failed to read squashfs sort file %s", config->sort_path);
+        result = -1;
+    }
+
+    sqfs_u8 *buffer = malloc((size_t)config->block_size);
+    if (result == 0 && (!buffer || open_writer(&writer, output_path, config) != 0))
+    {
+        LOG_ERROR("Failed to set up squashfs writer for %s", output_path);
+        result = -2;
+    }
+
+    // Write all file contents, then the metadata describing the tree.
+    if (result == 0
+        && (write_tree_data(&writer, manifest, buffer, (size_t)config->block_size) != 0
+            || sqfs_block_processor_finish(writer.processor) != 0))
+    {
+        LOG_ERROR("Failed to write squashfs data to %s", output_path);
+        result = -3;
+    }
+    if (result == 0 && finish_image(&writer, manifest->root) != 0)
+    {
+        LOG_ERROR("Failed to write squashfs metadata to %s", output_path);
+        result = -4;
+    }
+
+    if (result == 0 && writer.cache_stats.blocks > 0)
+    {
+        LOG_INFO(
+            "Reused %lu of %lu compressed blocks from cache",
+            writer.cache_stats.hits, writer.cache_stats.blocks
+        );
+    }
+
+    close_writer(&writer, manifest);
+    free(buffer);
+
+    return result;
+}
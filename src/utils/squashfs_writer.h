@@ -0,0 +1,57 @@
+#pragma once
+#include "../all.h"
+
+/** A type representing the parameters of a natively written squashfs. */
+typedef struct
+{
+    const char *compressor;
+    int level;
+    int flags;
+    int block_size;
+    int workers;
+    int memory_mib;
+    const char *sort_path;
+    const char *block_cache_dir;
+    off_t offset;
+} SquashfsWriterConfig;
+
+/**
+ * Writes a squashfs image of a tree in-process with libsquashfs.
+ *
+ * The tree comes from a manifest, so the image holds exactly what the
+ * builder walked, with ownership, permissions, modification times, hardlinks,
+ * and extended attributes kept. File contents are deduplicated and packed
+ * into fragments like mksquashfs does, and blocks are compressed across a
+ * pool of worker threads.
+ *
+ * File data is laid out in tree order, or first by the priorities of a
+ * mksquashfs-style sort file when one is given. Files whose names mark them
+ * as already compressed (e.g. `.ko.xz`, `.png`) are stored without trying to
+ * compress them again.
+ *
+ * With a block cache directory, data blocks are looked up there before
+ * being compressed, so unchanged files reuse their compressed blocks from
+ * earlier builds (see create_block_cache_compressor()).
+ *
+ * With a memory limit, as many blocks are kept in flight as fit into it,
+ * counting each block twice for its uncompressed and compressed copies, but
+ * at least one per worker. Without one, each worker gets a fixed backlog.
+ *
+ * With a non-zero offset, the image is written into an existing file at
+ * that offset, keeping the bytes before it and dropping any after it.
+ *
+ * @param manifest The manifest of the tree to squash.
+ * @param output_path The path of the squashfs file to create.
+ * @param config The compressor, block size, workers, memory limit, order,
+ * cache, and offset to use.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates sort file read failure.
+ * @return - `-2` - Indicates writer setup failure.
+ * @return - `-3` - Indicates file data write failure.
+ * @return - `-4` - Indicates metadata write failure.
+ */
+int write_squashfs_image(
+    const Manifest *manifest, const char *output_path,
+    const SquashfsWriterConfig *config
+);
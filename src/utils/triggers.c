@@ -0,0 +1,127 @@
+/**
+ * This code is responsible for deferring expensive package triggers during
+ * package installation and running each of them once afterwards.
+ */
+
+#include "all.h"
+
+/** A type representing a trigger binary whose execution is deferred. */
+typedef struct
+{
+    const char *path;
+    int (*run)(const char *rootfs_path);
+    int required;
+} DeferredTrigger;
+
+static int run_ldconfig(const char *rootfs_path)
+{
+    return common.run_chroot_indented(rootfs_path, "ldconfig");
+}
+
+static int run_fc_cache(const char *rootfs_path)
+{
+    return common.run_chroot_indented(rootfs_path, "fc-cache -s");
+}
+
+/** The triggers deferred during package installation, in run order. */
+static const DeferredTrigger DEFERRED_TRIGGERS[] = {
+    { "/sbin/ldconfig", run_ldconfig, 1 },
+    { "/usr/bin/fc-cache", run_fc_cache, 0 },
+    { "/usr/sbin/update-initramfs", generate_rootfs_initramfs, 1 }
+};
+
+/** The number of deferred triggers. */
+#define DEFERRED_TRIGGERS_COUNT \
+    (int)(sizeof(DEFERRED_TRIGGERS) / sizeof(DEFERRED_TRIGGERS[0]))
+
+/** The no-op script installed in place of a deferred trigger. */
+static const char *TRIGGER_STUB =
+    "#!/bin/sh\n"
+    "# Deferred by the LimeOS ISO builder; runs once after configuration.\n"
+    "exit 0\n";
+
+int defer_rootfs_triggers(const char *rootfs_path)
+{
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    char stub_path[COMMON_MAX_PATH_LENGTH];
+
+    for (int i = 0; i < DEFERRED_TRIGGERS_COUNT; i++)
+    {
+        const DeferredTrigger *trigger = &DEFERRED_TRIGGERS[i];
+
+        // Divert the real binary, including any installed later.
+        snprintf(
+            command, sizeof(command),
+            "dpkg-divert --local --rename --divert %s" TRIGGERS_DIVERT_SUFFIX
+            " --add %s",
+            trigger->path, trigger->path
+        );
+        if (common.run_chroot(rootfs_path, command) != 0)
+        {
+            return -1;
+        }
+
+        // Put a no-op stub in place of the diverted binary.
+        snprintf(stub_path, sizeof(stub_path), "%s%s", rootfs_path, trigger->path);
+        if (common.write_file(stub_path, TRIGGER_STUB) != 0)
+        {
+            return -2;
+        }
+        if (common.chmod_file("+x", stub_path) != 0)
+        {
+            return -3;
+        }
+    }
+
+    return 0;
+}
+
+int run_deferred_triggers(const char *rootfs_path)
+{
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    char path[COMMON_MAX_PATH_LENGTH];
+
+    // Remove the stubs and move the real binaries back into place.
+    for (int i = 0; i < DEFERRED_TRIGGERS_COUNT; i++)
+    {
+        const DeferredTrigger *trigger = &DEFERRED_TRIGGERS[i];
+
+        snprintf(path, sizeof(path), "%s%s", rootfs_path, trigger->path);
+        common.rm_file(path);
+
+        snprintf(
+            command, sizeof(command),
+            "dpkg-divert --local --rename --divert %s" TRIGGERS_DIVERT_SUFFIX
+            " --remove %s",
+            trigger->path, trigger->path
+        );
+        if (common.run_chroot(rootfs_path, command) != 0)
+        {
+            return -1;
+        }
+    }
+
+    // Run each trigger once whose binary ended up installed.
+    for (int i = 0; i < DEFERRED_TRIGGERS_COUNT; i++)
+    {
+        const DeferredTrigger *trigger = &DEFERRED_TRIGGERS[i];
+
+        snprintf(path, sizeof(path), "%s%s", rootfs_path, trigger->path);
+        if (!common.file_exists(path))
+        {
+            continue;
+        }
+
+        LOG_INFO("Running deferred trigger: %s", trigger->path);
+        if (trigger->run(rootfs_path) != 0)
+        {
+            if (trigger->required)
+            {
+                return -2;
+            }
+            LOG_WARNING("Deferred trigger failed: %s", trigger->path);
+        }
+    }
+
+    return 0;
+}
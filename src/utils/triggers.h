@@ -0,0 +1,39 @@
+#pragma once
+#include "../all.h"
+
+/** The suffix appended to trigger binaries diverted out of the way. */
+#define TRIGGERS_DIVERT_SUFFIX ".limeos-deferred"
+
+/**
+ * Defers expensive package triggers in a rootfs.
+ *
+ * Diverts update-initramfs, ldconfig, and fc-cache with `dpkg-divert` and
+ * puts no-op stubs in their place, so package installation does not run
+ * them once per package or per hook. Packages that ship these binaries
+ * while the diversion is active install them under the diverted name.
+ *
+ * @param rootfs_path The path to the rootfs directory.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates diversion failure.
+ * @return - `-2` - Indicates stub write failure.
+ * @return - `-3` - Indicates stub permission failure.
+ */
+int defer_rootfs_triggers(const char *rootfs_path);
+
+/**
+ * Restores deferred triggers and runs each of them exactly once.
+ *
+ * Removes the stubs and diversions installed by defer_rootfs_triggers(),
+ * then runs ldconfig, fc-cache, and initramfs generation for every
+ * installed kernel (see generate_rootfs_initramfs()). Call this after all
+ * configuration that affects the initramfs (modules, Plymouth theme) is in
+ * place.
+ *
+ * @param rootfs_path The path to the rootfs directory.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates diversion removal failure.
+ * @return - `-2` - Indicates a required trigger failed.
+ */
+int run_deferred_triggers(const char *rootfs_path);
@@ -0,0 +1,107 @@
+/**
+ * This code is responsible for trading I/O durability for speed while
+ * building throwaway rootfs, and restoring it before they are packaged.
+ */
+
+#define _GNU_SOURCE
+#include "all.h"
+
+int seed_unsafe_io(const char *rootfs_path)
+{
+    char path[COMMON_MAX_PATH_LENGTH];
+
+    // Create the dpkg configuration directory ahead of debootstrap.
+    snprintf(path, sizeof(path), "%s/etc/dpkg/dpkg.cfg.d", rootfs_path);
+    if (common.mkdir_p(path) != 0)
+    {
+        return -1;
+    }
+
+    // Skip fsync and rename barriers while unpacking packages.
+    snprintf(path, sizeof(path), "%s" UNSAFE_IO_DPKG_CONFIG_PATH, rootfs_path);
+    if (common.write_file(path, "force-unsafe-io\n") != 0)
+    {
+        return -2;
+    }
+
+    return 0;
+}
+
+int enable_unsafe_io_preload(const char *rootfs_path)
+{
+    // Install the preload library from the rootfs' own archive.
+    if (common.run_chroot_indented(rootfs_path,
+        "DEBIAN_FRONTEND=noninteractive "
+        "apt-get install -y --no-install-recommends " UNSAFE_IO_PRELOAD_PACKAGE) != 0)
+    {
+        return -1;
+    }
+
+    // Locate the installed library.
+    char pattern[COMMON_MAX_PATH_LENGTH];
+    char library_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(pattern, sizeof(pattern), "%s" UNSAFE_IO_PRELOAD_GLOB, rootfs_path);
+    if (common.find_first_glob(pattern, library_path, sizeof(library_path)) != 0)
+    {
+        return -2;
+    }
+
+    // Preload it into every process, using its path inside the rootfs.
+    char preload_path[COMMON_MAX_PATH_LENGTH];
+    char preload_content[COMMON_MAX_PATH_LENGTH];
+    snprintf(preload_path, sizeof(preload_path), "%s/etc/ld.so.preload", rootfs_path);
+    snprintf(
+        preload_content, sizeof(preload_content),
+        "%s\n", library_path + strlen(rootfs_path)
+    );
+    if (common.write_file(preload_path, preload_content) != 0)
+    {
+        return -3;
+    }
+
+    return 0;
+}
+
+int restore_safe_io(const char *rootfs_path)
+{
+    char path[COMMON_MAX_PATH_LENGTH];
+
+    // Stop preloading before touching the library it points to.
+    snprintf(path, sizeof(path), "%s/etc/ld.so.preload", rootfs_path);
+    if (common.file_exists(path) && common.rm_file(path) != 0)
+    {
+        return -1;
+    }
+
+    // Purge the preload package if it was installed.
+    char pattern[COMMON_MAX_PATH_LENGTH];
+    char library_path[COMMON_MAX_PATH_LENGTH];
+    snprintf(pattern, sizeof(pattern), "%s" UNSAFE_IO_PRELOAD_GLOB, rootfs_path);
+    if (common.find_first_glob(pattern, library_path, sizeof(library_path)) == 0
+        && common.run_chroot_indented(rootfs_path, "dpkg --purge " UNSAFE_IO_PRELOAD_PACKAGE) != 0)
+    {
+        return -2;
+    }
+
+    // Remove the dpkg drop-in so the packaged system keeps safe defaults.
+    snprintf(path, sizeof(path), "%s" UNSAFE_IO_DPKG_CONFIG_PATH, rootfs_path);
+    if (common.file_exists(path) && common.rm_file(path) != 0)
+    {
+        return -3;
+    }
+
+    // Flush everything written without barriers in one pass.
+    int fd = open(rootfs_path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+    {
+        return -4;
+    }
+    int result = syncfs(fd);
+    close(fd);
+    if (result != 0)
+    {
+        return -4;
+    }
+
+    return 0;
+}
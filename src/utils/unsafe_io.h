@@ -0,0 +1,61 @@
+#pragma once
+#include "../all.h"
+
+/** The dpkg drop-in that disables per-file fsync during unpacking. */
+#define UNSAFE_IO_DPKG_CONFIG_PATH "/etc/dpkg/dpkg.cfg.d/limeos-unsafe-io"
+
+/** The package providing the fsync-suppressing preload library. */
+#define UNSAFE_IO_PRELOAD_PACKAGE "libeatmydata1"
+
+/** The glob matching the preload library inside a rootfs. */
+#define UNSAFE_IO_PRELOAD_GLOB "/usr/lib/*/libeatmydata.so.1"
+
+/**
+ * Seeds the dpkg unsafe-io drop-in into a rootfs that is about to be created.
+ *
+ * Must run before debootstrap so that dpkg picks up `force-unsafe-io` when
+ * it installs the base packages. The drop-in is not owned by any package, so
+ * it survives dpkg's own installation and is inherited by derived rootfs.
+ *
+ * @param rootfs_path The path to the (possibly empty) rootfs directory.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates directory creation failure.
+ * @return - `-2` - Indicates drop-in write failure.
+ */
+int seed_unsafe_io(const char *rootfs_path);
+
+/**
+ * Suppresses fsync for every process run inside a rootfs.
+ *
+ * Installs the eatmydata preload library from the rootfs' own archive, so it
+ * always matches the rootfs' C library, and registers it in
+ * /etc/ld.so.preload. This covers maintainer scripts and tools that dpkg's
+ * `force-unsafe-io` does not.
+ *
+ * @param rootfs_path The path to the rootfs directory.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates preload package installation failure.
+ * @return - `-2` - Indicates the preload library was not found.
+ * @return - `-3` - Indicates /etc/ld.so.preload write failure.
+ */
+int enable_unsafe_io_preload(const char *rootfs_path);
+
+/**
+ * Restores durable I/O in a rootfs and flushes it to disk.
+ *
+ * Removes /etc/ld.so.preload, purges the preload package, and removes the
+ * dpkg drop-in so none of them ship, then issues a single `syncfs` barrier
+ * for the filesystem holding the rootfs. Safe to call on a rootfs where
+ * only some of the above were set up.
+ *
+ * @param rootfs_path The path to the rootfs directory.
+ *
+ * @return - `0` - Indicates success.
+ * @return - `-1` - Indicates preload removal failure.
+ * @return - `-2` - Indicates preload package purge failure.
+ * @return - `-3` - Indicates drop-in removal failure.
+ * @return - `-4` - Indicates filesystem sync failure.
+ */
+int restore_safe_io(const char *rootfs_path);
@@ -0,0 +1,264 @@
+/**
+ * This code is responsible for testing the chunked archive functions.
+ */
+
+#include "../../all.h"
+
+/** The uncompressed file content per chunk used by the tests. */
+#define TEST_CHUNK_SIZE 1024
+
+/** The size of each test file, so two files fill a chunk. */
+#define TEST_FILE_SIZE 800
+
+/** The number of test files. */
+#define TEST_FILE_COUNT 5
+
+/** Test directory path for archiver tests. */
+static char test_dir[256];
+
+/** Source tree path for archiver tests. */
+static char source_dir[512];
+
+/** Output directory path for archiver tests. */
+static char output_dir[512];
+
+/** Sets up the test environment before each test. */
+static int setup(void **state)
+{
+    (void)state;
+
+    // Create a unique test directory with a source tree of equal files.
+    snprintf(
+        test_dir, sizeof(test_dir),
+        "/tmp/iso-builder-test-archiver-%d",
+        getpid()
+    );
+    snprintf(source_dir, sizeof(source_dir), "%s/source/etc", test_dir);
+    common.mkdir_p(source_dir);
+    snprintf(source_dir, sizeof(source_dir), "%s/source", test_dir);
+    snprintf(output_dir, sizeof(output_dir), "%s/output", test_dir);
+    common.mkdir_p(output_dir);
+
+    char content[TEST_FILE_SIZE + 1];
+    memset(content, 'x', TEST_FILE_SIZE);
+    content[TEST_FILE_SIZE] = '\0';
+    for (int i = 0; i < TEST_FILE_COUNT; i++)
+    {
+        char path[768];
+        snprintf(path, sizeof(path), "%s/etc/file-%d", source_dir, i);
+        common.write_file(path, content);
+    }
+
+    return 0;
+}
+
+/** Cleans up the test environment after each test. */
+static int teardown(void **state)
+{
+    (void)state;
+
+    // Remove the test directory.
+    common.rm_rf(test_dir);
+    return 0;
+}
+
+/** Writes the source tree as uncompressed chunks. */
+static void write_test_chunks(void)
+{
+    assert_int_equal(0, write_chunked_tar_archive(
+        source_dir, output_dir, "rootfs", ".tar", "cat", TEST_CHUNK_SIZE
+    ));
+}
+
+/** Writes the path of the chunk index into the given buffer. */
+static void get_index_path(char *path, size_t size)
+{
+    snprintf(path, size, "%s/rootfs" ARCHIVER_INDEX_EXTENSION, output_dir);
+}
+
+/** Counts the index lines of one chunk that name regular test files. */
+static int count_indexed_files(int chunk)
+{
+    char path[768];
+    get_index_path(path, sizeof(path));
+    FILE *index = fopen(path, "r");
+    assert_non_null(index);
+
+    int count = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), index))
+    {
+        int line_chunk;
+        char name[768];
+        if (sscanf(line, "file\t%d\t%767s", &line_chunk, name) == 2
+            && line_chunk == chunk && strstr(name, "/file-"))
+        {
+            count++;
+        }
+    }
+    fclose(index);
+
+    return count;
+}
+
+/** Counts the regular files stored in one chunk. */
+static int count_archived_files(const char *chunk_name)
+{
+    char path[768];
+    snprintf(path, sizeof(path), "%s/%s", output_dir, chunk_name);
+
+    struct archive *reader = archive_read_new();
+    archive_read_support_format_tar(reader);
+    assert_int_equal(
+        ARCHIVE_OK, archive_read_open_filename(reader, path, 10240)
+    );
+
+    int count = 0;
+    struct archive_entry *entry;
+    while (archive_read_next_header(reader, &entry) == ARCHIVE_OK)
+    {
+        if (archive_entry_filetype(entry) == AE_IFREG)
+        {
+            assert_int_equal(TEST_FILE_SIZE, archive_entry_size(entry));
+            count++;
+        }
+    }
+    archive_read_free(reader);
+
+    return count;
+}
+
+/** Verifies write_chunked_tar_archive() starts a chunk once one is full. */
+static void test_write_chunked_tar_archive_splits_chunks(void **state)
+{
+    (void)state;
+
+    write_test_chunks();
+
+    // Two files fill a chunk, so five files take three chunks.
+    char path[768];
+    get_index_path(path, sizeof(path));
+    ArchiveChunkList chunks;
+    assert_int_equal(0, read_archive_chunk_list(path, &chunks));
+    assert_int_equal(3, chunks.count);
+    assert_string_equal("rootfs.000.tar", chunks.names[0]);
+    assert_string_equal("rootfs.001.tar", chunks.names[1]);
+    assert_string_equal("rootfs.002.tar", chunks.names[2]);
+    free_archive_chunk_list(&chunks);
+}
+
+/** Verifies the index lists each chunk's files, size, and hash. */
+static void test_write_chunked_tar_archive_indexes_chunks(void **state)
+{
+    (void)state;
+
+    write_test_chunks();
+
+    char path[768];
+    get_index_path(path, sizeof(path));
+    FILE *index = fopen(path, "r");
+    assert_non_null(index);
+
+    // Check every chunk line against the chunk file it names.
+    int chunk = 0;
+    int files = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), index))
+    {
+        char name[256];
+        long long size;
+        char sha256[COMMON_SHA256_HEX_LENGTH];
+        if (sscanf(line, "chunk\t%255s\t%lld\t%64s", name, &size, sha256) != 3)
+        {
+            continue;
+        }
+        char chunk_path[768];
+        snprintf(chunk_path, sizeof(chunk_path), "%s/%s", output_dir, name);
+        assert_int_equal(size, get_file_size(chunk_path));
+        assert_int_equal(COMMON_SHA256_HEX_LENGTH - 1, strlen(sha256));
+
+        // The chunk holds exactly the files the index assigns to it.
+        int indexed = count_indexed_files(chunk);
+        assert_int_equal(indexed, count_archived_files(name));
+        files += indexed;
+        chunk++;
+    }
+    fclose(index);
+
+    assert_int_equal(3, chunk);
+    assert_int_equal(TEST_FILE_COUNT, files);
+}
+
+/** Verifies the index escapes paths that would break its lines. */
+static void test_write_chunked_tar_archive_escapes_paths(void **state)
+{
+    (void)state;
+
+    // Name a file like an index line that lists another chunk.
+    char path[768];
+    snprintf(path, sizeof(path), "%s/etc/a\\b\nchunk\trootfs.999.tar\t1\tx", source_dir);
+    common.write_file(path, "");
+    write_test_chunks();
+
+    // The injected chunk is not listed.
+    get_index_path(path, sizeof(path));
+    ArchiveChunkList chunks;
+    assert_int_equal(0, read_archive_chunk_list(path, &chunks));
+    assert_int_equal(3, chunks.count);
+    for (int i = 0; i < chunks.count; i++)
+    {
+        assert_string_not_equal("rootfs.999.tar", chunks.names[i]);
+    }
+    free_archive_chunk_list(&chunks);
+
+    // The file keeps its own escaped line.
+    FILE *index = fopen(path, "r");
+    assert_non_null(index);
+    int found = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), index))
+    {
+        if (strncmp(line, "file\t", 5) == 0
+            && strstr(line, "/a\\\\b\\nchunk\\trootfs.999.tar\\t1\\tx\n"))
+        {
+            found++;
+        }
+    }
+    fclose(index);
+    assert_int_equal(1, found);
+}
+
+/** Verifies read_archive_chunk_list() rejects chunk names that are paths. */
+static void test_read_archive_chunk_list_rejects_paths(void **state)
+{
+    (void)state;
+
+    char path[768];
+    get_index_path(path, sizeof(path));
+    common.write_file(path, "chunk\trootfs.000.tar\t1\tx\nchunk\t../rootfs.tar\t1\tx\n");
+
+    ArchiveChunkList chunks;
+    assert_int_equal(-3, read_archive_chunk_list(path, &chunks));
+    assert_int_equal(0, chunks.count);
+    assert_null(chunks.names);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(
+            test_write_chunked_tar_archive_splits_chunks, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_write_chunked_tar_archive_indexes_chunks, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_write_chunked_tar_archive_escapes_paths, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_read_archive_chunk_list_rejects_paths, setup, teardown
+        ),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,170 @@
+/**
+ * This code is responsible for testing the boot trace conversion functions.
+ */
+
+#include "../../all.h"
+
+/** Test directory path for boot trace tests. */
+static char test_dir[256];
+
+/** Trace log path for boot trace tests. */
+static char trace_path[512];
+
+/** Sort file path for boot trace tests. */
+static char sort_path[512];
+
+/** Sort file content read back by the boot trace tests. */
+static char sort[1024];
+
+/** Sets up the test environment before each test. */
+static int setup(void **state)
+{
+    (void)state;
+
+    // Create a unique test directory.
+    snprintf(
+        test_dir, sizeof(test_dir),
+        "/tmp/iso-builder-test-boot-trace-%d",
+        getpid()
+    );
+    common.mkdir_p(test_dir);
+    snprintf(trace_path, sizeof(trace_path), "%s/trace.log", test_dir);
+    snprintf(sort_path, sizeof(sort_path), "%s/sort.txt", test_dir);
+
+    return 0;
+}
+
+/** Cleans up the test environment after each test. */
+static int teardown(void **state)
+{
+    (void)state;
+
+    // Remove the test directory.
+    common.rm_rf(test_dir);
+    return 0;
+}
+
+/** Converts the given trace log and reads back the resulting sort file. */
+static void convert_trace(const char *trace)
+{
+    assert_int_equal(0, common.write_file(trace_path, trace));
+    assert_int_equal(0, convert_boot_trace(trace_path, sort_path));
+
+    FILE *f = fopen(sort_path, "r");
+    assert_non_null(f);
+    size_t bytes = fread(sort, 1, sizeof(sort) - 1, f);
+    sort[bytes] = '\0';
+    fclose(f);
+}
+
+/** Verifies convert_boot_trace() keeps only the first access of a path. */
+static void test_convert_boot_trace_deduplicates(void **state)
+{
+    (void)state;
+
+    convert_trace(
+        "10:00:00.000001 systemd(1): O /usr/lib/libc.so.6\n"
+        "10:00:00.000002 systemd(1): R /usr/lib/libc.so.6\n"
+        "10:00:00.000003 udevadm(90): RO /usr/lib/libc.so.6\n"
+        "10:00:00.000004 udevadm(90): O /usr/bin/udevadm\n"
+    );
+
+    assert_string_equal(
+        "usr/lib/libc.so.6 32767\n"
+        "usr/bin/udevadm 32766\n",
+        sort
+    );
+}
+
+/** Verifies convert_boot_trace() keeps the order of first accesses. */
+static void test_convert_boot_trace_orders_by_first_access(void **state)
+{
+    (void)state;
+
+    convert_trace(
+        "systemd(1): O /etc/fstab\n"
+        "systemd(1): R /usr/lib/systemd/systemd\n"
+        "mount(120): O /etc/fstab\n"
+        "mount(120): O /usr/bin/mount\n"
+        "systemd(1): R /usr/lib/systemd/systemd\n"
+    );
+
+    assert_string_equal(
+        "etc/fstab 32767\n"
+        "usr/lib/systemd/systemd 32766\n"
+        "usr/bin/mount 32765\n",
+        sort
+    );
+}
+
+/** Verifies convert_boot_trace() skips virtual and runtime filesystems. */
+static void test_convert_boot_trace_filters_paths(void **state)
+{
+    (void)state;
+
+    convert_trace(
+        "systemd(1): R /proc/self/mountinfo\n"
+        "systemd(1): R /sys/fs/cgroup/cgroup.controllers\n"
+        "systemd(1): W /run/systemd/units/invocation\n"
+        "systemd(1): O /dev/null\n"
+        "systemd(1): O /tmp/scratch\n"
+        "systemd(1): O /usr/share/file with spaces\n"
+        "malformed line without a path\n"
+        "systemd(1): O relative/path\n"
+        "systemd(1): O /usr/lib/os-release\n"
+    );
+
+    assert_string_equal("usr/lib/os-release 32767\n", sort);
+}
+
+/** Verifies convert_boot_trace() maps lower squashfs reads to the root. */
+static void test_convert_boot_trace_strips_rootfs_prefix(void **state)
+{
+    (void)state;
+
+    convert_trace(
+        "systemd(1): R " BOOT_TRACE_ROOTFS_PREFIX "/usr/bin/bash\n"
+        "bash(200): R /usr/bin/bash\n"
+        "systemd(1): R " BOOT_TRACE_ROOTFS_PREFIX "\n"
+        "systemd(1): R " BOOT_TRACE_ROOTFS_PREFIX ".old/usr/bin/ls\n"
+        "systemd(1): R /run/live/medium/live/filesystem.squashfs\n"
+        "bash(200): R " BOOT_TRACE_ROOTFS_PREFIX "/etc/bash.bashrc\n"
+    );
+
+    assert_string_equal(
+        "usr/bin/bash 32767\n"
+        "etc/bash.bashrc 32766\n",
+        sort
+    );
+}
+
+/** Verifies convert_boot_trace() fails on a missing trace log. */
+static void test_convert_boot_trace_missing_trace(void **state)
+{
+    (void)state;
+
+    assert_int_equal(-1, convert_boot_trace(trace_path, sort_path));
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(
+            test_convert_boot_trace_deduplicates, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_convert_boot_trace_orders_by_first_access, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_convert_boot_trace_filters_paths, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_convert_boot_trace_strips_rootfs_prefix, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_convert_boot_trace_missing_trace, setup, teardown
+        ),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
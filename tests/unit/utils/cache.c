@@ -0,0 +1,212 @@
+/**
+ * This code is responsible for testing the build cache functions.
+ */
+
+#include "../../all.h"
+
+/** The size of each test cache entry, a quarter of a MiB. */
+#define TEST_ENTRY_SIZE (256 * 1024)
+
+/** Test directory path for cache tests. */
+static char test_dir[256];
+
+/** Sets up the test environment before each test. */
+static int setup(void **state)
+{
+    (void)state;
+
+    // Create a unique test directory.
+    snprintf(
+        test_dir, sizeof(test_dir),
+        "/tmp/iso-builder-test-cache-%d",
+        getpid()
+    );
+    common.mkdir_p(test_dir);
+
+    return 0;
+}
+
+/** Cleans up the test environment after each test. */
+static int teardown(void **state)
+{
+    (void)state;
+
+    // Remove the test directory.
+    common.rm_rf(test_dir);
+    return 0;
+}
+
+/** Stores a test entry last used the given number of seconds ago. */
+static void store_test_entry(const char *name, int age)
+{
+    static char data[TEST_ENTRY_SIZE];
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", test_dir, name);
+    assert_int_equal(0, store_cache_data(path, data, sizeof(data)));
+
+    struct timespec times[2] = { { time(NULL) - age, 0 }, { time(NULL) - age, 0 } };
+    assert_int_equal(0, utimensat(AT_FDCWD, path, times, 0));
+}
+
+/** Checks whether a test entry exists. */
+static int has_test_entry(const char *name)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", test_dir, name);
+    return common.file_exists(path);
+}
+
+/** Verifies store_cache_file() stores a copy or a hardlink of a file. */
+static void test_store_cache_file_shares_when_asked(void **state)
+{
+    (void)state;
+
+    char src_path[512];
+    char copy_path[512];
+    char link_path[512];
+    snprintf(src_path, sizeof(src_path), "%s/source", test_dir);
+    snprintf(copy_path, sizeof(copy_path), "%s/copy.img", test_dir);
+    snprintf(link_path, sizeof(link_path), "%s/link.img", test_dir);
+    common.write_file(src_path, "initrd\n");
+
+    assert_int_equal(0, store_cache_file(src_path, copy_path, 0));
+    assert_int_equal(0, store_cache_file(src_path, link_path, 1));
+
+    struct stat src_st, copy_st, link_st;
+    assert_int_equal(0, stat(src_path, &src_st));
+    assert_int_equal(0, stat(copy_path, &copy_st));
+    assert_int_equal(0, stat(link_path, &link_st));
+    assert_int_not_equal(src_st.st_ino, copy_st.st_ino);
+    assert_int_equal(src_st.st_ino, link_st.st_ino);
+    assert_int_equal(src_st.st_size, copy_st.st_size);
+}
+
+/** Verifies store_cache_file() leaves nothing behind on failure. */
+static void test_store_cache_file_failure_leaves_no_entry(void **state)
+{
+    (void)state;
+
+    char src_path[512];
+    char cache_path[512];
+    snprintf(src_path, sizeof(src_path), "%s/missing", test_dir);
+    snprintf(cache_path, sizeof(cache_path), "%s/entry.img", test_dir);
+
+    assert_int_equal(-1, store_cache_file(src_path, cache_path, 1));
+
+    // Only the test directory itself is left.
+    DIR *dir = opendir(test_dir);
+    assert_non_null(dir);
+    int count = 0;
+    while (readdir(dir))
+    {
+        count++;
+    }
+    closedir(dir);
+    assert_int_equal(2, count);
+}
+
+/** Verifies prune_cache() removes the least recently used entries first. */
+static void test_prune_cache_removes_oldest(void **state)
+{
+    (void)state;
+
+    // Five quarter-MiB entries exceed a one-MiB limit by one entry.
+    store_test_entry("a.img", 400);
+    store_test_entry("b.img", 100);
+    store_test_entry("c.img", 300);
+    store_test_entry("d.img", 200);
+    store_test_entry("e.img", 0);
+
+    assert_int_equal(0, prune_cache(test_dir, ".img", 0, 1));
+
+    assert_false(has_test_entry("a.img"));
+    assert_true(has_test_entry("b.img"));
+    assert_true(has_test_entry("c.img"));
+    assert_true(has_test_entry("d.img"));
+    assert_true(has_test_entry("e.img"));
+}
+
+/** Verifies touch_cache_entry() keeps a used entry over newer ones. */
+static void test_prune_cache_keeps_touched(void **state)
+{
+    (void)state;
+
+    store_test_entry("a.img", 400);
+    store_test_entry("b.img", 300);
+    store_test_entry("c.img", 200);
+    store_test_entry("d.img", 100);
+    store_test_entry("e.img", 50);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/a.img", test_dir);
+    touch_cache_entry(path);
+    assert_int_equal(0, prune_cache(test_dir, ".img", 0, 1));
+
+    assert_true(has_test_entry("a.img"));
+    assert_false(has_test_entry("b.img"));
+}
+
+/** Verifies prune_cache() only counts matching, complete entries. */
+static void test_prune_cache_ignores_other_files(void **state)
+{
+    (void)state;
+
+    store_test_entry("a.img", 400);
+    store_test_entry("content.memo", 500);
+    store_test_entry("b.img" CACHE_TEMP_MARKER "1-0", 600);
+
+    assert_int_equal(0, prune_cache(test_dir, ".img", 0, 0));
+
+    assert_false(has_test_entry("a.img"));
+    assert_true(has_test_entry("content.memo"));
+    assert_true(has_test_entry("b.img" CACHE_TEMP_MARKER "1-0"));
+}
+
+/** Verifies prune_cache() reaches entries spread over subdirectories. */
+static void test_prune_cache_nested(void **state)
+{
+    (void)state;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/ab", test_dir);
+    common.mkdir_p(path);
+    snprintf(path, sizeof(path), "%s/cd", test_dir);
+    common.mkdir_p(path);
+    store_test_entry("ab/old", 300);
+    store_test_entry("cd/new", 0);
+
+    // A flat cache does not look into subdirectories.
+    assert_int_equal(0, prune_cache(test_dir, NULL, 0, 0));
+    assert_true(has_test_entry("ab/old"));
+
+    // A nested cache prunes the entries of every subdirectory.
+    assert_int_equal(0, prune_cache(test_dir, NULL, 1, 0));
+    assert_false(has_test_entry("ab/old"));
+    assert_false(has_test_entry("cd/new"));
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(
+            test_store_cache_file_shares_when_asked, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_store_cache_file_failure_leaves_no_entry, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_prune_cache_removes_oldest, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_prune_cache_keeps_touched, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_prune_cache_ignores_other_files, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_prune_cache_nested, setup, teardown
+        ),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,141 @@
+/**
+ * This code is responsible for testing the fingerprint functions.
+ */
+
+#include "../../all.h"
+
+/** Test directory path for fingerprint tests. */
+static char test_dir[256];
+
+/** Sets up the test environment before each test. */
+static int setup(void **state)
+{
+    (void)state;
+
+    // Create a unique test directory with a nested file.
+    snprintf(
+        test_dir, sizeof(test_dir),
+        "/tmp/iso-builder-test-fingerprint-%d",
+        getpid()
+    );
+    char path[512];
+    snprintf(path, sizeof(path), "%s/conf.d", test_dir);
+    common.mkdir_p(path);
+    snprintf(path, sizeof(path), "%s/conf.d/modules", test_dir);
+    common.write_file(path, "amdgpu\n");
+
+    return 0;
+}
+
+/** Cleans up the test environment after each test. */
+static int teardown(void **state)
+{
+    (void)state;
+
+    // Remove the test directory.
+    common.rm_rf(test_dir);
+    return 0;
+}
+
+/** Computes the fingerprint of the test directory. */
+static void fingerprint_test_dir(char *out_hex, size_t out_size)
+{
+    Fingerprint fingerprint;
+    assert_int_equal(0, init_fingerprint(&fingerprint));
+    assert_int_equal(0, add_fingerprint_tree(&fingerprint, "/etc", test_dir));
+    assert_int_equal(0, finish_fingerprint(&fingerprint, out_hex, out_size));
+}
+
+/** Verifies add_fingerprint_tree() is stable for an unchanged tree. */
+static void test_add_fingerprint_tree_is_stable(void **state)
+{
+    (void)state;
+
+    char first[COMMON_SHA256_HEX_LENGTH];
+    char second[COMMON_SHA256_HEX_LENGTH];
+    fingerprint_test_dir(first, sizeof(first));
+    fingerprint_test_dir(second, sizeof(second));
+
+    assert_string_equal(first, second);
+}
+
+/** Verifies add_fingerprint_tree() changes when a file's contents change. */
+static void test_add_fingerprint_tree_tracks_contents(void **state)
+{
+    (void)state;
+
+    char before[COMMON_SHA256_HEX_LENGTH];
+    fingerprint_test_dir(before, sizeof(before));
+
+    // Modify the nested file.
+    char path[512];
+    snprintf(path, sizeof(path), "%s/conf.d/modules", test_dir);
+    common.write_file(path, "amdgpu\ni915\n");
+
+    char after[COMMON_SHA256_HEX_LENGTH];
+    fingerprint_test_dir(after, sizeof(after));
+
+    assert_string_not_equal(before, after);
+}
+
+/** Hashes one subdirectory of the test directory with the given memo. */
+static void fingerprint_test_subdir(const char *name, FingerprintMemo *memo)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", test_dir, name);
+    Manifest manifest;
+    assert_int_equal(0, create_manifest(path, NULL, 0, &manifest));
+
+    Fingerprint fingerprint;
+    char hex[COMMON_SHA256_HEX_LENGTH];
+    assert_int_equal(0, init_fingerprint(&fingerprint));
+    assert_int_equal(0, add_fingerprint_manifest(&fingerprint, &manifest, memo));
+    assert_int_equal(0, finish_fingerprint(&fingerprint, hex, sizeof(hex)));
+    free_manifest(&manifest);
+}
+
+/** Verifies a memo shared by two trees saves the entries of both. */
+static void test_save_fingerprint_memo_keeps_all_trees(void **state)
+{
+    (void)state;
+
+    // Add a second tree next to the nested one.
+    char path[512];
+    snprintf(path, sizeof(path), "%s/layer", test_dir);
+    common.mkdir_p(path);
+    snprintf(path, sizeof(path), "%s/layer/hostname", test_dir);
+    common.write_file(path, "limeos\n");
+
+    // Hash both trees with one memo, saving after each as a build does.
+    char memo_path[512];
+    snprintf(memo_path, sizeof(memo_path), "%s/content.memo", test_dir);
+    FingerprintMemo memo;
+    assert_int_equal(0, load_fingerprint_memo(&memo, memo_path));
+    fingerprint_test_subdir("conf.d", &memo);
+    assert_int_equal(0, save_fingerprint_memo(&memo, memo_path));
+    fingerprint_test_subdir("layer", &memo);
+    assert_int_equal(0, save_fingerprint_memo(&memo, memo_path));
+    free_fingerprint_memo(&memo);
+
+    // The saved memo holds the files of both trees.
+    assert_int_equal(0, load_fingerprint_memo(&memo, memo_path));
+    assert_int_equal(2, memo.count);
+    free_fingerprint_memo(&memo);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(
+            test_add_fingerprint_tree_is_stable, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_add_fingerprint_tree_tracks_contents, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_save_fingerprint_memo_keeps_all_trees, setup, teardown
+        ),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
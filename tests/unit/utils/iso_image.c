@@ -0,0 +1,415 @@
+/**
+ * This code is responsible for testing the ISO image patching functions on
+ * small synthetic hybrid images.
+ */
+
+#include "../../all.h"
+
+/** The ISO 9660 logical sector size. */
+#define TEST_SECTOR 2048
+
+/** The sector size of the MBR and GPT partition tables. */
+#define TEST_DISK_SECTOR 512
+
+/** The sector of the primary tree's root directory. */
+#define TEST_PRIMARY_ROOT 20
+
+/** The sector of the Joliet tree's root directory. */
+#define TEST_JOLIET_ROOT 21
+
+/** The sector of the nested live directory. */
+#define TEST_LIVE_DIR 22
+
+/** The sector of the base placeholder's contents. */
+#define TEST_BASE_EXTENT 24
+
+/** The sector of the live placeholder's contents. */
+#define TEST_LIVE_EXTENT 25
+
+/** The number of sectors of the synthetic image. */
+#define TEST_SECTORS 26
+
+/** The number of GPT partition entries and their size. */
+#define TEST_GPT_ENTRIES 128
+#define TEST_GPT_ENTRY_SIZE 128
+
+/** The number of disk sectors the GPT partition array takes. */
+#define TEST_GPT_ENTRY_SECTORS (TEST_GPT_ENTRIES * TEST_GPT_ENTRY_SIZE / TEST_DISK_SECTOR)
+
+/** The extra bytes a mismatched placeholder record claims. */
+#define TEST_SIZE_MISMATCH 5
+
+/** Test directory path for ISO image tests. */
+static char test_dir[256];
+
+/** Synthetic image path for ISO image tests. */
+static char iso_path[512];
+
+/** The byte offset of the base placeholder's record in the primary tree. */
+static off_t primary_base_record;
+
+/** The byte offset of the base placeholder's record in the Joliet tree. */
+static off_t joliet_base_record;
+
+/** The byte offset of the live placeholder's record in the live directory. */
+static off_t live_record;
+
+static uint32_t get_le32(const unsigned char *data)
+{
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8
+        | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static uint32_t get_be32(const unsigned char *data)
+{
+    return (uint32_t)data[3] | (uint32_t)data[2] << 8
+        | (uint32_t)data[1] << 16 | (uint32_t)data[0] << 24;
+}
+
+static uint64_t get_le64(const unsigned char *data)
+{
+    return (uint64_t)get_le32(data) | (uint64_t)get_le32(data + 4) << 32;
+}
+
+static void put_le32(unsigned char *data, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        data[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static void put_le64(unsigned char *data, uint64_t value)
+{
+    put_le32(data, (uint32_t)value);
+    put_le32(data + 4, (uint32_t)(value >> 32));
+}
+
+static void put_both32(unsigned char *data, uint32_t value)
+{
+    put_le32(data, value);
+    for (int i = 0; i < 4; i++)
+    {
+        data[4 + i] = (unsigned char)(value >> (8 * (3 - i)));
+    }
+}
+
+static uint32_t get_crc32(const unsigned char *data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+/** Writes an ISO 9660 directory record and returns its length. */
+static size_t put_record(
+    unsigned char *out, uint32_t extent, uint32_t size, int directory,
+    const char *name, size_t name_length
+)
+{
+    // Names of even length are followed by a padding byte.
+    size_t length = 33 + name_length + (name_length % 2 == 0 ? 1 : 0);
+    memset(out, 0, length);
+    out[0] = (unsigned char)length;
+    put_both32(out + 2, extent);
+    put_both32(out + 10, size);
+    out[25] = directory ? 0x02 : 0x00;
+    out[32] = (unsigned char)name_length;
+    memcpy(out + 33, name, name_length);
+    return length;
+}
+
+/** Writes a directory's self and parent records and returns their length. */
+static size_t put_dot_records(unsigned char *out, uint32_t extent, uint32_t parent)
+{
+    size_t length = put_record(out, extent, TEST_SECTOR, 1, "\0", 1);
+    return length + put_record(out + length, parent, TEST_SECTOR, 1, "\1", 1);
+}
+
+/** Writes a volume descriptor whose root directory is at the given sector. */
+static void put_descriptor(unsigned char *out, int type, uint32_t root)
+{
+    out[0] = (unsigned char)type;
+    memcpy(out + 1, "CD001", 5);
+    out[6] = 1;
+    put_both32(out + 80, TEST_SECTORS);
+    put_record(out + 156, root, TEST_SECTOR, 1, "\0", 1);
+}
+
+/** Writes the protective MBR and a GPT over the whole image. */
+static void put_partition_tables(unsigned char *image)
+{
+    uint64_t last_lba = (uint64_t)TEST_SECTORS * TEST_SECTOR / TEST_DISK_SECTOR - 1;
+    uint64_t last_usable = last_lba - TEST_GPT_ENTRY_SECTORS - 1;
+
+    // Cover the image with a protective partition.
+    unsigned char *mbr_entry = image + 446;
+    mbr_entry[4] = 0xEE;
+    put_le32(mbr_entry + 8, 1);
+    put_le32(mbr_entry + 12, (uint32_t)last_lba);
+    image[510] = 0x55;
+    image[511] = 0xAA;
+
+    // Add an EFI partition in the middle and a data partition up to the end.
+    unsigned char *entries = image + 2 * TEST_DISK_SECTOR;
+    memset(entries, 0xA1, 16);
+    put_le64(entries + 32, 48);
+    put_le64(entries + 40, 55);
+    memset(entries + TEST_GPT_ENTRY_SIZE, 0xB2, 16);
+    put_le64(entries + TEST_GPT_ENTRY_SIZE + 32, 64);
+    put_le64(entries + TEST_GPT_ENTRY_SIZE + 40, last_usable);
+
+    unsigned char *header = image + TEST_DISK_SECTOR;
+    memcpy(header, "EFI PART", 8);
+    put_le32(header + 8, 0x00010000);
+    put_le32(header + 12, 92);
+    put_le64(header + 24, 1);
+    put_le64(header + 32, last_lba);
+    put_le64(header + 40, 2 + TEST_GPT_ENTRY_SECTORS);
+    put_le64(header + 48, last_usable);
+    put_le64(header + 72, 2);
+    put_le32(header + 80, TEST_GPT_ENTRIES);
+    put_le32(header + 84, TEST_GPT_ENTRY_SIZE);
+    put_le32(header + 88, get_crc32(entries, TEST_GPT_ENTRIES * TEST_GPT_ENTRY_SIZE));
+    put_le32(header + 16, get_crc32(header, 92));
+}
+
+/** Writes the synthetic image with both placeholders. */
+static void create_test_image(void)
+{
+    static unsigned char image[TEST_SECTORS * TEST_SECTOR];
+    memset(image, 0, sizeof(image));
+    put_partition_tables(image);
+
+    // Describe a primary and a Joliet tree, then end the descriptor set.
+    put_descriptor(image + 16 * TEST_SECTOR, 1, TEST_PRIMARY_ROOT);
+    put_descriptor(image + 17 * TEST_SECTOR, 2, TEST_JOLIET_ROOT);
+    image[18 * TEST_SECTOR] = 255;
+    memcpy(image + 18 * TEST_SECTOR + 1, "CD001", 5);
+
+    // Place the base placeholder in both roots, and the live placeholder,
+    // whose record claims more bytes than its marker, in a subdirectory.
+    char base_marker[128];
+    char live_marker[128];
+    size_t base_length = (size_t)snprintf(
+        base_marker, sizeof(base_marker), "limeos-iso-placeholder:base.squashfs\n"
+    );
+    size_t live_length = (size_t)snprintf(
+        live_marker, sizeof(live_marker), "limeos-iso-placeholder:live.squashfs\n"
+    );
+    memcpy(image + TEST_BASE_EXTENT * TEST_SECTOR, base_marker, base_length);
+    memcpy(image + TEST_LIVE_EXTENT * TEST_SECTOR, live_marker, live_length);
+
+    unsigned char *primary = image + TEST_PRIMARY_ROOT * TEST_SECTOR;
+    size_t position = put_dot_records(primary, TEST_PRIMARY_ROOT, TEST_PRIMARY_ROOT);
+    position += put_record(primary + position, TEST_LIVE_DIR, TEST_SECTOR, 1, "LIVE", 4);
+    primary_base_record = TEST_PRIMARY_ROOT * TEST_SECTOR + (off_t)position;
+    put_record(primary + position, TEST_BASE_EXTENT, (uint32_t)base_length, 0, "BASE.SQU;1", 10);
+
+    unsigned char *joliet = image + TEST_JOLIET_ROOT * TEST_SECTOR;
+    position = put_dot_records(joliet, TEST_JOLIET_ROOT, TEST_JOLIET_ROOT);
+    joliet_base_record = TEST_JOLIET_ROOT * TEST_SECTOR + (off_t)position;
+    put_record(joliet + position, TEST_BASE_EXTENT, (uint32_t)base_length, 0, "\0b\0a\0s\0e", 8);
+
+    unsigned char *live = image + TEST_LIVE_DIR * TEST_SECTOR;
+    position = put_dot_records(live, TEST_LIVE_DIR, TEST_PRIMARY_ROOT);
+    live_record = TEST_LIVE_DIR * TEST_SECTOR + (off_t)position;
+    put_record(
+        live + position, TEST_LIVE_EXTENT, (uint32_t)(live_length + TEST_SIZE_MISMATCH),
+        0, "LIVE.SQU;1", 10
+    );
+
+    FILE *file = fopen(iso_path, "w");
+    assert_non_null(file);
+    assert_int_equal(sizeof(image), fwrite(image, 1, sizeof(image), file));
+    assert_int_equal(0, fclose(file));
+}
+
+/** Reads part of the synthetic image. */
+static void read_image(off_t offset, void *out, size_t size)
+{
+    FILE *file = fopen(iso_path, "r");
+    assert_non_null(file);
+    assert_int_equal(0, fseeko(file, offset, SEEK_SET));
+    assert_int_equal(size, fread(out, 1, size, file));
+    fclose(file);
+}
+
+/** Checks the extent and size of a directory record in both byte orders. */
+static void assert_record(off_t record_offset, uint32_t extent, uint32_t size)
+{
+    unsigned char record[18];
+    read_image(record_offset, record, sizeof(record));
+    assert_int_equal(extent, get_le32(record + 2));
+    assert_int_equal(extent, get_be32(record + 6));
+    assert_int_equal(size, get_le32(record + 10));
+    assert_int_equal(size, get_be32(record + 14));
+}
+
+/** Checks a GPT header's CRC and returns its field at the given offset. */
+static uint64_t assert_gpt_header(const unsigned char *header)
+{
+    unsigned char copy[92];
+    memcpy(copy, header, sizeof(copy));
+    assert_memory_equal("EFI PART", copy, 8);
+    uint32_t crc = get_le32(copy + 16);
+    put_le32(copy + 16, 0);
+    assert_int_equal(crc, get_crc32(copy, sizeof(copy)));
+    return get_le64(header + 24);
+}
+
+/** Sets up the test environment before each test. */
+static int setup(void **state)
+{
+    (void)state;
+
+    // Create a unique test directory with the synthetic image.
+    snprintf(
+        test_dir, sizeof(test_dir),
+        "/tmp/iso-builder-test-iso-image-%d",
+        getpid()
+    );
+    common.mkdir_p(test_dir);
+    snprintf(iso_path, sizeof(iso_path), "%s/test.iso", test_dir);
+    create_test_image();
+
+    return 0;
+}
+
+/** Cleans up the test environment after each test. */
+static int teardown(void **state)
+{
+    (void)state;
+
+    // Remove the test directory.
+    common.rm_rf(test_dir);
+    return 0;
+}
+
+/** Verifies set_iso_placeholder_extent() patches every directory tree. */
+static void test_set_iso_placeholder_extent_patches_all_trees(void **state)
+{
+    (void)state;
+
+    off_t offset = (off_t)TEST_SECTORS * TEST_SECTOR;
+    assert_int_equal(0, set_iso_placeholder_extent(iso_path, "base.squashfs", offset, 123456));
+
+    assert_record(primary_base_record, TEST_SECTORS, 123456);
+    assert_record(joliet_base_record, TEST_SECTORS, 123456);
+}
+
+/** Verifies set_iso_placeholder_extent() skips records of another size. */
+static void test_set_iso_placeholder_extent_size_mismatch(void **state)
+{
+    (void)state;
+
+    // The live record names a marker, but claims more bytes than it holds.
+    size_t live_length = strlen("limeos-iso-placeholder:live.squashfs\n");
+    off_t offset = (off_t)TEST_SECTORS * TEST_SECTOR;
+    assert_int_equal(-2, set_iso_placeholder_extent(iso_path, "live.squashfs", offset, 4096));
+
+    assert_record(live_record, TEST_LIVE_EXTENT, (uint32_t)(live_length + TEST_SIZE_MISMATCH));
+}
+
+/** Verifies set_iso_placeholder_extent() rejects data beyond one extent. */
+static void test_set_iso_placeholder_extent_too_large(void **state)
+{
+    (void)state;
+
+    off_t offset = (off_t)TEST_SECTORS * TEST_SECTOR;
+    off_t size = (off_t)UINT32_MAX + 1;
+    assert_int_equal(-3, set_iso_placeholder_extent(iso_path, "base.squashfs", offset, size));
+}
+
+/** Verifies resize_iso_image() grows the volume and both partition tables. */
+static void test_resize_iso_image_moves_backup_gpt(void **state)
+{
+    (void)state;
+
+    // Append data that does not end on a sector.
+    off_t old_size = (off_t)TEST_SECTORS * TEST_SECTOR;
+    off_t data_end = old_size + 100001;
+    assert_int_equal(0, truncate(iso_path, data_end));
+    assert_int_equal(0, resize_iso_image(iso_path, old_size, data_end));
+
+    // The image ends on a sector after the data and the backup GPT.
+    struct stat st;
+    assert_int_equal(0, stat(iso_path, &st));
+    off_t reserved = (TEST_GPT_ENTRY_SECTORS + 1) * TEST_DISK_SECTOR;
+    assert_int_equal(0, st.st_size % TEST_SECTOR);
+    assert_true(st.st_size >= data_end + reserved);
+    assert_true(st.st_size < data_end + reserved + TEST_SECTOR);
+
+    // Both volume descriptors record the new size.
+    unsigned char descriptor[TEST_SECTOR];
+    for (int i = 0; i < 2; i++)
+    {
+        read_image((off_t)(16 + i) * TEST_SECTOR, descriptor, sizeof(descriptor));
+        assert_int_equal(st.st_size / TEST_SECTOR, get_le32(descriptor + 80));
+        assert_int_equal(st.st_size / TEST_SECTOR, get_be32(descriptor + 84));
+    }
+
+    // The protective partition reaches the new end.
+    uint64_t backup_lba = (uint64_t)st.st_size / TEST_DISK_SECTOR - 1;
+    unsigned char tables[2 * TEST_DISK_SECTOR];
+    read_image(0, tables, sizeof(tables));
+    assert_int_equal(backup_lba, get_le32(tables + 446 + 12));
+
+    // The primary header points at the backup at the last sector, and its
+    // CRCs cover the new header and partition array.
+    unsigned char *header = tables + TEST_DISK_SECTOR;
+    uint64_t last_usable = backup_lba - TEST_GPT_ENTRY_SECTORS - 1;
+    assert_int_equal(1, assert_gpt_header(header));
+    assert_int_equal(backup_lba, get_le64(header + 32));
+    assert_int_equal(last_usable, get_le64(header + 48));
+
+    static unsigned char entries[TEST_GPT_ENTRIES * TEST_GPT_ENTRY_SIZE];
+    read_image(2 * TEST_DISK_SECTOR, entries, sizeof(entries));
+    assert_int_equal(get_le32(header + 88), get_crc32(entries, sizeof(entries)));
+
+    // Only the partition that reached the old end grows.
+    assert_int_equal(55, get_le64(entries + 40));
+    assert_int_equal(last_usable, get_le64(entries + TEST_GPT_ENTRY_SIZE + 40));
+
+    // The backup header points back at the primary, after its own array.
+    unsigned char backup[TEST_DISK_SECTOR];
+    read_image((off_t)backup_lba * TEST_DISK_SECTOR, backup, sizeof(backup));
+    assert_int_equal(backup_lba, assert_gpt_header(backup));
+    assert_int_equal(1, get_le64(backup + 32));
+    assert_int_equal(backup_lba - TEST_GPT_ENTRY_SECTORS, get_le64(backup + 72));
+    assert_int_equal(get_le32(header + 88), get_le32(backup + 88));
+
+    static unsigned char backup_entries[TEST_GPT_ENTRIES * TEST_GPT_ENTRY_SIZE];
+    read_image(
+        (off_t)(backup_lba - TEST_GPT_ENTRY_SECTORS) * TEST_DISK_SECTOR,
+        backup_entries, sizeof(backup_entries)
+    );
+    assert_memory_equal(entries, backup_entries, sizeof(entries));
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(
+            test_set_iso_placeholder_extent_patches_all_trees, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_set_iso_placeholder_extent_size_mismatch, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_set_iso_placeholder_extent_too_large, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_resize_iso_image_moves_backup_gpt, setup, teardown
+        ),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
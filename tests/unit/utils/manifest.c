@@ -0,0 +1,106 @@
+/**
+ * This code is responsible for testing the manifest functions.
+ */
+
+#include "../../all.h"
+
+/** The size of the large extended attribute value, beyond one page. */
+#define TEST_XATTR_SIZE 10000
+
+/** Test directory path for manifest tests. */
+static char test_dir[256];
+
+/** Sets up the test environment before each test. */
+static int setup(void **state)
+{
+    (void)state;
+
+    // Create a unique test directory.
+    snprintf(
+        test_dir, sizeof(test_dir),
+        "/tmp/iso-builder-test-manifest-%d",
+        getpid()
+    );
+    common.mkdir_p(test_dir);
+
+    return 0;
+}
+
+/** Cleans up the test environment after each test. */
+static int teardown(void **state)
+{
+    (void)state;
+
+    // Remove the test directory.
+    common.rm_rf(test_dir);
+    return 0;
+}
+
+/** Verifies create_manifest() links hardlinks to the first sorted name. */
+static void test_create_manifest_links_to_first_sorted_name(void **state)
+{
+    (void)state;
+
+    // Create the names in reverse, so creation order differs from sorting.
+    char paths[3][512];
+    const char *names[] = { "c", "b", "a" };
+    for (int i = 0; i < 3; i++)
+    {
+        snprintf(paths[i], sizeof(paths[i]), "%s/%s", test_dir, names[i]);
+    }
+    common.write_file(paths[0], "shared\n");
+    assert_int_equal(0, link(paths[0], paths[1]));
+    assert_int_equal(0, link(paths[0], paths[2]));
+
+    Manifest manifest;
+    assert_int_equal(0, create_manifest(test_dir, NULL, 0, &manifest));
+    assert_int_equal(3, manifest.root->child_count);
+
+    ManifestEntry *first = manifest.root->children[0];
+    assert_string_equal("a", first->name);
+    assert_null(first->link);
+    assert_int_equal(3, first->link_count);
+    assert_true(manifest.root->children[1]->link == first);
+    assert_true(manifest.root->children[2]->link == first);
+    free_manifest(&manifest);
+}
+
+/** Verifies create_manifest() reads extended attributes of any size. */
+static void test_create_manifest_reads_large_xattrs(void **state)
+{
+    (void)state;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/file", test_dir);
+    common.write_file(path, "content\n");
+
+    static char value[TEST_XATTR_SIZE];
+    memset(value, 'v', sizeof(value));
+    if (setxattr(path, "user.large", value, sizeof(value), 0) != 0)
+    {
+        skip();
+    }
+
+    Manifest manifest;
+    assert_int_equal(0, create_manifest(test_dir, NULL, 0, &manifest));
+    ManifestEntry *entry = manifest.root->children[0];
+    assert_int_equal(1, entry->xattr_count);
+    assert_string_equal("user.large", entry->xattrs[0].name);
+    assert_int_equal(TEST_XATTR_SIZE, entry->xattrs[0].size);
+    assert_memory_equal(value, entry->xattrs[0].value, TEST_XATTR_SIZE);
+    free_manifest(&manifest);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(
+            test_create_manifest_links_to_first_sorted_name, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_create_manifest_reads_large_xattrs, setup, teardown
+        ),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
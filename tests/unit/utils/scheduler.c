@@ -0,0 +1,138 @@
+/**
+ * This code is responsible for testing the task scheduler.
+ */
+
+#include "../../all.h"
+
+/** Test directory path for scheduler tests. */
+static char test_dir[256];
+
+/** Sets up the test environment before each test. */
+static int setup(void **state)
+{
+    (void)state;
+
+    // Create a unique test directory.
+    snprintf(
+        test_dir, sizeof(test_dir),
+        "/tmp/iso-builder-test-scheduler-%d",
+        getpid()
+    );
+    common.mkdir_p(test_dir);
+
+    return 0;
+}
+
+/** Cleans up the test environment after each test. */
+static int teardown(void **state)
+{
+    (void)state;
+
+    // Remove the test directory.
+    common.rm_rf(test_dir);
+    return 0;
+}
+
+/** Creates a marker file named after the context string. */
+static int mark_task(void *context)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", test_dir, (const char *)context);
+    return common.write_file(path, "");
+}
+
+/** Succeeds only when the marker named by the context already exists. */
+static int require_marker_task(void *context)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", test_dir, (const char *)context);
+    if (!common.file_exists(path))
+    {
+        return -1;
+    }
+    return mark_task("joined");
+}
+
+/** Always fails. */
+static int fail_task(void *context)
+{
+    (void)context;
+    return -1;
+}
+
+/** Verifies run_scheduler() starts a task only after its dependencies. */
+static void test_run_scheduler_respects_dependencies(void **state)
+{
+    (void)state;
+
+    Scheduler scheduler;
+    init_scheduler(&scheduler);
+
+    // Declare a task that requires the marker of its dependency.
+    int first = add_scheduler_task(&scheduler, "first", mark_task, "first");
+    int second = add_scheduler_task(&scheduler, "second", require_marker_task, "first");
+    assert_int_equal(0, add_scheduler_dependency(&scheduler, second, first));
+
+    // Run the graph and verify the dependent task observed the marker.
+    assert_int_equal(0, run_scheduler(&scheduler));
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/joined", test_dir);
+    assert_true(common.file_exists(path));
+}
+
+/** Verifies run_scheduler() never starts dependents of a failed task. */
+static void test_run_scheduler_cancels_dependents_on_failure(void **state)
+{
+    (void)state;
+
+    Scheduler scheduler;
+    init_scheduler(&scheduler);
+
+    // Declare a failing task with a dependent.
+    int failing = add_scheduler_task(&scheduler, "failing", fail_task, NULL);
+    int dependent = add_scheduler_task(&scheduler, "dependent", mark_task, "dependent");
+    assert_int_equal(0, add_scheduler_dependency(&scheduler, dependent, failing));
+
+    // Run the graph and verify the dependent never ran.
+    assert_int_equal(-1, run_scheduler(&scheduler));
+    assert_int_equal(SCHEDULER_TASK_CANCELLED, scheduler.tasks[dependent].state);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/dependent", test_dir);
+    assert_false(common.file_exists(path));
+}
+
+/** Verifies run_scheduler() reports tasks stuck in a dependency cycle. */
+static void test_run_scheduler_detects_cycles(void **state)
+{
+    (void)state;
+
+    Scheduler scheduler;
+    init_scheduler(&scheduler);
+
+    // Declare two tasks that depend on each other.
+    int first = add_scheduler_task(&scheduler, "first", mark_task, "first");
+    int second = add_scheduler_task(&scheduler, "second", mark_task, "second");
+    assert_int_equal(0, add_scheduler_dependency(&scheduler, first, second));
+    assert_int_equal(0, add_scheduler_dependency(&scheduler, second, first));
+
+    assert_int_equal(-4, run_scheduler(&scheduler));
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(
+            test_run_scheduler_respects_dependencies, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_run_scheduler_cancels_dependents_on_failure, setup, teardown
+        ),
+        cmocka_unit_test_setup_teardown(
+            test_run_scheduler_detects_cycles, setup, teardown
+        ),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,264 @@
+/**
+ * This code is responsible for testing the native squashfs writer by
+ * writing images of a tree and reading them back with unsquashfs.
+ */
+
+#include "../../all.h"
+
+/** The block size of the test images, small enough to span several blocks. */
+#define TEST_BLOCK_SIZE 4096
+
+/** The modification time given to every test tree entry. */
+#define TEST_MTIME 1700000000
+
+/** Test directory path for squashfs writer tests. */
+static char test_dir[256];
+
+/** Source tree path for squashfs writer tests. */
+static char source_dir[512];
+
+/** Block cache path for squashfs writer tests. */
+static char cache_dir[512];
+
+/** Writes a file of the given size, filled with a repeating pattern. */
+static void write_pattern_file(const char *name, size_t size)
+{
+    char path[768];
+    snprintf(path, sizeof(path), "%s/%s", source_dir, name);
+    FILE *file = fopen(path, "w");
+    assert_non_null(file);
+    for (size_t i = 0; i < size; i++)
+    {
+        fputc((int)((i * 7 + i / 251) & 0xff), file);
+    }
+    assert_int_equal(0, fclose(file));
+}
+
+/** Sets up the test environment before each test. */
+static int setup(void **state)
+{
+    (void)state;
+
+    // Create a unique test directory with a source tree and a block cache.
+    snprintf(
+        test_dir, sizeof(test_dir),
+        "/tmp/iso-builder-test-squashfs-writer-%d",
+        getpid()
+    );
+    snprintf(source_dir, sizeof(source_dir), "%s/source/etc/skel", test_dir);
+    common.mkdir_p(source_dir);
+    snprintf(source_dir, sizeof(source_dir), "%s/source", test_dir);
+    snprintf(cache_dir, sizeof(cache_dir), "%s/blocks", test_dir);
+    common.mkdir_p(cache_dir);
+
+    return 0;
+}
+
+/** Cleans up the test environment after each test. */
+static int teardown(void **state)
+{
+    (void)state;
+
+    // Remove the test directory.
+    common.rm_rf(test_dir);
+    return 0;
+}
+
+/** Builds a tree holding every kind of entry the writer supports. */
+static void create_test_tree(void)
+{
+    char path[768];
+    char other_path[768];
+
+    // Regular files spanning several blocks, ending in a fragment, and empty.
+    write_pattern_file("etc/large", 5 * TEST_BLOCK_SIZE + 123);
+    write_pattern_file("etc/small", 100);
+    write_pattern_file("etc/empty", 0);
+
+    // A sparse file with data only at its end.
+    snprintf(path, sizeof(path), "%s/etc/sparse", source_dir);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    assert_true(fd >= 0);
+    assert_int_equal(0, ftruncate(fd, 8 * TEST_BLOCK_SIZE));
+    assert_int_equal(3, pwrite(fd, "end", 3, 8 * TEST_BLOCK_SIZE - 3));
+    assert_int_equal(0, close(fd));
+
+    // Three names of one file, created out of sorted order.
+    write_pattern_file("etc/skel/link-c", 2 * TEST_BLOCK_SIZE);
+    snprintf(path, sizeof(path), "%s/etc/skel/link-c", source_dir);
+    snprintf(other_path, sizeof(other_path), "%s/etc/link-a", source_dir);
+    assert_int_equal(0, link(path, other_path));
+    snprintf(other_path, sizeof(other_path), "%s/link-b", source_dir);
+    assert_int_equal(0, link(path, other_path));
+
+    // Symbolic links, one of them dangling.
+    snprintf(path, sizeof(path), "%s/etc/small-link", source_dir);
+    assert_int_equal(0, symlink("small", path));
+    snprintf(path, sizeof(path), "%s/dangling", source_dir);
+    assert_int_equal(0, symlink("/nonexistent/target", path));
+
+    // Special files, with their owners and modes.
+    struct stat null_st;
+    assert_int_equal(0, stat("/dev/null", &null_st));
+    snprintf(path, sizeof(path), "%s/null", source_dir);
+    assert_int_equal(0, mknod(path, S_IFCHR | 0666, null_st.st_rdev));
+    snprintf(path, sizeof(path), "%s/block", source_dir);
+    assert_int_equal(0, mknod(path, S_IFBLK | 0660, null_st.st_rdev));
+    snprintf(path, sizeof(path), "%s/fifo", source_dir);
+    assert_int_equal(0, mkfifo(path, 0640));
+    snprintf(path, sizeof(path), "%s/etc/small", source_dir);
+    assert_int_equal(0, chown(path, 1000, 100));
+    assert_int_equal(0, chmod(path, 04755));
+    snprintf(path, sizeof(path), "%s/etc/skel", source_dir);
+    assert_int_equal(0, chmod(path, 0700));
+
+    // Extended attributes on a file and a directory.
+    snprintf(path, sizeof(path), "%s/etc/large", source_dir);
+    assert_int_equal(0, setxattr(path, "user.comment", "large file", 10, 0));
+    assert_int_equal(0, setxattr(path, "trusted.overlay.opaque", "y", 1, 0));
+    snprintf(path, sizeof(path), "%s/etc", source_dir);
+    assert_int_equal(0, setxattr(path, "user.directory", "etc", 3, 0));
+
+    // Fix every modification time, directories after their contents.
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        command, sizeof(command),
+        "find %s -depth -exec touch -h -d @%d {} +", source_dir, TEST_MTIME
+    );
+    assert_int_equal(0, common.run_command(command));
+}
+
+/** Finds an extended attribute of a manifest entry by name. */
+static const ManifestXattr *find_xattr(const ManifestEntry *entry, const char *name)
+{
+    for (int i = 0; i < entry->xattr_count; i++)
+    {
+        if (strcmp(entry->xattrs[i].name, name) == 0)
+        {
+            return &entry->xattrs[i];
+        }
+    }
+    return NULL;
+}
+
+/** Checks that an extracted entry matches its source entry, recursively. */
+static void assert_entries_equal(const ManifestEntry *expected, const ManifestEntry *actual)
+{
+    assert_string_equal(expected->relative_path, actual->relative_path);
+    assert_int_equal(expected->st.st_mode, actual->st.st_mode);
+    assert_int_equal(expected->st.st_uid, actual->st.st_uid);
+    assert_int_equal(expected->st.st_gid, actual->st.st_gid);
+    assert_int_equal(expected->st.st_mtim.tv_sec, actual->st.st_mtim.tv_sec);
+
+    // Compare contents, link targets, and device numbers.
+    if (S_ISREG(expected->st.st_mode))
+    {
+        char expected_sha256[COMMON_SHA256_HEX_LENGTH];
+        char actual_sha256[COMMON_SHA256_HEX_LENGTH];
+        assert_int_equal(expected->st.st_size, actual->st.st_size);
+        assert_int_equal(0, common.compute_file_sha256(
+            expected->path, expected_sha256, sizeof(expected_sha256)
+        ));
+        assert_int_equal(0, common.compute_file_sha256(
+            actual->path, actual_sha256, sizeof(actual_sha256)
+        ));
+        assert_string_equal(expected_sha256, actual_sha256);
+    }
+    if (S_ISLNK(expected->st.st_mode))
+    {
+        assert_string_equal(expected->target, actual->target);
+    }
+    if (S_ISCHR(expected->st.st_mode) || S_ISBLK(expected->st.st_mode))
+    {
+        assert_int_equal(expected->st.st_rdev, actual->st.st_rdev);
+    }
+
+    // Compare hardlinks by the name they point at.
+    assert_int_equal(expected->link_count, actual->link_count);
+    assert_int_equal(expected->link != NULL, actual->link != NULL);
+    if (expected->link)
+    {
+        assert_string_equal(expected->link->relative_path, actual->link->relative_path);
+    }
+
+    // Compare extended attributes, which may be listed in another order.
+    assert_int_equal(expected->xattr_count, actual->xattr_count);
+    for (int i = 0; i < expected->xattr_count; i++)
+    {
+        const ManifestXattr *xattr = find_xattr(actual, expected->xattrs[i].name);
+        assert_non_null(xattr);
+        assert_int_equal(expected->xattrs[i].size, xattr->size);
+        assert_memory_equal(expected->xattrs[i].value, xattr->value, xattr->size);
+    }
+
+    assert_int_equal(expected->child_count, actual->child_count);
+    for (int i = 0; i < expected->child_count; i++)
+    {
+        assert_entries_equal(expected->children[i], actual->children[i]);
+    }
+}
+
+/** Writes the test tree natively, extracts it, and compares both trees. */
+static void assert_round_trip(const Manifest *manifest, const char *name, int memory_mib)
+{
+    char image_path[768];
+    char extract_path[768];
+    snprintf(image_path, sizeof(image_path), "%s/%s.squashfs", test_dir, name);
+    snprintf(extract_path, sizeof(extract_path), "%s/%s", test_dir, name);
+
+    SquashfsWriterConfig config = {
+        .compressor = "gzip",
+        .block_size = TEST_BLOCK_SIZE,
+        .workers = 4,
+        .memory_mib = memory_mib,
+        .block_cache_dir = cache_dir
+    };
+    assert_int_equal(0, write_squashfs_image(manifest, image_path, &config));
+
+    // Extract the image as root, keeping owners, devices, and attributes.
+    char command[COMMON_MAX_COMMAND_LENGTH];
+    snprintf(
+        command, sizeof(command), "unsquashfs -no-progress -quiet -d %s %s",
+        extract_path, image_path
+    );
+    assert_int_equal(0, common.run_command(command));
+
+    Manifest extracted;
+    assert_int_equal(0, create_manifest(extract_path, NULL, 0, &extracted));
+    assert_entries_equal(manifest->root, extracted.root);
+    free_manifest(&extracted);
+}
+
+/** Verifies write_squashfs_image() keeps every kind of entry intact. */
+static void test_write_squashfs_image_round_trip(void **state)
+{
+    (void)state;
+
+    // Devices, owners, and trusted attributes need root, and reading the
+    // image back needs unsquashfs.
+    if (geteuid() != 0 || !common.is_command_available("unsquashfs"))
+    {
+        skip();
+    }
+
+    create_test_tree();
+    Manifest manifest;
+    assert_int_equal(0, create_manifest(source_dir, NULL, 0, &manifest));
+
+    // Write twice, so the second image is built from cached blocks, and
+    // with a memory limit small enough to bound the blocks in flight.
+    assert_round_trip(&manifest, "cold", 0);
+    assert_round_trip(&manifest, "cached", 1);
+    free_manifest(&manifest);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(
+            test_write_squashfs_image_round_trip, setup, teardown
+        ),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}